@@ -15,12 +15,15 @@
 ## You should have received a copy of the GNU General Public License
 ## along with Somato.  If not, see <http://www.gnu.org/licenses/>.
 
-#serial 20180128
+#serial 20261018
 
 ## SOMATO_ARG_ENABLE_VECTOR_SIMD()
 ##
 ## Provide the --enable-vector-simd configure argument, set to 'auto'
-## by default.
+## by default. On top of SSE, kernels for AVX2 and FMA are built if the
+## compiler supports per-function target selection, and are picked at
+## run time if the CPU supports them. NEON is part of the baseline of
+## 64-bit ARM, and thus selected at build time.
 ##
 AC_DEFUN([SOMATO_ARG_ENABLE_VECTOR_SIMD],
 [dnl
@@ -38,22 +41,66 @@ b = _mm_mul_ps(a, a);
   [somato_cv_simd_sse_support=yes],
   [somato_cv_simd_sse_support=no])
 ])
+AC_CACHE_CHECK([for AVX2 and FMA runtime dispatch support], [somato_cv_simd_avx2_support],
+               [AC_LINK_IFELSE([AC_LANG_PROGRAM(
+[[
+#include <immintrin.h>
+
+__attribute__((target("avx2,fma")))
+static float fmadd8(float x)
+{
+  const __m256 a = _mm256_set1_ps(x);
+  const __m256 b = _mm256_fmadd_ps(a, a, _mm256_permute_ps(a, 0x55));
+  return _mm_cvtss_f32(_mm256_castps256_ps128(b));
+}
+]], [[
+__builtin_cpu_init();
+if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  (void) fmadd8(2.0f);
+]])],
+  [somato_cv_simd_avx2_support=yes],
+  [somato_cv_simd_avx2_support=no])
+])
+AC_CACHE_CHECK([for NEON support], [somato_cv_simd_neon_support],
+               [AC_COMPILE_IFELSE([AC_LANG_PROGRAM(
+[[
+#include <arm_neon.h>
+]], [[
+float32x4_t a;
+a = vdupq_n_f32(1.0f);
+a = vfmaq_laneq_f32(a, a, a, 3);
+(void) vaddvq_f32(a);
+]])],
+  [somato_cv_simd_neon_support=yes],
+  [somato_cv_simd_neon_support=no])
+])
 AC_ARG_ENABLE([vector-simd], [AS_HELP_STRING(
-  [--enable-vector-simd=@<:@auto|sse|no@:>@],
+  [--enable-vector-simd=@<:@auto|sse|neon|no@:>@],
   [use SIMD instructions for vector arithmetic @<:@auto@:>@])],
   [somato_enable_vector_simd=$enableval],
   [somato_enable_vector_simd=auto])[]dnl
 
 AC_MSG_CHECKING([which SIMD vector implementation to use])
 somato_result=none
+somato_dispatch=
 
 AS_IF([test "x$somato_cv_simd_sse_support" = xyes],
       [AS_CASE([$somato_enable_vector_simd],
-               [sse|auto|yes], [somato_result=sse])])
+               [sse|auto|yes], [somato_result=sse])],
+      [test "x$somato_cv_simd_neon_support" = xyes],
+      [AS_CASE([$somato_enable_vector_simd],
+               [neon|auto|yes], [somato_result=neon])])
 AM_CONDITIONAL([SIMD_SSE], [test "x$somato_result" = xsse])
 AM_COND_IF([SIMD_SSE], [AC_DEFINE([SOMATO_VECTOR_USE_SSE], [1],
                                   [Define to 1 to enable the SSE vector code.])])
-AC_MSG_RESULT([$somato_result])
+AS_IF([test "x$somato_result$somato_cv_simd_avx2_support" = xsseyes],
+      [AC_DEFINE([SOMATO_VECTOR_USE_AVX2], [1],
+                 [Define to 1 to enable run-time selected AVX2 vector code.])
+       somato_dispatch=" (avx2 selected at run time)"])
+AS_IF([test "x$somato_result" = xneon],
+      [AC_DEFINE([SOMATO_VECTOR_USE_NEON], [1],
+                 [Define to 1 to enable the NEON vector code.])])
+AC_MSG_RESULT([$somato_result$somato_dispatch])
 
 AS_CASE([$somato_enable_vector_simd], [auto|yes|no],,
         [AS_IF([test "x$somato_result" != "x$somato_enable_vector_simd"], [AC_MSG_FAILURE([[
@@ -21,6 +21,7 @@
 
 #include "application.h"
 #include "mainwindow.h"
+#include "puzzle.h"
 
 #include <giomm/menumodel.h>
 #include <gtkmm/aboutdialog.h>
@@ -29,6 +30,8 @@
 
 #include <algorithm>
 #include <memory>
+#include <string>
+#include <utility>
 
 namespace
 {
@@ -63,7 +66,15 @@ Application::~Application()
 Application::Application()
 :
   Gtk::Application("org.gtk.somato")
-{}
+{
+  add_main_option_entry(OPTION_TYPE_FILENAME, "puzzle", '\0',
+                        "Solve the puzzle defined in FILE", "FILE");
+  add_main_option_entry(OPTION_TYPE_BOOL, "solver-stats", '\0',
+                        "Print puzzle solver statistics as JSON");
+
+  signal_handle_local_options()
+    .connect(sigc::mem_fun(*this, &Application::on_handle_local_options));
+}
 
 void Application::on_startup()
 {
@@ -82,6 +93,7 @@ void Application::on_startup()
   set_accel_for_action ("win.cycle",        "c");
   set_accel_for_action ("win.grid",         "g");
   set_accel_for_action ("win.outline",      "o");
+  set_accel_for_action ("win.voxel",        "v");
   set_accel_for_action ("win.antialias",    "a");
   set_accels_for_action("win.fullscreen",  {"f", "F11"});
   set_accel_for_action ("win.unfullscreen", "Escape");
@@ -110,7 +122,7 @@ void Application::on_activate()
   }
   add_window(*app_window);
 
-  app_window->run_puzzle_solver();
+  app_window->run_puzzle_solver(puzzle_, solver_stats_);
   app_window->present();
 }
 
@@ -121,6 +133,47 @@ void Application::on_window_removed(Gtk::Window* window)
   delete window;
 }
 
+int Application::on_handle_local_options(const Glib::RefPtr<Glib::VariantDict>& options)
+{
+  solver_stats_ = options->contains("solver-stats");
+
+  std::string filename;
+
+  if (options->lookup_value("puzzle", filename))
+    try
+    {
+      auto puzzle = PuzzleDefinition::load(filename);
+      check_puzzle_displayable(puzzle);
+      puzzle_ = std::move(puzzle);
+    }
+    catch (const PuzzleDefinition::Error& error)
+    {
+      g_printerr("%s\n", error.what());
+      return 1;
+    }
+
+  // The options only take effect where the main window is created. If an
+  // instance is running already, it would merely be activated instead.
+  if (solver_stats_ || !filename.empty())
+    try
+    {
+      if (register_application() && is_remote())
+      {
+        g_printerr("Somato is already running, and cannot be passed "
+                   "the --puzzle or --solver-stats options\n");
+        return 1;
+      }
+    }
+    catch (const Glib::Error& error)
+    {
+      g_printerr("%s\n", error.what().c_str());
+      return 1;
+    }
+
+  // Continue with the default processing.
+  return -1;
+}
+
 void Application::show_about()
 {
   MainWindow* main_window = nullptr;
@@ -20,6 +20,8 @@
 #ifndef SOMATO_APPLICATION_H_INCLUDED
 #define SOMATO_APPLICATION_H_INCLUDED
 
+#include "puzzledef.h"
+
 #include <gtkmm/application.h>
 
 namespace Somato
@@ -39,8 +41,12 @@ protected:
   void on_window_removed(Gtk::Window* window) override;
 
 private:
+  int  on_handle_local_options(const Glib::RefPtr<Glib::VariantDict>& options);
   void show_about();
   void close_all();
+
+  PuzzleDefinition puzzle_      = PuzzleDefinition::soma_cube();
+  bool             solver_stats_ = false;
 };
 
 } // namespace Somato
@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "bitcube.h"
+#include "puzzlecube.h"
+#include "puzzlesolver.h"
+
+#if SOMATO_VECTOR_USE_SSE && !SOMATO_BENCH_FALLBACK
+# include "simd_dispatch.h"
+#else
+# include "simd_fallback.h"
+#endif
+
+#include <glib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Self-contained microbenchmarks for the bit cube operations, the puzzle
+ * cube accessors, the Simd kernels and the complete puzzle solver. Each
+ * benchmark is calibrated to run for a minimum time per sample, and the
+ * median and minimum time per iteration over several samples are written
+ * to standard output as JSON.
+ */
+namespace
+{
+
+using namespace Somato;
+using Simd::V4f;
+
+typedef std::chrono::steady_clock Clock;
+
+enum { INPUT_COUNT = 64, BATCH_COUNT = 1024 };
+
+char*    option_filter      = nullptr;
+int      option_repetitions = 5;
+double   option_min_time    = 0.02;
+gboolean option_list        = FALSE;
+
+const GOptionEntry option_entries[] =
+{
+  {"filter", 'f', 0, G_OPTION_ARG_STRING, &option_filter,
+   "Only run benchmarks whose name contains STRING", "STRING"},
+  {"repetitions", 'r', 0, G_OPTION_ARG_INT, &option_repetitions,
+   "Number of timed samples per benchmark", "N"},
+  {"min-time", 't', 0, G_OPTION_ARG_DOUBLE, &option_min_time,
+   "Minimum duration of each sample in seconds", "SECONDS"},
+  {"list", 'l', 0, G_OPTION_ARG_NONE, &option_list,
+   "List the benchmark names without running them", nullptr},
+  {nullptr, '\0', 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr}
+};
+
+/* Force the compiler to materialize a value without otherwise
+ * constraining the code generated for it.
+ */
+template <typename T>
+inline void keep(const T& value)
+{
+  asm volatile ("" : : "r,m" (value) : "memory");
+}
+
+struct Result
+{
+  std::string name;
+  std::size_t iterations;
+  std::size_t items;
+  double      median_ns;
+  double      min_ns;
+};
+
+class Runner
+{
+public:
+  Runner() = default;
+
+  Runner(const Runner&) = delete;
+  Runner& operator=(const Runner&) = delete;
+
+  // Run func(n) for n iterations at a time. If items is not 1, each
+  // iteration processes that many items, which is reported along with
+  // the time per iteration.
+  template <typename F>
+  void run(const std::string& name, F func, std::size_t items = 1);
+
+  void write_json(std::FILE* out) const;
+
+private:
+  template <typename F> static double time_iterations(F& func, std::size_t n);
+
+  std::vector<Result> results_;
+};
+
+template <typename F>
+double Runner::time_iterations(F& func, std::size_t n)
+{
+  const auto start = Clock::now();
+  func(n);
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  return elapsed.count();
+}
+
+template <typename F>
+void Runner::run(const std::string& name, F func, std::size_t items)
+{
+  if (option_filter && name.find(option_filter) == std::string::npos)
+    return;
+
+  if (option_list)
+  {
+    std::printf("%s\n", name.c_str());
+    return;
+  }
+  std::fprintf(stderr, "%-44s", name.c_str());
+
+  // Grow the iteration count until a single sample takes long enough.
+  std::size_t n = 1;
+
+  for (;;)
+  {
+    const double seconds = time_iterations(func, n);
+
+    if (seconds >= option_min_time)
+      break;
+
+    const double scale = (seconds > 0.) ? 1.4 * option_min_time / seconds : 100.;
+    n = static_cast<std::size_t>(n * std::min(scale, 100.)) + 1;
+  }
+
+  std::vector<double> samples;
+
+  for (int i = 0; i < std::max(1, option_repetitions); ++i)
+    samples.push_back(1e9 * time_iterations(func, n) / n);
+
+  std::sort(begin(samples), end(samples));
+
+  const double median = samples[samples.size() / 2];
+  std::fprintf(stderr, "%12.2f ns\n", median);
+
+  results_.push_back({name, n, items, median, samples.front()});
+}
+
+void Runner::write_json(std::FILE* out) const
+{
+  char date[32] = "";
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+#if SOMATO_BENCH_FALLBACK || !(SOMATO_VECTOR_USE_SSE || SOMATO_VECTOR_USE_NEON)
+  const char *const backend = "fallback";
+#elif SOMATO_VECTOR_USE_NEON
+  const char *const backend = "neon";
+#elif SOMATO_VECTOR_USE_AVX2
+  __builtin_cpu_init();
+  const char *const backend = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                              ? "avx2" : "sse";
+#else
+  const char *const backend = "sse";
+#endif
+  std::fprintf(out, "{\n  \"context\": {\n"
+                    "    \"date\": \"%s\",\n"
+                    "    \"package\": \"%s\",\n"
+                    "    \"compiler\": \"%s\",\n"
+                    "    \"simd_backend\": \"%s\",\n"
+                    "    \"repetitions\": %d\n"
+                    "  },\n  \"benchmarks\": [",
+               date, PACKAGE_STRING, __VERSION__, backend, std::max(1, option_repetitions));
+
+  const char* separator = "\n";
+
+  for (const Result& r : results_)
+  {
+    std::fprintf(out, "%s    {\"name\": \"%s\", \"iterations\": %zu, \"items_per_iteration\": %zu, "
+                      "\"real_time\": %.3f, \"min_time\": %.3f, \"time_unit\": \"ns\"}",
+                 separator, r.name.c_str(), r.iterations, r.items, r.median_ns, r.min_ns);
+    separator = ",\n";
+  }
+  std::fprintf(out, "\n  ]\n}\n");
+}
+
+/* Fixed pseudo-random inputs, so that results are comparable across runs.
+ */
+struct Matrix
+{
+  V4f c[4];
+};
+
+struct SimdInputs
+{
+  V4f    vectors[INPUT_COUNT];
+  Matrix matrices[INPUT_COUNT];
+  float  soa_in[4][BATCH_COUNT];
+  float  soa_out[4][BATCH_COUNT];
+  Matrix batch_in[INPUT_COUNT];
+  Matrix batch_out[INPUT_COUNT];
+  float  rows_out[12 * INPUT_COUNT];
+};
+
+template <int N>
+std::vector<BitCube<N>> make_bit_cubes(std::minstd_rand& random)
+{
+  std::vector<BitCube<N>> cubes (INPUT_COUNT);
+
+  for (auto& cube : cubes)
+    for (int x = 0; x < N; ++x)
+      for (int y = 0; y < N; ++y)
+        for (int z = 0; z < N; ++z)
+          cube.put(x, y, z, (random() & 3) == 0);
+
+  return cubes;
+}
+
+template <int N>
+void bench_bit_cube(Runner& runner, std::minstd_rand& random)
+{
+  typedef BitCube<N> Cube;
+
+  const std::vector<Cube> cubes = make_bit_cubes<N>(random);
+  const std::string prefix = "BitCube<" + std::to_string(N) + ">/";
+
+  const auto bench_op = [&](const char* name, Cube& (*op)(Cube&))
+  {
+    runner.run(prefix + name, [&](std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        Cube c = cubes[i % INPUT_COUNT];
+        keep(op(c));
+      }
+    });
+  };
+  bench_op("rotate_x", [](Cube& c) -> Cube& { return c.rotate_x(); });
+  bench_op("rotate_y", [](Cube& c) -> Cube& { return c.rotate_y(); });
+  bench_op("rotate_z", [](Cube& c) -> Cube& { return c.rotate_z(); });
+
+  bench_op("shift/x", [](Cube& c) -> Cube& { return c.shift(AXIS_X); });
+  bench_op("shift/y", [](Cube& c) -> Cube& { return c.shift(AXIS_Y); });
+  bench_op("shift/z", [](Cube& c) -> Cube& { return c.shift(AXIS_Z); });
+  bench_op("shift_slice/x", [](Cube& c) -> Cube& { return c.shift(AXIS_X, ClipMode::SLICE); });
+
+  bench_op("shift_rev/x", [](Cube& c) -> Cube& { return c.shift_rev(AXIS_X); });
+  bench_op("shift_rev/y", [](Cube& c) -> Cube& { return c.shift_rev(AXIS_Y); });
+  bench_op("shift_rev/z", [](Cube& c) -> Cube& { return c.shift_rev(AXIS_Z); });
+}
+
+void bench_puzzle_cube(Runner& runner, const std::vector<SomaCube>& solutions)
+{
+  g_return_if_fail(!solutions.empty());
+
+  enum { CELL_COUNT = SomaBitCube::N * SomaBitCube::N * SomaBitCube::N };
+
+  runner.run("PuzzleCube<3,7>/piece_at_cell", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      const SomaCube& cube = solutions[i % solutions.size()];
+      std::size_t sum = 0;
+
+      for (int x = 0; x < SomaBitCube::N; ++x)
+        for (int y = 0; y < SomaBitCube::N; ++y)
+          for (int z = 0; z < SomaBitCube::N; ++z)
+            sum += cube.piece_at_cell({x, y, z});
+
+      keep(sum);
+    }
+  }, CELL_COUNT);
+
+  runner.run("PuzzleCube<3,7>/iterator", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      SomaBitCube all;
+
+      for (const SomaBitCube piece : solutions[i % solutions.size()])
+        all ^= piece;
+
+      keep(all);
+    }
+  }, SomaCube::COUNT);
+}
+
+/* The Simd kernels which are selected at run time on x86, so that each
+ * variant can be measured separately.
+ */
+struct KernelSet
+{
+  decltype(&Simd::norm4)                    norm4;
+  decltype(&Simd::mat4_mul_mv)              mat4_mul_mv;
+  decltype(&Simd::mat4_mul_mm)              mat4_mul_mm;
+  decltype(&Simd::mat4_mul_mv_batch)        mat4_mul_mv_batch;
+  decltype(&Simd::mat4_mul_mm_batch)        mat4_mul_mm_batch;
+  decltype(&Simd::mat4_transpose_3x4_batch) mat4_transpose_3x4_batch;
+  decltype(&Simd::quat_to_matrix)           quat_to_matrix;
+  decltype(&Simd::quat_mul)                 quat_mul;
+};
+
+void bench_kernels(Runner& runner, const std::string& prefix,
+                   const KernelSet& k, SimdInputs& in)
+{
+  runner.run(prefix + "norm4", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      keep(k.norm4(in.vectors[i % INPUT_COUNT]));
+  });
+  runner.run(prefix + "mat4_mul_mv", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      keep(k.mat4_mul_mv(in.matrices[i % INPUT_COUNT].c, in.vectors[(i + 1) % INPUT_COUNT]));
+  });
+  runner.run(prefix + "mat4_mul_mm", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      Matrix r;
+      k.mat4_mul_mm(in.matrices[i % INPUT_COUNT].c, in.matrices[(i + 1) % INPUT_COUNT].c, r.c);
+      keep(r);
+    }
+  });
+  runner.run(prefix + "mat4_mul_mv_batch", [&](std::size_t n)
+  {
+    const float* const src[4] = {in.soa_in[0], in.soa_in[1], in.soa_in[2], in.soa_in[3]};
+    float* const dst[4] = {in.soa_out[0], in.soa_out[1], in.soa_out[2], in.soa_out[3]};
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      k.mat4_mul_mv_batch(in.matrices[i % INPUT_COUNT].c, src, dst, BATCH_COUNT);
+      keep(in.soa_out);
+    }
+  }, BATCH_COUNT);
+  runner.run(prefix + "mat4_mul_mm_batch", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      k.mat4_mul_mm_batch(in.matrices[i % INPUT_COUNT].c, in.batch_in[0].c,
+                          in.batch_out[0].c, INPUT_COUNT);
+      keep(in.batch_out);
+    }
+  }, INPUT_COUNT);
+  runner.run(prefix + "mat4_transpose_3x4_batch", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      k.mat4_transpose_3x4_batch(in.batch_in[0].c, in.rows_out, INPUT_COUNT);
+      keep(in.rows_out);
+    }
+  }, INPUT_COUNT);
+  runner.run(prefix + "quat_to_matrix", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      Matrix r;
+      k.quat_to_matrix(in.vectors[i % INPUT_COUNT], r.c);
+      keep(r);
+    }
+  });
+  runner.run(prefix + "quat_mul", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      keep(k.quat_mul(in.vectors[i % INPUT_COUNT], in.vectors[(i + 1) % INPUT_COUNT]));
+  });
+}
+
+/* Benchmark a Simd function taking one or two vectors.
+ */
+template <typename F>
+void bench_unary(Runner& runner, const char* name, const SimdInputs& in, F func)
+{
+  runner.run(std::string{"Simd/"} + name, [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      keep(func(in.vectors[i % INPUT_COUNT]));
+  });
+}
+
+template <typename F>
+void bench_binary(Runner& runner, const char* name, const SimdInputs& in, F func)
+{
+  runner.run(std::string{"Simd/"} + name, [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      keep(func(in.vectors[i % INPUT_COUNT], in.vectors[(i + 1) % INPUT_COUNT]));
+  });
+}
+
+void bench_simd(Runner& runner, std::minstd_rand& random)
+{
+  std::uniform_real_distribution<float> dist {-1.f, 1.f};
+  const auto v = [&]() { return Simd::set4(dist(random), dist(random), dist(random), dist(random)); };
+
+  const std::unique_ptr<SimdInputs> inputs {new SimdInputs};
+  SimdInputs& in = *inputs;
+
+  for (auto& e : in.vectors)
+    e = v();
+  for (auto& m : in.matrices)
+    for (auto& c : m.c)
+      c = v();
+  for (auto& m : in.batch_in)
+    for (auto& c : m.c)
+      c = v();
+  for (auto& a : in.soa_in)
+    for (auto& e : a)
+      e = dist(random);
+
+  using namespace Simd;
+
+  bench_unary(runner, "set4", in, [](const V4f& a) { return set4(ext4s<0>(a), 1.f, 2.f, 3.f); });
+  bench_binary(runner, "add4", in, [](const V4f& a, const V4f& b) { return add4(a, b); });
+  bench_binary(runner, "sub4", in, [](const V4f& a, const V4f& b) { return sub4(a, b); });
+  bench_unary(runner, "mul4s", in, [](const V4f& a) { return mul4s(a, 0.5f); });
+  bench_unary(runner, "div4s", in, [](const V4f& a) { return div4s(a, 3.f); });
+  bench_unary(runner, "neg4", in, [](const V4f& a) { return neg4(a); });
+  bench_binary(runner, "cross3", in, [](const V4f& a, const V4f& b) { return cross3(a, b); });
+  bench_binary(runner, "dot4s", in, [](const V4f& a, const V4f& b) { return dot4s(a, b); });
+  bench_unary(runner, "mag4s", in, [](const V4f& a) { return mag4s(a); });
+  bench_binary(runner, "cmp4eq", in, [](const V4f& a, const V4f& b) { return cmp4eq(a, b); });
+  bench_unary(runner, "ext4s", in, [](const V4f& a) { return ext4s<1>(a); });
+  bench_unary(runner, "ref4s", in, [](const V4f& a) { return ref4s(a, 3); });
+
+  runner.run("Simd/mat4_transpose", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      Matrix r;
+      mat4_transpose(in.matrices[i % INPUT_COUNT].c, r.c);
+      keep(r);
+    }
+  });
+  runner.run("Simd/mat4_mul_vm", [&](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      keep(mat4_mul_vm(in.vectors[(i + 1) % INPUT_COUNT], in.matrices[i % INPUT_COUNT].c));
+  });
+
+  bench_unary(runner, "quat_from_rv", in, [](const V4f& a) { return quat_from_rv(0.5f, a); });
+  bench_unary(runner, "quat_conj", in, [](const V4f& a) { return quat_conj(a); });
+  bench_unary(runner, "quat_axis", in, [](const V4f& a) { return quat_axis(a); });
+  bench_unary(runner, "quat_angle", in, [](const V4f& a) { return quat_angle(a); });
+  bench_binary(runner, "quat_from_wedge", in,
+               [](const V4f& a, const V4f& b) { return quat_from_wedge(a, b); });
+  bench_unary(runner, "quat_from_axis", in, [](const V4f& a) { return quat_from_axis(a, 0.7f); });
+  bench_unary(runner, "quat_inv", in, [](const V4f& a) { return quat_inv(a); });
+
+  bench_kernels(runner, "Simd/",
+                {&norm4, &mat4_mul_mv, &mat4_mul_mm, &mat4_mul_mv_batch,
+                 &mat4_mul_mm_batch, &mat4_transpose_3x4_batch, &quat_to_matrix, &quat_mul},
+                in);
+#if SOMATO_VECTOR_USE_SSE && !SOMATO_BENCH_FALLBACK
+  bench_kernels(runner, "Simd::Sse/",
+                {&Sse::norm4, &Sse::mat4_mul_mv, &Sse::mat4_mul_mm, &Sse::mat4_mul_mv_batch,
+                 &Sse::mat4_mul_mm_batch, &Sse::mat4_transpose_3x4_batch,
+                 &Sse::quat_to_matrix, &Sse::quat_mul},
+                in);
+# if SOMATO_VECTOR_USE_AVX2
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    bench_kernels(runner, "Simd::Avx2/",
+                  {&Avx2::norm4, &Avx2::mat4_mul_mv, &Avx2::mat4_mul_mm, &Avx2::mat4_mul_mv_batch,
+                   &Avx2::mat4_mul_mm_batch, &Avx2::mat4_transpose_3x4_batch,
+                   &Avx2::quat_to_matrix, &Avx2::quat_mul},
+                  in);
+# endif
+#endif
+}
+
+void bench_solver(Runner& runner)
+{
+  runner.run("PuzzleSolver/execute", [](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      PuzzleSolver solver;
+      keep(solver.execute().size());
+    }
+  });
+  runner.run("PuzzleSolver/execute/threads:1", [](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      PuzzleSolver solver;
+      solver.set_thread_count(1);
+      keep(solver.execute().size());
+    }
+  });
+  runner.run("PuzzleSolver/execute/stats", [](std::size_t n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      PuzzleSolver solver;
+      SolverStats  stats;
+      keep(solver.execute(stats).size());
+    }
+  });
+
+  for (const auto order : {PieceOrder::GIVEN, PieceOrder::AUTOMATIC})
+  {
+    const std::string name = (order == PieceOrder::GIVEN) ? "given" : "auto";
+
+    runner.run("BasicPuzzleSolver<3>/count/order:" + name, [order](std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        BasicPuzzleSolver<3> solver {{cbegin(cube_piece_data), cend(cube_piece_data)}};
+        solver.set_thread_count(1);
+        solver.set_piece_order(order);
+        keep(solver.count());
+      }
+    });
+  }
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  GOptionContext *const context = g_option_context_new("- run Somato microbenchmarks");
+  g_option_context_add_main_entries(context, option_entries, nullptr);
+
+  GError* error = nullptr;
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    std::fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  std::minstd_rand random;
+  Runner runner;
+
+  bench_bit_cube<3>(runner, random);
+  bench_bit_cube<4>(runner, random);
+
+  const std::vector<SomaCube> solutions = PuzzleSolver{}.execute();
+  bench_puzzle_cube(runner, solutions);
+
+  bench_simd(runner, random);
+  bench_solver(runner);
+
+  if (!option_list)
+    runner.write_json(stdout);
+
+  g_free(option_filter);
+  return 0;
+}
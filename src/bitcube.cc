@@ -258,5 +258,6 @@ typename BitCube<N_>::Bits BitCube<N_>::shift_rev_(Bits data, std::size_t axis,
 }
 
 template class BitCube<3>;
+template class BitCube<4>;
 
 } // namespace Somato
@@ -132,6 +132,7 @@ struct BitCube<N_>::SortPredicate
 };
 
 extern template class BitCube<3>;
+extern template class BitCube<4>;
 
 } // namespace Somato
 
@@ -29,17 +29,21 @@
 #include <gdk/gdk.h>
 #include <gdk/gdkkeysyms.h>
 #include <glibmm.h>
-#include <giomm/resource.h>
 #include <gdkmm.h>
 #include <gtkmm/accelgroup.h>
 #include <epoxy/gl.h>
 
 #include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <algorithm>
 #include <functional>
 #include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace
 {
@@ -63,6 +67,207 @@ private:
   const T* data_;
 };
 
+/*
+ * Test whether all triangles of a cluster face away from the eye at the
+ * origin of view space. The normal cone of half-angle alpha is back-facing
+ * from every point of the bounding sphere if the angle theta between the
+ * cone axis and the view vector to the sphere center satisfies
+ * cos(theta + alpha) * distance >= radius.
+ */
+bool cluster_faces_away(const Math::Vector4& center, const Math::Vector4& axis,
+                        float radius, float cutoff)
+{
+  if (cutoff <= 0.f)
+    return false;
+
+  const float distance = magnitude(center);
+
+  if (distance <= radius)
+    return false;
+
+  const float cos_view = dot(center, axis) / distance;
+  const float sin_view = std::sqrt(std::max(0.f, 1.f - cos_view * cos_view));
+  const float sin_cone = std::sqrt(1.f - cutoff * cutoff);
+
+  return (cos_view * cutoff - sin_view * sin_cone) * distance >= radius;
+}
+
+/*
+ * Find the occupied cells which may be visible from the eye position given
+ * in model coordinates. A cell is exposed if it has at least one face which
+ * is not covered by an adjacent occupied cell, and which faces the eye.
+ *
+ * As the pieces have rounded edges, a covered cell may still show through
+ * the grooves along the boundaries between pieces. Thus a cell is visible
+ * as well if one of its neighbors in the directions facing the eye, across
+ * a face, edge or corner, is either empty or exposed and part of another
+ * piece. Pieces without any visible cell are hidden behind others.
+ */
+SomaBitCube find_visible_cells(const SomaCube& pieces, SomaBitCube occupied,
+                               const Math::Vector4& eye)
+{
+  enum { N = SomaBitCube::N };
+
+  SomaBitCube exposed;
+  int facing[N][N][N][3] = {};
+
+  for (int x = 0; x < N; ++x)
+    for (int y = 0; y < N; ++y)
+      for (int z = 0; z < N; ++z)
+      {
+        if (!occupied.get(x, y, z))
+          continue;
+
+        const int cell[3] = {x, y, z};
+        bool cell_exposed = false;
+
+        for (int axis = AXIS_X; axis <= AXIS_Z; ++axis)
+        {
+          int next[3] = {x, y, z};
+          const float center = (cell[axis] - 0.5f * (N - 1)) * grid_cell_size;
+
+          // Determine the direction along the axis which faces the eye.
+          if (eye[axis] > center + 0.5f * grid_cell_size)
+            facing[x][y][z][axis] = 1;
+          else if (eye[axis] < center - 0.5f * grid_cell_size)
+            facing[x][y][z][axis] = -1;
+          else
+            continue;
+
+          next[axis] += facing[x][y][z][axis];
+
+          if (next[axis] < 0 || next[axis] >= N || !occupied.get(next[0], next[1], next[2]))
+            cell_exposed = true;
+        }
+        exposed.put(x, y, z, cell_exposed);
+      }
+
+  SomaBitCube visible = exposed;
+
+  for (int x = 0; x < N; ++x)
+    for (int y = 0; y < N; ++y)
+      for (int z = 0; z < N; ++z)
+      {
+        if (!occupied.get(x, y, z) || exposed.get(x, y, z))
+          continue;
+
+        const auto piece = pieces.piece_at_cell({x, y, z});
+        const int* const dir = facing[x][y][z];
+        bool seen = false;
+
+        // Visit the neighbors reachable by stepping towards the eye along
+        // any combination of the facing axes.
+        for (int mask = 1; mask < 8 && !seen; ++mask)
+        {
+          int next[3] = {x, y, z};
+          bool valid = true;
+
+          for (int axis = AXIS_X; axis <= AXIS_Z; ++axis)
+            if (mask & (1 << axis))
+            {
+              next[axis] += dir[axis];
+              valid = valid && dir[axis] != 0 && next[axis] >= 0 && next[axis] < N;
+            }
+
+          if (valid)
+            seen = (!occupied.get(next[0], next[1], next[2])
+                    || (exposed.get(next[0], next[1], next[2])
+                        && pieces.piece_at_cell({next[0], next[1], next[2]}) != piece));
+        }
+        visible.put(x, y, z, seen);
+      }
+
+  return visible;
+}
+
+bool same_cube_pieces(const SomaCube& a, const SomaCube& b)
+{
+  for (SomaCube::size_type i = 0; i < SomaCube::COUNT; ++i)
+    if (a[i] != b[i])
+      return false;
+
+  return true;
+}
+
+/*
+ * Convert the element indices, which are relative to the first vertex
+ * of each mesh, to absolute indices for drawing without base vertex
+ * support. Meshes which extend beyond the 16-bit range are promoted to
+ * 32-bit indices. The input is left untouched, and a copy with rebased
+ * mesh descriptions and indices is returned.
+ */
+SceneData rebase_mesh_indices(const SceneData& data)
+{
+  gsize desc_size = 0, indices_size = 0;
+
+  const auto *const desc    = static_cast<const MeshDesc*>(data.mesh_desc->get_data(desc_size));
+  const auto *const indices = static_cast<const guint8*>(data.mesh_indices->get_data(indices_size));
+
+  std::vector<MeshDesc> rebased_desc (desc, desc + desc_size / sizeof(MeshDesc));
+
+  // Keep any leading index data not owned by a mesh, such as the cell grid.
+  gsize prefix_size = indices_size;
+
+  for (const MeshDesc& mesh : rebased_desc)
+    for (const MeshLod& lod : mesh.lod)
+      prefix_size = std::min<gsize>(prefix_size, lod.indices_offset);
+
+  std::vector<guint8> rebased (indices, indices + prefix_size);
+
+  for (MeshDesc& mesh : rebased_desc)
+  {
+    const unsigned int index_size = (mesh.element_last < G_MAXUINT16) ? sizeof(MeshIndex)
+                                                                      : sizeof(MeshIndex32);
+    for (MeshLod& lod : mesh.lod)
+    {
+      const gsize count  = 3 * gsize{lod.triangle_count};
+      const gsize offset = rebased.size();
+
+      rebased.resize(offset + aligned_index_bytes(count * index_size), 0xFF);
+
+      for (gsize i = 0; i < count; ++i)
+      {
+        const guint8 *const source = indices + lod.indices_offset + i * mesh.index_size;
+        guint8 *const dest = &rebased[offset + i * index_size];
+        unsigned int index = mesh.element_first;
+
+        if (mesh.index_size == sizeof(MeshIndex32))
+        {
+          MeshIndex32 value;
+          std::memcpy(&value, source, sizeof value);
+          index += value;
+        }
+        else
+        {
+          MeshIndex value;
+          std::memcpy(&value, source, sizeof value);
+          index += value;
+        }
+
+        if (index_size == sizeof(MeshIndex32))
+        {
+          const MeshIndex32 value = index;
+          std::memcpy(dest, &value, sizeof value);
+        }
+        else
+        {
+          const MeshIndex value = index;
+          std::memcpy(dest, &value, sizeof value);
+        }
+      }
+      lod.indices_offset = offset;
+    }
+    mesh.index_size = index_size;
+  }
+  SceneData result = data;
+
+  result.mesh_desc    = Glib::Bytes::create(rebased_desc.data(),
+                                            rebased_desc.size() * sizeof(MeshDesc));
+  result.mesh_indices = Glib::Bytes::create(rebased.data(), rebased.size());
+
+  return result;
+}
+
 /* Puzzle piece vertex shader input attribute locations.
  */
 enum
@@ -101,16 +306,50 @@ enum
  */
 const int hide_cursor_delay = 5000;
 
+/*
+ * Interval in milliseconds at which to check for the completion of
+ * background shader compilation while the placeholder frame is shown.
+ */
+const int init_poll_interval = 15;
+
+/*
+ * Maximum amount of texture data in bytes to upload per frame, except
+ * for a single mipmap level which is always uploaded as a whole.
+ */
+const std::size_t texture_upload_budget = 256 * 1024;
+
 /*
  * View offset in the direction of the z-axis.
  */
 const float view_z_offset = -9.;
 
+/*
+ * Cotangent of half the vertical field of view angle of 45 degrees.
+ */
+const float view_cot_half_fov = G_SQRT2 + 1.; // cot(pi/8)
+
+/*
+ * Projected area in pixels per triangle below which a coarser level
+ * of detail of a cube piece mesh is selected.
+ */
+const float lod_pixels_per_triangle = 4.;
+
 /*
  * The angle by which to rotate if a keyboard navigation key is pressed.
  */
 const float rotation_step = G_PI / 60.;
 
+/*
+ * Minimum on-screen motion in pixels of the animated cube piece for
+ * an animation frame to be drawn.
+ */
+const float min_pixel_motion = 0.25;
+
+/*
+ * Distance in model units an animated cube piece has to travel.
+ */
+const float animation_distance = 1.75 * SomaBitCube::N * grid_cell_size;
+
 /* Wood texture shear and translate matrix.
  */
 const GLfloat texture_shear[2][4] =
@@ -196,6 +435,23 @@ void find_animation_axis(SomaBitCube cube, SomaBitCube piece, float* direction)
   g_return_if_reached();
 }
 
+/*
+ * Select the finest level of detail of a mesh that fits the triangle
+ * budget for its projected size. The pixel scale is the projected size
+ * in pixels of a model unit at the distance of the cube.
+ */
+int select_mesh_lod(const MeshDesc& mesh, float pixel_scale)
+{
+  const float radius = mesh.scale * pixel_scale;
+  const float budget = G_PI * radius * radius / lod_pixels_per_triangle;
+
+  for (int level = 0; level < MESH_LOD_COUNT - 1; ++level)
+    if (mesh.lod[level].triangle_count <= budget)
+      return level;
+
+  return MESH_LOD_COUNT - 1;
+}
+
 } // anonymous namespace
 
 namespace Somato
@@ -215,6 +471,12 @@ CubeScene::CubeScene(BaseObjectType* obj, const Glib::RefPtr<Gtk::Builder>&)
   add_events(Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON_RELEASE_MASK | Gdk::BUTTON1_MOTION_MASK
              | Gdk::POINTER_MOTION_MASK | Gdk::KEY_PRESS_MASK | Gdk::KEY_RELEASE_MASK
              | Gdk::ENTER_NOTIFY_MASK | Gdk::LEAVE_NOTIFY_MASK | Gdk::VISIBILITY_NOTIFY_MASK);
+
+  // Start fetching the scene data right away, so that it is likely
+  // to be ready by the time the GL context has been set up.
+  scene_loader_ = std::make_unique<SceneLoader>();
+  scene_loader_->signal_done().connect(sigc::mem_fun(*this, &CubeScene::on_scene_loaded));
+  scene_loader_->run();
 }
 
 CubeScene::~CubeScene()
@@ -232,11 +494,14 @@ void CubeScene::set_cube_pieces(const SomaCube& cube_pieces)
 {
   try
   {
+    // Puzzles of fewer than seven pieces leave the remaining ones empty.
+    const auto count = std::count_if(cube_pieces.begin(), cube_pieces.end(),
+                                     [](SomaBitCube piece) { return !piece.empty(); });
     cube_pieces_ = cube_pieces;
-    animation_data_.assign(cube_pieces.size(), AnimationData{});
-    depth_order_   .assign(cube_pieces.size(), 0);
+    animation_data_.assign(count, AnimationData{});
+    depth_order_   .assign(count, 0);
 
-    if (!cube_pieces.empty())
+    if (count > 0)
       update_animation_order();
   }
   catch (...)
@@ -252,12 +517,13 @@ void CubeScene::set_cube_pieces(const SomaCube& cube_pieces)
     throw;
   }
 
-  if (animation_running_ || animation_piece_ > static_cast<int>(cube_pieces.size()))
+  if (animation_running_ || animation_piece_ > static_cast<int>(animation_data_.size()))
   {
     animation_piece_    = 0;
     animation_position_ = 0.;
   }
 
+  update_voxel_meshes();
   continue_animation();
   queue_static_draw();
 }
@@ -272,6 +538,9 @@ void CubeScene::set_zoom(float zoom)
 
     if (zoom_visible_)
       update_footing();
+
+    if (!animation_data_.empty())
+      queue_static_draw();
   }
 }
 
@@ -282,11 +551,16 @@ float CubeScene::get_zoom() const
 
 void CubeScene::set_rotation(const Math::Quat& rotation)
 {
-  rotation_ = normalize(rotation);
-  depth_order_changed_ = true;
+  const Math::Quat value = normalize(rotation);
 
-  if (!animation_data_.empty())
-    queue_static_draw();
+  if (value != rotation_)
+  {
+    rotation_ = value;
+    depth_order_changed_ = true;
+
+    if (!animation_data_.empty())
+      queue_static_draw();
+  }
 }
 
 Math::Quat CubeScene::get_rotation() const
@@ -391,21 +665,42 @@ bool CubeScene::get_show_outline() const
   return show_outline_;
 }
 
+void CubeScene::set_voxel_meshes(bool voxel_meshes)
+{
+  if (voxel_meshes != voxel_meshes_)
+  {
+    voxel_meshes_ = voxel_meshes;
+    update_voxel_meshes();
+
+    if (!animation_data_.empty())
+      queue_static_draw();
+  }
+}
+
+bool CubeScene::get_voxel_meshes() const
+{
+  return voxel_meshes_;
+}
+
 int CubeScene::get_cube_triangle_count() const
 {
+  g_return_val_if_fail(scene_data_.mesh_desc, 0);
+
   int cube_triangle_count = 0;
 
-  for (const auto& mesh : BytesView<MeshDesc>{mesh_desc_})
-    cube_triangle_count += mesh.triangle_count;
+  for (const auto& mesh : BytesView<MeshDesc>{scene_data_.mesh_desc})
+    cube_triangle_count += mesh.lod[0].triangle_count;
 
   return cube_triangle_count;
 }
 
 int CubeScene::get_cube_vertex_count() const
 {
+  g_return_val_if_fail(scene_data_.mesh_desc, 0);
+
   int cube_vertex_count = 0;
 
-  for (const auto& mesh : BytesView<MeshDesc>{mesh_desc_})
+  for (const auto& mesh : BytesView<MeshDesc>{scene_data_.mesh_desc})
     cube_vertex_count += mesh.element_count();
 
   return cube_vertex_count;
@@ -425,6 +720,10 @@ void CubeScene::gl_initialize()
   if (!GL::extensions().is_gles)
     glEnable(GL_DEPTH_CLAMP);
 
+  init_start_time_ = g_get_monotonic_time();
+
+  // Only issue the compile and link commands here. Until the programs
+  // and the scene data are ready, gl_render() draws a placeholder frame.
   gl_create_piece_shader();
 
   if (GL::extensions().geometry_shader)
@@ -432,12 +731,33 @@ void CubeScene::gl_initialize()
     gl_create_outline_shader();
     gl_create_grid_shader();
   }
+}
+
+/*
+ * Finish the initialization of GL resources once the shader programs
+ * have been linked and the scene data has been loaded. Return whether
+ * the scene is ready to be drawn.
+ */
+bool CubeScene::gl_complete_initialization()
+{
+  if (mesh_vertex_array_)
+    return true;
+
+  if (!scene_data_.mesh_desc)
+    return false;
+
+  for (auto* program : {&piece_shader_, &outline_shader_, &grid_shader_})
+    if (*program && !program->poll_link())
+      return false;
+
+  gl_init_uniforms();
   gl_init_cube_texture();
-  gl_create_mesh_buffers();
+  gl_create_mesh_buffers(scene_data_, "mesh", mesh_vertex_array_, mesh_buffers_,
+                         mesh_draw_desc_);
 
-  piece_shader_.use();
-  glUniformMatrix2x4fv(uf_texture_shear_, 1, GL_FALSE, texture_shear[0]);
-  glUniform1i(uf_piece_texture_, SAMPLER_PIECE);
+  g_info("Scene ready after %0.1f ms",
+         0.001 * (g_get_monotonic_time() - init_start_time_));
+  return true;
 }
 
 void CubeScene::gl_create_piece_shader()
@@ -451,13 +771,7 @@ void CubeScene::gl_create_piece_shader()
   program.bind_attrib_location(ATTRIB_POSITION, "position");
   program.bind_attrib_location(ATTRIB_NORMAL,   "normal");
   program.bind_frag_data_location(0, "outputColor");
-  program.link();
-
-  uf_model_view_    = program.get_uniform_location("modelView");
-  uf_view_frustum_  = program.get_uniform_location("viewFrustum");
-  uf_texture_shear_ = program.get_uniform_location("textureShear");
-  uf_diffuse_color_ = program.get_uniform_location("diffuseColor");
-  uf_piece_texture_ = program.get_uniform_location("pieceTexture");
+  program.link_async();
 
   piece_shader_ = std::move(program);
 }
@@ -474,12 +788,7 @@ void CubeScene::gl_create_outline_shader()
   program.bind_attrib_location(ATTRIB_POSITION, "position");
   program.bind_attrib_location(ATTRIB_NORMAL,   "normal");
   program.bind_frag_data_location(0, "outputColor");
-  program.link();
-
-  ol_uf_model_view_    = program.get_uniform_location("modelView");
-  ol_uf_view_frustum_  = program.get_uniform_location("viewFrustum");
-  ol_uf_window_size_   = program.get_uniform_location("windowSize");
-  ol_uf_diffuse_color_ = program.get_uniform_location("diffuseColor");
+  program.link_async();
 
   outline_shader_ = std::move(program);
 }
@@ -495,17 +804,41 @@ void CubeScene::gl_create_grid_shader()
 
   program.bind_attrib_location(ATTRIB_POSITION, "position");
   program.bind_frag_data_location(0, "outputColor");
-  program.link();
-
-  grid_uf_model_view_   = program.get_uniform_location("modelView");
-  grid_uf_view_frustum_ = program.get_uniform_location("viewFrustum");
-  grid_uf_pixel_scale_  = program.get_uniform_location("pixelScale");
+  program.link_async();
 
   grid_shader_ = std::move(program);
 }
 
+void CubeScene::gl_init_uniforms()
+{
+  uf_model_view_    = piece_shader_.get_uniform_location("modelView");
+  uf_view_frustum_  = piece_shader_.get_uniform_location("viewFrustum");
+  uf_texture_shear_ = piece_shader_.get_uniform_location("textureShear");
+  uf_diffuse_color_ = piece_shader_.get_uniform_location("diffuseColor");
+  uf_piece_texture_ = piece_shader_.get_uniform_location("pieceTexture");
+
+  piece_shader_.use();
+  glUniform1i(uf_piece_texture_, SAMPLER_PIECE);
+
+  if (outline_shader_)
+  {
+    ol_uf_model_view_    = outline_shader_.get_uniform_location("modelView");
+    ol_uf_view_frustum_  = outline_shader_.get_uniform_location("viewFrustum");
+    ol_uf_window_size_   = outline_shader_.get_uniform_location("windowSize");
+    ol_uf_diffuse_color_ = outline_shader_.get_uniform_location("diffuseColor");
+  }
+  if (grid_shader_)
+  {
+    grid_uf_model_view_   = grid_shader_.get_uniform_location("modelView");
+    grid_uf_view_frustum_ = grid_shader_.get_uniform_location("viewFrustum");
+    grid_uf_pixel_scale_  = grid_shader_.get_uniform_location("pixelScale");
+  }
+}
+
 void CubeScene::gl_cleanup()
 {
+  init_poll_timeout_.disconnect();
+
   uf_model_view_        = -1;
   uf_view_frustum_      = -1;
   uf_texture_shear_     = -1;
@@ -535,7 +868,16 @@ void CubeScene::gl_cleanup()
     mesh_buffers_[VERTICES] = 0;
     mesh_buffers_[INDICES]  = 0;
   }
+  mesh_draw_desc_.reset();
+
+  gl_delete_voxel_buffers();
+  voxel_data_changed_ = true;
 
+  if (texture_upload_)
+  {
+    texture_upload_->gl_delete();
+    texture_upload_.reset();
+  }
   if (cube_texture_)
   {
     glDeleteTextures(1, &cube_texture_);
@@ -549,6 +891,19 @@ int CubeScene::gl_render()
 {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  if (!gl_complete_initialization())
+  {
+    // Keep polling while the shaders are still compiling. If the scene
+    // data is not there yet, on_scene_loaded() will queue a redraw.
+    if (scene_data_.mesh_desc && !init_poll_timeout_.connected())
+      init_poll_timeout_ = Glib::signal_timeout().connect(
+          sigc::mem_fun(*this, &CubeScene::on_init_poll_timeout), init_poll_interval);
+
+    return GL::Scene::gl_render();
+  }
+  if (texture_upload_)
+    gl_update_cube_texture();
+
   int triangle_count = 0;
 
   if (!animation_data_.empty())
@@ -559,26 +914,33 @@ int CubeScene::gl_render()
     if (depth_order_changed_)
       update_depth_order();
 
-    if (mesh_vertex_array_)
-    {
-      glBindVertexArray(mesh_vertex_array_);
-      glEnable(GL_DEPTH_TEST);
+    drawn_position_ = animation_position_;
 
-      Math::Matrix4 cube_transform {Math::Vector4::basis[0],
-                                    Math::Vector4::basis[1],
-                                    Math::Vector4::basis[2],
-                                    {0.f, 0.f, view_z_offset, 1.f}};
-      cube_transform *= Math::Matrix4::from_quaternion(rotation_);
-      cube_transform.scale(zoom_);
+    if (voxel_data_changed_)
+      gl_update_voxel_buffers();
 
-      if (animation_piece_ > 0 && animation_piece_ <= static_cast<int>(animation_data_.size()))
-        triangle_count += gl_draw_pieces(cube_transform);
+    glBindVertexArray((voxel_meshes_ready()) ? voxel_vertex_array_ : mesh_vertex_array_);
+    glEnable(GL_DEPTH_TEST);
 
-      if (show_cell_grid_)
-        gl_draw_cell_grid(cube_transform);
+    Math::Matrix4 cube_transform {Math::Vector4::basis[0],
+                                  Math::Vector4::basis[1],
+                                  Math::Vector4::basis[2],
+                                  {0.f, 0.f, view_z_offset, 1.f}};
+    cube_transform *= Math::Matrix4::from_quaternion(rotation_);
+    cube_transform.scale(zoom_);
 
-      glDisable(GL_DEPTH_TEST);
+    // Without baked meshes for all pieces, wait for the generated ones.
+    if (animation_piece_ > 0 && animation_piece_ <= static_cast<int>(animation_data_.size())
+        && (baked_meshes_usable_ || voxel_meshes_ready()))
+      triangle_count += gl_draw_pieces(cube_transform);
+
+    if (show_cell_grid_)
+    {
+      glBindVertexArray(mesh_vertex_array_);
+      gl_draw_cell_grid(cube_transform);
     }
+
+    glDisable(GL_DEPTH_TEST);
   }
   triangle_count += GL::Scene::gl_render();
 
@@ -602,26 +964,36 @@ void CubeScene::gl_update_viewport()
                                  margin_x, margin_y);
 }
 
-void CubeScene::gl_create_mesh_buffers()
+/*
+ * Upload the vertices and indices of a set of meshes. Without base vertex
+ * support, a rebased copy of the indices is uploaded instead, so that the
+ * data can be uploaded again later on. The mesh descriptions matching the
+ * uploaded indices are stored to draw_desc.
+ */
+void CubeScene::gl_create_mesh_buffers(const SceneData& data, const char* label,
+                                       unsigned int& vertex_array, unsigned int (&buffers)[2],
+                                       Glib::RefPtr<const Glib::Bytes>& draw_desc)
 {
-  g_return_if_fail(mesh_vertex_array_ == 0);
-  g_return_if_fail(mesh_buffers_[VERTICES] == 0 && mesh_buffers_[INDICES] == 0);
+  g_return_if_fail(vertex_array == 0);
+  g_return_if_fail(buffers[VERTICES] == 0 && buffers[INDICES] == 0);
 
-  mesh_desc_ = Gio::Resource::lookup_data_global(RESOURCE_PREFIX "mesh-desc.bin");
-  const auto vertices = Gio::Resource::lookup_data_global(RESOURCE_PREFIX "mesh-vertices.bin");
-  const auto indices  = Gio::Resource::lookup_data_global(RESOURCE_PREFIX "mesh-indices.bin");
+  const SceneData upload = (GL::extensions().draw_base_vertex) ? data
+                                                               : rebase_mesh_indices(data);
+  const auto& vertices = upload.mesh_vertices;
+  const auto& indices  = upload.mesh_indices;
+  const std::string prefix = label;
 
-  glGenVertexArrays(1, &mesh_vertex_array_);
-  GL::Error::throw_if_fail(mesh_vertex_array_ != 0);
+  glGenVertexArrays(1, &vertex_array);
+  GL::Error::throw_if_fail(vertex_array != 0);
 
-  glGenBuffers(G_N_ELEMENTS(mesh_buffers_), mesh_buffers_);
-  GL::Error::throw_if_fail(mesh_buffers_[VERTICES] != 0 && mesh_buffers_[INDICES] != 0);
+  glGenBuffers(G_N_ELEMENTS(buffers), buffers);
+  GL::Error::throw_if_fail(buffers[VERTICES] != 0 && buffers[INDICES] != 0);
 
-  glBindVertexArray(mesh_vertex_array_);
-  GL::set_object_label(GL_VERTEX_ARRAY, mesh_vertex_array_, "meshArray");
+  glBindVertexArray(vertex_array);
+  GL::set_object_label(GL_VERTEX_ARRAY, vertex_array, (prefix + "Array").c_str());
 
-  glBindBuffer(GL_ARRAY_BUFFER, mesh_buffers_[VERTICES]);
-  GL::set_object_label(GL_BUFFER, mesh_buffers_[VERTICES], "meshVertices");
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[VERTICES]);
+  GL::set_object_label(GL_BUFFER, buffers[VERTICES], (prefix + "Vertices").c_str());
 
   gsize vertices_size = 0;
   const auto *const vertices_data = vertices->get_data(vertices_size);
@@ -631,7 +1003,7 @@ void CubeScene::gl_create_mesh_buffers()
   glVertexAttribPointer(ATTRIB_POSITION,
                         GL::attrib_size<decltype(MeshVertex::position)>,
                         GL::attrib_type<decltype(MeshVertex::position)>,
-                        GL_FALSE, sizeof(MeshVertex),
+                        GL_TRUE, sizeof(MeshVertex),
                         GL::buffer_offset(offsetof(MeshVertex, position)));
   glVertexAttribPointer(ATTRIB_NORMAL,
                         GL::attrib_size<decltype(MeshVertex::normal)>,
@@ -641,8 +1013,8 @@ void CubeScene::gl_create_mesh_buffers()
   glEnableVertexAttribArray(ATTRIB_POSITION);
   glEnableVertexAttribArray(ATTRIB_NORMAL);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_buffers_[INDICES]);
-  GL::set_object_label(GL_BUFFER, mesh_buffers_[INDICES], "meshIndices");
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[INDICES]);
+  GL::set_object_label(GL_BUFFER, buffers[INDICES], (prefix + "Indices").c_str());
 
   gsize indices_size = 0;
   const auto *const indices_data = indices->get_data(indices_size);
@@ -652,9 +1024,41 @@ void CubeScene::gl_create_mesh_buffers()
   glBindVertexArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  g_info("Mesh totals: %u vertices, %u indices",
+  draw_desc = upload.mesh_desc;
+
+  g_info("Mesh totals (%s): %u vertices, %u index bytes", label,
          static_cast<unsigned int>(vertices_size / sizeof(MeshVertex)),
-         static_cast<unsigned int>(indices_size  / sizeof(MeshIndex)));
+         static_cast<unsigned int>(indices_size));
+}
+
+/*
+ * Upload the generated piece meshes, replacing any previous ones.
+ */
+void CubeScene::gl_update_voxel_buffers()
+{
+  voxel_data_changed_ = false;
+  gl_delete_voxel_buffers();
+
+  if (voxel_data_.mesh_desc)
+    gl_create_mesh_buffers(voxel_data_, "voxel", voxel_vertex_array_, voxel_buffers_,
+                           voxel_draw_desc_);
+}
+
+void CubeScene::gl_delete_voxel_buffers()
+{
+  if (voxel_vertex_array_)
+  {
+    glDeleteVertexArrays(1, &voxel_vertex_array_);
+    voxel_vertex_array_ = 0;
+  }
+
+  if (voxel_buffers_[VERTICES] | voxel_buffers_[INDICES])
+  {
+    glDeleteBuffers(G_N_ELEMENTS(voxel_buffers_), voxel_buffers_);
+    voxel_buffers_[VERTICES] = 0;
+    voxel_buffers_[INDICES]  = 0;
+  }
+  voxel_draw_desc_.reset();
 }
 
 void CubeScene::on_size_allocate(Gtk::Allocation& allocation)
@@ -868,7 +1272,11 @@ bool CubeScene::on_animation_tick(gint64 animation_time)
   const float position = animation_seek_ - (elapsed * pieces_per_sec_);
 
   animation_position_ = std::max(0.f, position);
-  queue_draw();
+
+  if (animation_moved_visibly())
+    queue_draw();
+  else
+    skip_animation_frame();
 
   if (position > 0.)
     return true;
@@ -884,6 +1292,39 @@ bool CubeScene::on_animation_tick(gint64 animation_time)
   return false;
 }
 
+/*
+ * Return whether the animated cube piece has moved far enough on screen
+ * since the last frame was drawn to warrant drawing another one. The final
+ * resting position is always drawn exactly.
+ */
+bool CubeScene::animation_moved_visibly() const
+{
+  // In exclusive mode, the animated piece is only shown if it is the
+  // last one up to the selected piece.
+  if (exclusive_piece_ > 0 && exclusive_piece_ < animation_piece_)
+    return false;
+
+  if (animation_position_ == 0.f)
+    return (drawn_position_ != 0.f);
+
+  // The pixel scale at the depth of the cube origin is not accurate for
+  // the near parts of the cube, but good enough for the small threshold
+  // involved.
+  const float motion = std::abs(animation_position_ - drawn_position_)
+                       * animation_distance * get_pixel_scale();
+
+  return (motion >= min_pixel_motion);
+}
+
+/*
+ * Return the projected size in pixels of a model unit at the depth of
+ * the cube origin, including the zoom factor.
+ */
+float CubeScene::get_pixel_scale() const
+{
+  return 0.5f * get_viewport_height() * view_cot_half_fov * zoom_ / -view_z_offset;
+}
+
 void CubeScene::update_footing()
 {
   const int percentage = std::lrint(100.f * zoom_);
@@ -923,6 +1364,7 @@ void CubeScene::update_animation_order()
 
   unsigned int count = 0;
   SomaBitCube  cube_mask;
+  bool         baked_meshes = true;
 
   for (const SomaBitCube::Index cell : cell_order)
   {
@@ -953,7 +1395,16 @@ void CubeScene::update_animation_order()
         auto& anim = animation_data_[anim_index];
 
         anim.cube_index = piece_index;
-        anim.transform = find_puzzle_piece_orientation(piece_index, piece);
+
+        // Pieces of a shape other than the Soma cube pieces have no baked
+        // mesh, and can only be drawn with the generated meshes.
+        const int mesh_index = find_puzzle_piece_orientation(piece_index, piece, anim.transform);
+
+        if (mesh_index >= 0)
+          anim.mesh_index = mesh_index;
+        else
+          baked_meshes = false;
+
         find_animation_axis(cube_mask, piece, anim.direction);
 
         cube_mask |= piece;
@@ -962,6 +1413,8 @@ void CubeScene::update_animation_order()
       piece_cells_[cell].piece = anim_index;
     }
   }
+  baked_meshes_usable_ = baked_meshes;
+
   g_return_if_fail(count == animation_data_.size()); // invalid input
 
   depth_order_changed_ = true;
@@ -978,18 +1431,33 @@ void CubeScene::update_depth_order()
   const auto matrix = Math::Matrix4::from_quaternion(rotation_);
 
   enum { N = SomaBitCube::N };
+  typedef std::array<float, N*N*N> CellCoords;
 
-  std::array<float, N*N*N> zcoords;
-  auto pcell = begin(zcoords);
+  // Cell center coordinates, as separate x, y and z component arrays.
+  static const std::array<CellCoords, 3> cell_coords = []()
+  {
+    std::array<CellCoords, 3> coords;
+    int cell = 0;
 
-  for (int x = 1 - N; x < N; x += 2)
-    for (int y = 1 - N; y < N; y += 2)
-      for (int z = 1 - N; z < N; z += 2)
-      {
-        const Math::Vector4 coords = matrix * Math::Vector4(x, y, z);
+    for (int x = 1 - N; x < N; x += 2)
+      for (int y = 1 - N; y < N; y += 2)
+        for (int z = 1 - N; z < N; z += 2)
+        {
+          coords[0][cell] = x;
+          coords[1][cell] = y;
+          coords[2][cell] = z;
+          ++cell;
+        }
+    return coords;
+  }();
 
-        *pcell++ = coords.z();
-      }
+  CellCoords zcoords;
+
+  const float *const src[4] = {cell_coords[0].data(), cell_coords[1].data(),
+                               cell_coords[2].data(), nullptr};
+  float *const dst[4] = {nullptr, nullptr, zcoords.data(), nullptr};
+
+  transform_batch(matrix, src, dst, zcoords.size());
 
   std::sort(begin(piece_cells_), end(piece_cells_),
             [&zcoords](const PieceCell& a, const PieceCell& b)
@@ -1050,7 +1518,7 @@ bool CubeScene::on_delay_timeout()
 {
   if (animation_running_ && !animation_data_.empty())
   {
-    if (animation_piece_ < static_cast<int>(cube_pieces_.size()))
+    if (animation_piece_ < static_cast<int>(animation_data_.size()))
     {
       ++animation_piece_;
       animation_position_ = 1.;
@@ -1071,6 +1539,81 @@ bool CubeScene::on_delay_timeout()
   return false; // disconnect
 }
 
+bool CubeScene::on_init_poll_timeout()
+{
+  queue_static_draw();
+  return false; // disconnect
+}
+
+void CubeScene::on_scene_loaded()
+{
+  const auto loader = Async::deferred_delete(scene_loader_);
+  g_return_if_fail(loader);
+
+  // Without valid scene data, keep drawing the placeholder frame.
+  try
+  {
+    scene_data_ = loader->acquire_results();
+  }
+  catch (const std::runtime_error& error)
+  {
+    g_critical("Failed to load scene data: %s", error.what());
+    return;
+  }
+  queue_static_draw();
+}
+
+/*
+ * Start generating meshes for the current cube pieces, unless they are
+ * already available or a mesher task is still busy. In the latter case,
+ * this is retried once the task is done. The meshes are generated even if
+ * not enabled when some of the pieces have no baked mesh.
+ */
+void CubeScene::update_voxel_meshes()
+{
+  if ((!voxel_meshes_ && baked_meshes_usable_) || voxel_mesher_ || animation_data_.empty()
+      || (voxel_data_.mesh_desc && same_cube_pieces(voxel_pieces_, cube_pieces_)))
+    return;
+
+  voxel_mesher_ = std::make_unique<VoxelMesher>(cube_pieces_);
+  voxel_mesher_->signal_done().connect(sigc::mem_fun(*this, &CubeScene::on_voxel_meshes_done));
+  voxel_mesher_->run();
+}
+
+void CubeScene::on_voxel_meshes_done()
+{
+  const auto mesher = Async::deferred_delete(voxel_mesher_);
+  g_return_if_fail(mesher);
+
+  // Keep drawing the baked meshes if the generated ones are unusable.
+  try
+  {
+    voxel_data_ = mesher->acquire_results();
+  }
+  catch (const VoxelMesher::Error& error)
+  {
+    g_warning("Failed to generate piece meshes: %s", error.what());
+    return;
+  }
+  voxel_pieces_ = mesher->get_pieces();
+  voxel_data_changed_ = true;
+
+  // The pieces may have changed in the meantime.
+  update_voxel_meshes();
+  queue_static_draw();
+}
+
+/*
+ * Return whether the generated meshes match the current cube pieces
+ * and should be drawn instead of the baked ones.
+ */
+bool CubeScene::voxel_meshes_ready() const
+{
+  return ((voxel_meshes_ || !baked_meshes_usable_)
+          && voxel_vertex_array_ && !voxel_data_changed_
+          && same_cube_pieces(voxel_pieces_, cube_pieces_));
+}
+
 void CubeScene::start_piece_animation()
 {
   if (get_is_drawable())
@@ -1192,7 +1735,7 @@ void CubeScene::gl_set_projection(int id, float offset)
   const float width  = get_viewport_width();
   const float height = get_viewport_height();
 
-  const float topinv   = G_SQRT2 + 1.; // cot(pi/8)
+  const float topinv   = view_cot_half_fov;
   const float rightinv = height / width * topinv;
 
   // Set up a perspective projection with a field of view angle of 45 degrees
@@ -1234,7 +1777,7 @@ void CubeScene::gl_draw_cell_grid(const Math::Matrix4& cube_transform)
       // Shift grid lines slighty to the front to suppress z-fighting.
       gl_set_projection(grid_uf_view_frustum_, 1.f / (1 << 13));
     }
-    const Math::Matrix4 model_view = transpose(cube_transform);
+    const Math::Matrix4 model_view = transpose(scale(cube_transform, grid_position_scale));
 
     glUniformMatrix3x4fv(grid_uf_model_view_, 1, GL_FALSE, &model_view[0][0]);
 
@@ -1290,68 +1833,215 @@ int CubeScene::gl_draw_pieces_range(const Math::Matrix4& cube_transform,
       }
       gl_set_projection((show_outline_) ? ol_uf_view_frustum_ : uf_view_frustum_);
     }
-    const BytesView<MeshDesc> desc_view {mesh_desc_};
-
     int last_fixed = last;
 
     if (animation_position_ > 0.f && last == animation_piece_ - 1)
       --last_fixed;
 
+    // The generated meshes are already in place, without the need
+    // to apply the orientation of the puzzle piece.
+    const bool voxel = voxel_meshes_ready();
+    const BytesView<MeshDesc> meshes {(voxel) ? voxel_draw_desc_ : mesh_draw_desc_};
+
+    draw_pieces_.clear();
+    piece_views_.clear();
+
     if (last_fixed >= first)
     {
+      // Skip pieces which are completely surrounded by pieces in place
+      // on the sides facing the viewer. The moving piece does not count
+      // as an occluder.
+      SomaBitCube occupied;
+
+      for (int i = first; i <= last_fixed; ++i)
+        occupied |= cube_pieces_[animation_data_[i].cube_index];
+
+      const auto rotation = Math::Matrix4::from_quaternion(rotation_);
+      const auto eye = transpose(rotation) * Math::Vector4{0.f, 0.f, -view_z_offset} / zoom_;
+      const SomaBitCube visible = find_visible_cells(cube_pieces_, occupied, eye);
+
       for (const int i : depth_order_)
-        if (i >= first && i <= last_fixed)
+        if (i >= first && i <= last_fixed
+            && (cube_pieces_[animation_data_[i].cube_index] & visible))
         {
-          const auto& data = animation_data_[i];
-          const auto& mesh = desc_view[data.cube_index];
-          triangle_count += mesh.triangle_count;
-
-          gl_draw_piece_elements(cube_transform, data);
+          draw_pieces_.push_back(i);
+          piece_views_.push_back((voxel) ? Math::Matrix4{} : animation_data_[i].transform);
         }
     }
     if (last != last_fixed)
     {
       const auto& data = animation_data_[last];
-      const auto& mesh = desc_view[data.cube_index];
-      triangle_count += mesh.triangle_count;
-
-      // Distance in model units an animated cube piece has to travel.
-      const float animation_distance = 1.75 * SomaBitCube::N * grid_cell_size;
       const float d = animation_position_ * animation_distance;
 
-      const auto transform = translate(cube_transform, data.direction[0] * d,
-                                                       data.direction[1] * d,
-                                                       data.direction[2] * d);
-      gl_draw_piece_elements(transform, data);
+      const auto offset = translate(Math::Matrix4{}, data.direction[0] * d,
+                                                     data.direction[1] * d,
+                                                     data.direction[2] * d);
+      draw_pieces_.push_back(last);
+      piece_views_.push_back((voxel) ? offset : offset * data.transform);
+    }
+    const int count = draw_pieces_.size();
+
+    // Transform all pieces to view space in one go.
+    mul_batch(cube_transform, piece_views_.data(), piece_views_.data(), count);
+
+    // Fold the dequantization of vertex positions into the transformation.
+    model_views_.resize(count);
+
+    for (int k = 0; k < count; ++k)
+    {
+      const auto& data = animation_data_[draw_pieces_[k]];
+      const auto& mesh = meshes[(voxel) ? data.cube_index : data.mesh_index];
+      model_views_[k] = scale(translate(piece_views_[k], mesh.bias[0], mesh.bias[1],
+                                                         mesh.bias[2]),
+                              mesh.scale);
+    }
+    model_view_rows_.resize(12 * count);
+    transpose_3x4_batch(model_views_.data(), model_view_rows_.data(), count);
+
+    for (int k = 0; k < count; ++k)
+    {
+      const auto& data = animation_data_[draw_pieces_[k]];
+      const auto& mesh = meshes[(voxel) ? data.cube_index : data.mesh_index];
+
+      triangle_count += gl_draw_piece_elements(mesh, data, piece_views_[k],
+                                               &model_view_rows_[12 * k]);
     }
   }
   return triangle_count;
 }
 
-void CubeScene::gl_draw_piece_elements(const Math::Matrix4& transform,
-                                       const AnimationData& data)
+/*
+ * Draw a single piece. The piece view transformation maps model units to
+ * view space, while the model view rows additionally include the vertex
+ * dequantization, in the layout expected by glUniformMatrix3x4fv().
+ */
+int CubeScene::gl_draw_piece_elements(const MeshDesc& mesh, const AnimationData& data,
+                                      const Math::Matrix4& piece_view,
+                                      const float* model_view)
 {
-  Math::Matrix4 model_view = transform * data.transform;
-  model_view.transpose();
-
   glUniformMatrix3x4fv((show_outline_) ? ol_uf_model_view_ : uf_model_view_,
-                       1, GL_FALSE, &model_view[0][0]);
+                       1, GL_FALSE, model_view);
   glUniform4fv((show_outline_) ? ol_uf_diffuse_color_ : uf_diffuse_color_,
                1, piece_colors[data.cube_index % piece_colors.size()]);
 
-  const auto& mesh = BytesView<MeshDesc>{mesh_desc_}[data.cube_index];
+  if (!show_outline_)
+  {
+    // The texture coordinates are derived from the model space position,
+    // so the texture shear needs to take the dequantization into account.
+    GLfloat shear[2][4];
+
+    for (int i = 0; i < 2; ++i)
+    {
+      const GLfloat *const row = texture_shear[i];
+
+      shear[i][0] = row[0] * mesh.scale;
+      shear[i][1] = row[1] * mesh.scale;
+      shear[i][2] = row[2] * mesh.scale;
+      shear[i][3] = row[3] + row[0] * mesh.bias[0] + row[1] * mesh.bias[1]
+                           + row[2] * mesh.bias[2];
+    }
+    glUniformMatrix2x4fv(uf_texture_shear_, 1, GL_FALSE, shear[0]);
+  }
+
+  const int level = select_mesh_lod(mesh, get_pixel_scale());
+  const auto& lod = mesh.lod[level];
 
-  glDrawRangeElements(GL_TRIANGLES, mesh.element_first, mesh.element_last,
-                      3 * mesh.triangle_count, GL::attrib_type<MeshIndex>,
-                      GL::buffer_offset<MeshIndex>(mesh.indices_offset));
+  const GLenum index_type = (mesh.index_size == sizeof(MeshIndex32))
+                            ? GL::attrib_type<MeshIndex32> : GL::attrib_type<MeshIndex>;
+
+  if (level == 0 && mesh.cluster_count > 0)
+    return gl_draw_mesh_clusters(piece_view, mesh, index_type);
+
+  if (GL::extensions().draw_base_vertex)
+    glDrawRangeElementsBaseVertex(GL_TRIANGLES, 0, mesh.element_count() - 1,
+                                  3 * lod.triangle_count, index_type,
+                                  GL::buffer_offset(lod.indices_offset), mesh.element_first);
+  else
+    glDrawRangeElements(GL_TRIANGLES, mesh.element_first, mesh.element_last,
+                        3 * lod.triangle_count, index_type,
+                        GL::buffer_offset(lod.indices_offset));
+  return lod.triangle_count;
 }
 
-void CubeScene::gl_init_cube_texture()
+/*
+ * Draw the clusters of the full detail level of a mesh which are not
+ * entirely back-facing for the given transformation, merging adjacent
+ * visible clusters into a single range. The transformation maps model
+ * units to view space, and includes the uniform zoom scale.
+ */
+int CubeScene::gl_draw_mesh_clusters(const Math::Matrix4& piece_view,
+                                     const MeshDesc& mesh, unsigned int index_type)
 {
-  const auto resource = Gio::Resource::lookup_data_global(RESOURCE_PREFIX "woodtexture.ktx");
-  g_return_if_fail(resource);
+  const BytesView<MeshCluster> clusters {scene_data_.mesh_clusters};
+  const unsigned int lod_offset = mesh.lod[0].indices_offset;
+
+  draw_counts_.clear();
+  draw_offsets_.clear();
+
+  unsigned int run_first = 0;
+  unsigned int run_end   = 0;
+  int triangle_count = 0;
+
+  const auto flush_run = [&]()
+  {
+    if (run_end > run_first)
+    {
+      draw_counts_.push_back(3 * (run_end - run_first));
+      draw_offsets_.push_back(GL::buffer_offset(lod_offset
+                                                + 3 * run_first * mesh.index_size));
+      triangle_count += run_end - run_first;
+    }
+  };
+
+  for (unsigned int i = 0; i < mesh.cluster_count; ++i)
+  {
+    const MeshCluster& cluster = clusters[mesh.cluster_first + i];
+
+    Math::Vector4 center = piece_view * Math::Vector4{cluster.center[0], cluster.center[1],
+                                                      cluster.center[2], 1.f};
+    center[3] = 0.f;
+    const Math::Vector4 axis = normalize(piece_view * Math::Vector4{cluster.cone_axis[0],
+                                                                    cluster.cone_axis[1],
+                                                                    cluster.cone_axis[2]});
+    if (cluster_faces_away(center, axis, zoom_ * cluster.radius, cluster.cone_cutoff))
+      continue;
+
+    if (cluster.triangle_first != run_end)
+    {
+      flush_run();
+      run_first = cluster.triangle_first;
+    }
+    run_end = cluster.triangle_first + cluster.triangle_count;
+  }
+  flush_run();
 
-  const BytesView<guint32> ktx {resource};
+  const int draw_count = draw_counts_.size();
+
+  if (GL::extensions().multi_draw && draw_count > 1)
+  {
+    draw_base_vertices_.assign(draw_count, mesh.element_first);
+
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, draw_counts_.data(), index_type,
+                                  draw_offsets_.data(), draw_count,
+                                  draw_base_vertices_.data());
+    return triangle_count;
+  }
+  for (int i = 0; i < draw_count; ++i)
+  {
+    if (GL::extensions().draw_base_vertex)
+      glDrawRangeElementsBaseVertex(GL_TRIANGLES, 0, mesh.element_count() - 1,
+                                    draw_counts_[i], index_type,
+                                    draw_offsets_[i], mesh.element_first);
+    else
+      glDrawRangeElements(GL_TRIANGLES, mesh.element_first, mesh.element_last,
+                          draw_counts_[i], index_type, draw_offsets_[i]);
+  }
+  return triangle_count;
+}
+
+void CubeScene::gl_init_cube_texture()
+{
+  g_return_if_fail(scene_data_.texture.data);
 
   glActiveTexture(GL_TEXTURE0 + SAMPLER_PIECE);
 
@@ -1370,7 +2060,20 @@ void CubeScene::gl_init_cube_texture()
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
                     std::min(8.f, GL::extensions().max_anisotropy));
 
-  GL::tex_image_from_ktx(&ktx[0], ktx.size());
+  // Upload the smallest mipmap levels right away, so that the scene can
+  // be drawn immediately. The finer levels follow with the next frames.
+  texture_upload_ = std::make_unique<GL::TextureUpload>(scene_data_.texture, cube_texture_);
+  gl_update_cube_texture();
+}
+
+void CubeScene::gl_update_cube_texture()
+{
+  glActiveTexture(GL_TEXTURE0 + SAMPLER_PIECE);
+
+  if (texture_upload_->gl_upload_step(texture_upload_budget))
+    texture_upload_.reset();
+  else
+    queue_static_draw();
 }
 
 } // namespace Somato
@@ -23,8 +23,12 @@
 #include "glscene.h"
 #include "bitcube.h"
 #include "glshader.h"
+#include "gltexture.h"
+#include "meshtypes.h"
 #include "puzzle.h"
+#include "sceneloader.h"
 #include "vectormath.h"
+#include "voxelmesher.h"
 
 #include <sigc++/sigc++.h>
 #include <glibmm/bytes.h>
@@ -41,6 +45,7 @@ struct AnimationData
 {
   Math::Matrix4 transform;      // puzzle piece orientation
   unsigned int  cube_index = 0; // index into pieces vector in original order
+  unsigned int  mesh_index = 0; // index of the baked mesh of the same shape
   float         direction[3] = {0., 0., 0.}; // animation move direction
 };
 
@@ -87,6 +92,9 @@ public:
   void set_show_outline(bool show_outline);
   bool get_show_outline() const;
 
+  void set_voxel_meshes(bool voxel_meshes);
+  bool get_voxel_meshes() const;
+
   int get_cube_triangle_count() const;
   int get_cube_vertex_count() const;
 
@@ -121,16 +129,32 @@ private:
 
   Math::Quat                  rotation_;
 
-  Glib::RefPtr<const Glib::Bytes> mesh_desc_;
+  std::unique_ptr<SceneLoader> scene_loader_;
+  SceneData                   scene_data_;
+  Glib::RefPtr<const Glib::Bytes> mesh_draw_desc_;
+  std::unique_ptr<GL::TextureUpload> texture_upload_;
+
+  std::unique_ptr<VoxelMesher> voxel_mesher_;
+  SceneData                   voxel_data_;
+  Glib::RefPtr<const Glib::Bytes> voxel_draw_desc_;
+  SomaCube                    voxel_pieces_;
 
   SomaCube                    cube_pieces_;
   std::vector<AnimationData>  animation_data_;
   PieceCellVector             piece_cells_;
   std::vector<int>            depth_order_;
+  std::vector<int>            draw_counts_;
+  std::vector<const void*>    draw_offsets_;
+  std::vector<int>            draw_base_vertices_;
+  std::vector<int>            draw_pieces_;
+  std::vector<Math::Matrix4>  piece_views_;
+  std::vector<Math::Matrix4>  model_views_;
+  std::vector<float>          model_view_rows_;
 
   sigc::signal<void>          signal_cycle_finished_;
   sigc::connection            delay_timeout_;
   sigc::connection            hide_cursor_timeout_;
+  sigc::connection            init_poll_timeout_;
 
   GL::ShaderProgram           piece_shader_;
   int                         uf_model_view_        = -1;
@@ -152,16 +176,21 @@ private:
 
   unsigned int                mesh_vertex_array_    = 0;
   unsigned int                mesh_buffers_[2]      = {0, 0};
+  unsigned int                voxel_vertex_array_   = 0;
+  unsigned int                voxel_buffers_[2]     = {0, 0};
   unsigned int                cube_texture_         = 0;
 
   int                         track_last_x_         = TRACK_UNSET;
   int                         track_last_y_         = TRACK_UNSET;
   CursorState                 cursor_state_         = CURSOR_DEFAULT;
 
+  gint64                      init_start_time_      = 0;
+
   int                         animation_piece_      = 0;
   int                         exclusive_piece_      = 0;
   float                       animation_seek_       = 1.;
   float                       animation_position_   = 0.;
+  float                       drawn_position_       = 0.;
   float                       animation_delay_      = 1. / 3.;
 
   float                       zoom_                 = 1.;
@@ -172,11 +201,16 @@ private:
   bool                        animation_running_    = false;
   bool                        show_cell_grid_       = false;
   bool                        show_outline_         = false;
+  bool                        voxel_meshes_         = false;
+  bool                        baked_meshes_usable_  = true;
+  bool                        voxel_data_changed_   = false;
   bool                        zoom_visible_         = true;
   bool                        cube_proj_dirty_      = true;
   bool                        outline_proj_dirty_   = true;
   bool                        grid_proj_dirty_      = true;
 
+  bool animation_moved_visibly() const;
+  float get_pixel_scale() const;
   void update_footing();
   void update_animation_order();
   void update_depth_order();
@@ -190,23 +224,38 @@ private:
   void reset_hide_cursor_timeout();
   bool on_hide_cursor_timeout();
   bool on_delay_timeout();
+  bool on_init_poll_timeout();
+  void on_scene_loaded();
+  void update_voxel_meshes();
+  void on_voxel_meshes_done();
+  bool voxel_meshes_ready() const;
 
   void cycle_exclusive(int direction);
   void select_piece(int piece);
   void process_track_motion(int x, int y);
 
-  void gl_create_mesh_buffers();
+  bool gl_complete_initialization();
+  void gl_create_mesh_buffers(const SceneData& data, const char* label,
+                              unsigned int& vertex_array, unsigned int (&buffers)[2],
+                              Glib::RefPtr<const Glib::Bytes>& draw_desc);
+  void gl_update_voxel_buffers();
+  void gl_delete_voxel_buffers();
   void gl_create_piece_shader();
   void gl_create_outline_shader();
   void gl_create_grid_shader();
+  void gl_init_uniforms();
   void gl_set_projection(int id, float offset = 0.);
 
   void gl_draw_cell_grid(const Math::Matrix4& cube_transform);
   int  gl_draw_pieces(const Math::Matrix4& cube_transform);
   int  gl_draw_pieces_range(const Math::Matrix4& cube_transform, int first, int last);
-  void gl_draw_piece_elements(const Math::Matrix4& transform, const AnimationData& data);
+  int  gl_draw_piece_elements(const MeshDesc& mesh, const AnimationData& data,
+                              const Math::Matrix4& piece_view, const float* model_view);
+  int  gl_draw_mesh_clusters(const Math::Matrix4& piece_view,
+                             const MeshDesc& mesh, unsigned int index_type);
 
   void gl_init_cube_texture();
+  void gl_update_cube_texture();
 };
 
 } // namespace Somato
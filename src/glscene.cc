@@ -30,6 +30,7 @@
 #include <gdkmm.h>
 #include <epoxy/gl.h>
 
+#include <glibmm/main.h>
 #include <algorithm>
 #include <utility>
 
@@ -44,6 +45,39 @@ enum
   DEPTH = 1
 };
 
+/* Render quality steps of the adaptive governor, ordered from full quality
+ * down to the cheapest setup.  Below the lowest multi-sample setting, the
+ * scene is rendered at a reduced resolution and scaled up by a linear blit
+ * before it is handed to GDK.  That only requires single-sample buffers.
+ */
+struct QualityStep
+{
+  int   max_samples;
+  float render_scale;
+};
+
+const QualityStep quality_steps[] =
+{
+  {G_MAXINT, 1.f}, {2, 1.f}, {0, 1.f}, {0, 0.75f}, {0, 0.5f}
+};
+
+/* Number of frames to average the frame interval over, also used as the
+ * idle period in frames after which the scene is considered to be at rest.
+ * The governor waits for UPGRADE_FRAMES frames in time before attempting to
+ * step up again, doubling the wait after each step down.
+ */
+enum
+{
+  SETTLE_FRAMES      = 8,
+  UPGRADE_FRAMES     = 120,
+  MAX_UPGRADE_FRAMES = 16 * UPGRADE_FRAMES
+};
+
+/* Time span in seconds without any frames drawn, after which the scene
+ * framebuffer is released to free up GPU memory.
+ */
+const unsigned int idle_release_delay = 30;
+
 extern "C"
 {
 static GLAPIENTRY
@@ -62,13 +96,19 @@ namespace GL
 Scene::Scene(BaseObjectType* obj)
 :
   Gtk::GLArea{obj},
-  text_layouts_ {new TextLayoutAtlas{}}
+  text_layouts_ {new TextLayoutAtlas{}},
+  upgrade_frames_ {UPGRADE_FRAMES}
 {
   add_events(Gdk::FOCUS_CHANGE_MASK);
+
+  text_layouts_->signal_glyphs_ready().connect(sigc::mem_fun(*this, &Scene::queue_static_draw));
 }
 
 Scene::~Scene()
-{}
+{
+  settle_timeout_.disconnect();
+  idle_timeout_.disconnect();
+}
 
 void Scene::reset_counters()
 {
@@ -88,10 +128,10 @@ unsigned int Scene::get_triangle_counter() const
 
 void Scene::set_multisample(int n_samples)
 {
-  const int samples_set = std::min(aa_samples_, max_aa_samples_);
+  const int samples_set = get_effective_samples(quality_level_);
   aa_samples_ = n_samples;
 
-  if (n_samples != samples_set)
+  if (get_effective_samples(quality_level_) != samples_set)
   {
     size_changed_ = true;
     queue_static_draw();
@@ -103,6 +143,22 @@ int Scene::get_multisample() const
   return aa_samples_;
 }
 
+void Scene::set_adaptive_quality(bool adaptive)
+{
+  if (adaptive != adaptive_quality_)
+  {
+    adaptive_quality_ = adaptive;
+    adaptive_level_   = 0;
+    upgrade_frames_   = UPGRADE_FRAMES;
+
+    if (quality_level_ != 0)
+    {
+      set_quality_level(0);
+      queue_static_draw();
+    }
+  }
+}
+
 void Scene::start_animation_tick()
 {
   g_return_if_fail(anim_tick_id_ == 0);
@@ -123,10 +179,34 @@ void Scene::reset_animation_tick()
   first_tick_ = true;
 }
 
+/*
+ * Queue a redraw for a change not driven by the animation tick. Since the
+ * tick handler only redraws if the animation moved visibly, this cannot be
+ * skipped while the tick is active. Redundant requests are merged anyway.
+ */
 void Scene::queue_static_draw()
 {
-  if (anim_tick_id_ == 0 && get_is_drawable())
+  if (get_is_drawable())
+  {
+    // Draw a still frame at full quality.  During continuous motion, the
+    // settle timeout is pending and takes care of that once at rest.
+    if (quality_level_ != 0 && !settle_timeout_.connected())
+      set_quality_level(0);
+
     queue_draw();
+  }
+}
+
+/*
+ * Called by the animation tick handler instead of queueing a redraw if the
+ * frame is skipped because nothing moved visibly. The frame time governor
+ * measures the interval from the last frame clock cycle, drawn or skipped,
+ * so that skipped ticks are not mistaken for missed frames.
+ */
+void Scene::skip_animation_frame()
+{
+  if (GdkFrameClock *const frame_clock = gtk_widget_get_frame_clock(Gtk::Widget::gobj()))
+    interval_start_ = gdk_frame_clock_get_frame_time(frame_clock);
 }
 
 void Scene::gl_initialize()
@@ -174,11 +254,16 @@ void Scene::gl_update_viewport()
   alloc_width_  = std::max(1, get_allocated_width());
   alloc_height_ = std::max(1, get_allocated_height());
 
-  g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Viewport resized to %dx%d",
-        get_viewport_width(), get_viewport_height());
+  const float render_scale = get_render_scale(quality_level_);
+
+  render_width_  = std::max(1, int(get_viewport_width()  * render_scale + 0.5f));
+  render_height_ = std::max(1, int(get_viewport_height() * render_scale + 0.5f));
+
+  g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Viewport resized to %dx%d, rendering at %dx%d",
+        get_viewport_width(), get_viewport_height(), render_width_, render_height_);
 
   gl_update_framebuffer();
-  glViewport(0, 0, get_viewport_width(), get_viewport_height());
+  glViewport(0, 0, render_width_, render_height_);
 
   size_changed_ = false;
 }
@@ -205,6 +290,14 @@ void Scene::on_realize()
                             0, nullptr, GL_TRUE);
       glDebugMessageCallback(&gl_on_debug_message, nullptr);
     }
+    // Let the implementation use as many shader compiler threads as it likes.
+    if (GL::extensions().parallel_shader_compile)
+    {
+      if (epoxy_has_gl_extension("GL_KHR_parallel_shader_compile"))
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+      else
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
     max_aa_samples_ = 0;
     glGetIntegerv(GL_MAX_SAMPLES, &max_aa_samples_);
 
@@ -214,6 +307,9 @@ void Scene::on_realize()
 
 void Scene::on_unrealize()
 {
+  settle_timeout_.disconnect();
+  idle_timeout_.disconnect();
+
   if (const auto context = get_context())
   {
     // No need for scoped acquisition here, as Gtk::GLArea's unrealize
@@ -238,6 +334,11 @@ void Scene::on_size_allocate(Gtk::Allocation& allocation)
  * the drawing logic of Gtk::GLArea to bypass it. That way, we can create
  * our own frame buffer configuration with multi-sample render buffers,
  * without interference from Gtk::GLArea's hard-coded setup.
+ *
+ * The copy of the finished frame by gdk_cairo_draw_from_gl() cannot be
+ * avoided this way, nor by rendering through Gtk::GLArea::on_render():
+ * GTK+ 3 presents the GLArea framebuffer by means of the very same call,
+ * so that route would merely add a resolve blit on top of it.
  */
 bool Scene::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
 {
@@ -248,22 +349,16 @@ bool Scene::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
     text_layouts_->set_pango_context(std::move(context));
   }
   make_current();
+  gl_draw_frame();
 
-  if (size_changed_)
-    gl_update_viewport();
-
-  if (text_layouts_->update_needed())
-    text_layouts_->gl_update(get_viewport_width(), get_viewport_height());
-
-  const unsigned int triangle_count = gl_render();
+  // A frame rendered at reduced resolution has been scaled up into the
+  // resolve buffer, which is then what GDK gets to see.
+  const unsigned int source = (resolve_buffer_) ? resolve_buffer_ : render_buffers_[COLOR];
 
   gdk_cairo_draw_from_gl(cr->cobj(), gtk_widget_get_window(Gtk::Widget::gobj()),
-                         render_buffers_[COLOR], GL_RENDERBUFFER,
+                         source, GL_RENDERBUFFER,
                          scale_factor_, 0, 0,
                          get_viewport_width(), get_viewport_height());
-  ++frame_counter_;
-  triangle_counter_ += triangle_count;
-
   return true;
 }
 
@@ -329,6 +424,173 @@ bool Scene::try_make_current()
   return !!context;
 }
 
+int Scene::get_effective_samples(int level) const
+{
+  return std::min({aa_samples_, max_aa_samples_, quality_steps[level].max_samples});
+}
+
+float Scene::get_render_scale(int level) const
+{
+  return quality_steps[level].render_scale;
+}
+
+void Scene::set_quality_level(int level)
+{
+  if (get_effective_samples(level) != get_effective_samples(quality_level_)
+      || get_render_scale(level) != get_render_scale(quality_level_))
+  {
+    g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Render quality level %d", level);
+    size_changed_ = true;
+  }
+  quality_level_ = level;
+  level_frames_  = 0;
+}
+
+/*
+ * Move by one quality step in the given direction, skipping over steps
+ * that would not make any difference with the current settings.
+ */
+bool Scene::step_quality_level(int step)
+{
+  const int last_level = G_N_ELEMENTS(quality_steps) - 1;
+  const int samples = get_effective_samples(quality_level_);
+  const float scale = get_render_scale(quality_level_);
+
+  for (int level = quality_level_ + step; level >= 0 && level <= last_level; level += step)
+    if (get_effective_samples(level) != samples || get_render_scale(level) != scale)
+    {
+      set_quality_level(level);
+      adaptive_level_ = level;
+      return true;
+    }
+  return false;
+}
+
+/*
+ * Frame time governor. While the scene is redrawn continuously, compare the
+ * average frame interval against the display refresh interval, and step the
+ * render quality down if frames are missed. Once the scene comes to rest,
+ * on_settle_timeout() restores full quality for the static frame.
+ */
+void Scene::update_quality(GdkFrameClock* frame_clock)
+{
+  const gint64 frame_time = gdk_frame_clock_get_frame_time(frame_clock);
+  // A tick skipped within the current frame clock cycle does not count,
+  // as the frame is drawn anyway due to some other change.
+  const gint64 start = (interval_start_ < frame_time)
+                       ? std::max(last_frame_time_, interval_start_) : last_frame_time_;
+  const gint64 interval = frame_time - start;
+  last_frame_time_ = frame_time;
+
+  if (!adaptive_quality_)
+    return;
+
+  gint64 refresh = 0;
+  gdk_frame_clock_get_refresh_info(frame_clock, frame_time, &refresh, nullptr);
+
+  if (interval > SETTLE_FRAMES * refresh)
+  {
+    // Start over after a period of rest.
+    frame_interval_ = refresh;
+    level_frames_   = 0;
+    return;
+  }
+  if (quality_level_ != adaptive_level_)
+    set_quality_level(adaptive_level_);
+
+  frame_interval_ += (interval - frame_interval_) / SETTLE_FRAMES;
+  ++level_frames_;
+
+  if (level_frames_ >= SETTLE_FRAMES && 4 * frame_interval_ > 5 * refresh)
+  {
+    if (step_quality_level(1))
+      upgrade_frames_ = std::min<int>(2 * upgrade_frames_, MAX_UPGRADE_FRAMES);
+  }
+  else if (level_frames_ >= upgrade_frames_ && 10 * frame_interval_ < 11 * refresh)
+  {
+    step_quality_level(-1);
+  }
+  settle_timeout_.disconnect();
+
+  if (quality_level_ > 0)
+    settle_timeout_ = Glib::signal_timeout().connect(
+        sigc::mem_fun(*this, &Scene::on_settle_timeout),
+        SETTLE_FRAMES * refresh / 1000 + 1);
+}
+
+bool Scene::on_settle_timeout()
+{
+  if (quality_level_ != 0)
+  {
+    set_quality_level(0);
+    queue_draw();
+  }
+  return false; // disconnect
+}
+
+/*
+ * Once the scene has been idle for a while, for instance because the
+ * animation is paused, release the possibly multi-sampled framebuffer.
+ * It will be recreated on demand by the next frame.
+ */
+bool Scene::on_idle_timeout()
+{
+  if (g_get_monotonic_time() - last_frame_time_ < gint64{idle_release_delay} * G_USEC_PER_SEC)
+    return true; // keep waiting
+
+  if (frame_buffer_)
+    if (auto guard = scoped_make_current())
+    {
+      g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Releasing framebuffer of idle scene");
+
+      gl_delete_framebuffer();
+      size_changed_ = true;
+    }
+  return false; // disconnect
+}
+
+void Scene::gl_draw_frame()
+{
+  if (GdkFrameClock *const frame_clock = gtk_widget_get_frame_clock(Gtk::Widget::gobj()))
+    update_quality(frame_clock);
+
+  if (size_changed_)
+    gl_update_viewport();
+
+  if (text_layouts_->update_needed())
+    text_layouts_->gl_update(get_viewport_width(), get_viewport_height());
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frame_buffer_);
+
+  const unsigned int triangle_count = gl_render();
+
+  if (resolve_frame_)
+    gl_scale_frame();
+
+  ++frame_counter_;
+  triangle_counter_ += triangle_count;
+
+  if (!idle_timeout_.connected())
+    idle_timeout_ = Glib::signal_timeout().connect_seconds(
+        sigc::mem_fun(*this, &Scene::on_idle_timeout), idle_release_delay);
+}
+
+/*
+ * Scale up a frame rendered at reduced resolution to the full size of the
+ * viewport.  The source is never multi-sampled, so filtering is allowed.
+ */
+void Scene::gl_scale_frame()
+{
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, frame_buffer_);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_frame_);
+
+  glBlitFramebuffer(0, 0, render_width_, render_height_,
+                    0, 0, get_viewport_width(), get_viewport_height(),
+                    GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_);
+}
+
 unsigned int Scene::gl_try_create_framebuffer(unsigned int color_format, int samples)
 {
   gl_delete_framebuffer();
@@ -343,13 +605,13 @@ unsigned int Scene::gl_try_create_framebuffer(unsigned int color_format, int sam
   GL::set_object_label(GL_RENDERBUFFER, render_buffers_[COLOR], "sceneColor");
 
   glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, color_format,
-                                   get_viewport_width(), get_viewport_height());
+                                   render_width_, render_height_);
 
   glBindRenderbuffer(GL_RENDERBUFFER, render_buffers_[DEPTH]);
   GL::set_object_label(GL_RENDERBUFFER, render_buffers_[DEPTH], "sceneDepth");
 
   glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24,
-                                   get_viewport_width(), get_viewport_height());
+                                   render_width_, render_height_);
   glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frame_buffer_);
@@ -363,30 +625,73 @@ unsigned int Scene::gl_try_create_framebuffer(unsigned int color_format, int sam
   return glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
 }
 
-void Scene::gl_update_framebuffer()
+void Scene::gl_create_resolve_buffer(unsigned int color_format)
 {
-  if (!GL::extensions().is_gles)
-  {
-    const int samples = std::min(aa_samples_, max_aa_samples_);
+  glGenRenderbuffers(1, &resolve_buffer_);
+  GL::Error::throw_if_fail(resolve_buffer_ != 0);
 
-    // SRGB8 is not a required color-renderable format, but it appears to
-    // be widely supported. Unfortunately, using the required SRGB8_ALPHA8
-    // format instead causes problems due to a GTK+ bug.
-    if (gl_try_create_framebuffer(GL_SRGB8, samples) == GL_FRAMEBUFFER_COMPLETE)
-      return;
-  }
-  // The GDK OpenGL-Cairo code is unable to handle multisample renderbuffer
-  // sources if the color format includes an alpha component. Unfortunately
-  // there is no way to instruct GDK to not do any alpha blending and just
-  // blit the framebuffer as it does without alpha.
-  const unsigned int status = gl_try_create_framebuffer(GL_SRGB8_ALPHA8, 0);
+  glGenFramebuffers(1, &resolve_frame_);
+  GL::Error::throw_if_fail(resolve_frame_ != 0);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, resolve_buffer_);
+  GL::set_object_label(GL_RENDERBUFFER, resolve_buffer_, "resolveColor");
+
+  glRenderbufferStorage(GL_RENDERBUFFER, color_format,
+                        get_viewport_width(), get_viewport_height());
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_frame_);
+  GL::set_object_label(GL_FRAMEBUFFER, resolve_frame_, "resolveFrame");
+
+  glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, resolve_buffer_);
+
+  const unsigned int status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frame_buffer_);
 
   if (status != GL_FRAMEBUFFER_COMPLETE)
     throw GL::FramebufferError{status};
 }
 
+void Scene::gl_update_framebuffer()
+{
+  unsigned int color_format = GL_SRGB8;
+
+  // SRGB8 is not a required color-renderable format, but it appears to
+  // be widely supported. Unfortunately, using the required SRGB8_ALPHA8
+  // format instead causes problems due to a GTK+ bug.
+  if (GL::extensions().is_gles
+      || gl_try_create_framebuffer(GL_SRGB8, get_effective_samples(quality_level_))
+         != GL_FRAMEBUFFER_COMPLETE)
+  {
+    // The GDK OpenGL-Cairo code is unable to handle multisample renderbuffer
+    // sources if the color format includes an alpha component. Unfortunately
+    // there is no way to instruct GDK to not do any alpha blending and just
+    // blit the framebuffer as it does without alpha.
+    color_format = GL_SRGB8_ALPHA8;
+
+    const unsigned int status = gl_try_create_framebuffer(color_format, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+      throw GL::FramebufferError{status};
+  }
+  if (render_width_ != get_viewport_width() || render_height_ != get_viewport_height())
+    gl_create_resolve_buffer(color_format);
+}
+
 void Scene::gl_delete_framebuffer()
 {
+  if (resolve_frame_)
+  {
+    glDeleteFramebuffers(1, &resolve_frame_);
+    resolve_frame_ = 0;
+  }
+  if (resolve_buffer_)
+  {
+    glDeleteRenderbuffers(1, &resolve_buffer_);
+    resolve_buffer_ = 0;
+  }
   if (frame_buffer_)
   {
     glDeleteFramebuffers(1, &frame_buffer_);
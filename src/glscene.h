@@ -21,6 +21,7 @@
 #define SOMATO_GLSCENE_H_INCLUDED
 
 #include <gtkmm/glarea.h>
+#include <sigc++/sigc++.h>
 #include <memory>
 
 namespace GL
@@ -47,6 +48,9 @@ public:
   void set_multisample(int n_samples);
   int  get_multisample() const;
 
+  void set_adaptive_quality(bool adaptive);
+  bool get_adaptive_quality() const { return adaptive_quality_; }
+
 protected:
   class ContextGuard
   {
@@ -74,6 +78,7 @@ protected:
   void reset_animation_tick();
   bool animation_tick_active() const { return (anim_tick_id_ != 0); }
   void queue_static_draw();
+  void skip_animation_frame();
 
   int get_unscaled_width()  const { return alloc_width_;  }
   int get_unscaled_height() const { return alloc_height_; }
@@ -101,7 +106,19 @@ private:
 
   bool try_make_current();
 
+  int   get_effective_samples(int level) const;
+  float get_render_scale(int level) const;
+  void  set_quality_level(int level);
+  bool  step_quality_level(int step);
+  void  update_quality(GdkFrameClock* frame_clock);
+  bool  on_settle_timeout();
+  bool  on_idle_timeout();
+
+  void gl_draw_frame();
+  void gl_scale_frame();
+
   unsigned int gl_try_create_framebuffer(unsigned int color_format, int samples);
+  void gl_create_resolve_buffer(unsigned int color_format);
   void gl_update_framebuffer();
   void gl_delete_framebuffer();
 
@@ -110,22 +127,36 @@ private:
   static void tick_callback_destroy(gpointer user_data);
 
   std::unique_ptr<TextLayoutAtlas> text_layouts_;
+  sigc::connection settle_timeout_;
+  sigc::connection idle_timeout_;
 
   gint64        anim_start_time_    = 0;
+  gint64        last_frame_time_    = 0;
+  gint64        interval_start_     = 0;
+  gint64        frame_interval_     = 0;
   unsigned int  anim_tick_id_       = 0;
   unsigned int  frame_counter_      = 0;
   unsigned int  triangle_counter_   = 0;
 
   unsigned int  frame_buffer_       = 0;
   unsigned int  render_buffers_[2]  = {0, 0};
+  unsigned int  resolve_frame_      = 0;
+  unsigned int  resolve_buffer_     = 0;
   int           aa_samples_         = 0;
   int           max_aa_samples_     = 0;
   int           scale_factor_       = 1;
   int           alloc_width_        = 1;
   int           alloc_height_       = 1;
+  int           render_width_       = 1;
+  int           render_height_      = 1;
+  int           quality_level_      = 0;
+  int           adaptive_level_     = 0;
+  int           level_frames_       = 0;
+  int           upgrade_frames_     = 0;
 
   bool          first_tick_         = false;
   bool          size_changed_       = true;
+  bool          adaptive_quality_   = true;
 };
 
 } // namespace GL
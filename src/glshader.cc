@@ -23,12 +23,21 @@
 #include "glutils.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <glibmm/bytes.h>
+#include <glibmm/checksum.h>
+#include <glibmm/miscutils.h>
 #include <glibmm/ustring.h>
 #include <giomm/resource.h>
 #include <epoxy/gl.h>
 
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <cstddef>
 #include <cstring>
 
 namespace
@@ -64,20 +73,35 @@ int choose_glsl_version()
   return 15; // require at least GLSL 1.50
 }
 
+/* Magic number at the start of cached program binary files.
+ */
+const guint32 program_cache_magic = 0x42504F53; // "SOPB"
+
+/* Maximum number of program binaries kept in the cache directory. Each
+ * driver update or shader change produces a new set of cache keys, so
+ * stale entries are pruned whenever a new binary is stored.
+ */
+const std::size_t program_cache_max_files = 64;
+
+Glib::ustring get_shader_preamble()
+{
+  // Select an appropriate preamble to the shader source text
+  // depending on whether we are using OpenGL ES or desktop OpenGL.
+  return Glib::ustring::compose((GL::extensions().is_gles)
+                                ? "#version %10 es\n"
+                                  "#define noperspective\n"
+                                  "#line 1\n"
+                                : "#version %10\n"
+                                  "#line 1\n",
+                                choose_glsl_version());
+}
+
 void load_shader_source(GLuint shader, const std::string& name)
 {
   const char* snippets[2];
   int lengths[G_N_ELEMENTS(snippets)];
 
-  // Select an appropriate preamble to the shader source text
-  // depending on whether we are using OpenGL ES or desktop OpenGL.
-  const auto preamble = Glib::ustring::compose((GL::extensions().is_gles)
-                      ? "#version %10 es\n"
-                        "#define noperspective\n"
-                        "#line 1\n"
-                      : "#version %10\n"
-                        "#line 1\n",
-                      choose_glsl_version());
+  const auto preamble = get_shader_preamble();
 
   snippets[0] = preamble.data();
   lengths [0] = preamble.bytes();
@@ -90,7 +114,36 @@ void load_shader_source(GLuint shader, const std::string& name)
   glShaderSource(shader, G_N_ELEMENTS(snippets), snippets, lengths);
 }
 
-GLuint compile_shader(GLenum type, const std::string& resource)
+/*
+ * Log the info log of a compiled shader, and throw if compilation failed.
+ */
+void check_compile_status(GLuint shader, const std::string& resource)
+{
+  GLint success = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+
+  GLint bufsize = 0;
+  glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &bufsize);
+
+  if (bufsize > 0)
+  {
+    const auto buffer = std::make_unique<char[]>(bufsize + 1);
+
+    GLsizei length = 0;
+    glGetShaderInfoLog(shader, bufsize, &length, buffer.get());
+
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == '\0'))
+      --length;
+    buffer[length] = '\0';
+
+    g_log(GL::log_domain, (success) ? G_LOG_LEVEL_INFO : G_LOG_LEVEL_WARNING,
+          "%s", buffer.get());
+  }
+  if (!success)
+    throw GL::Error{Glib::ustring::compose("Compiling %1 failed", resource)};
+}
+
+GLuint compile_shader(GLenum type, const std::string& resource, bool deferred)
 {
   ScopedShader shader {type};
 
@@ -100,18 +153,26 @@ GLuint compile_shader(GLenum type, const std::string& resource)
   load_shader_source(shader.get(), resource);
   glCompileShader(shader.get());
 
-  GLint success = GL_FALSE;
-  glGetShaderiv(shader.get(), GL_COMPILE_STATUS, &success);
+  if (!deferred)
+    check_compile_status(shader.get(), resource);
 
+  return shader.release();
+}
+
+/*
+ * Log the info log of a shader program after linking.
+ */
+void log_program_info(GLuint program, bool success)
+{
   GLint bufsize = 0;
-  glGetShaderiv(shader.get(), GL_INFO_LOG_LENGTH, &bufsize);
+  glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufsize);
 
   if (bufsize > 0)
   {
     const auto buffer = std::make_unique<char[]>(bufsize + 1);
 
     GLsizei length = 0;
-    glGetShaderInfoLog(shader.get(), bufsize, &length, buffer.get());
+    glGetProgramInfoLog(program, bufsize, &length, buffer.get());
 
     while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == '\0'))
       --length;
@@ -120,10 +181,125 @@ GLuint compile_shader(GLenum type, const std::string& resource)
     g_log(GL::log_domain, (success) ? G_LOG_LEVEL_INFO : G_LOG_LEVEL_WARNING,
           "%s", buffer.get());
   }
+}
+
+std::string get_program_cache_dir()
+{
+  return Glib::build_filename(Glib::get_user_cache_dir(), PACKAGE_TARNAME, "programs");
+}
+
+/*
+ * Try to load a previously stored program binary. This fails gracefully
+ * if there is no cache file, or if the driver rejects the binary.
+ */
+bool load_program_binary(GLuint program, const std::string& filename)
+{
+  gchar* contents = nullptr;
+  gsize  length   = 0;
+
+  if (!g_file_get_contents(filename.c_str(), &contents, &length, nullptr))
+    return false;
+
+  const std::unique_ptr<gchar, decltype(&g_free)> guard {contents, &g_free};
+  guint32 header[2];
+
+  if (length <= sizeof header)
+    return false;
+
+  std::memcpy(header, contents, sizeof header);
+
+  if (header[0] != program_cache_magic)
+    return false;
+
+  glProgramBinary(program, header[1], contents + sizeof header, length - sizeof header);
+
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+
   if (!success)
-    throw GL::Error{Glib::ustring::compose("Compiling %1 failed", resource)};
+    g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Program binary rejected: %s", filename.c_str());
+  else
+    g_utime(filename.c_str(), nullptr); // mark as recently used for pruning
 
-  return shader.release();
+  return success;
+}
+
+/*
+ * Delete the least recently used program binaries from the cache
+ * directory until at most program_cache_max_files remain.
+ */
+void prune_program_cache(const std::string& dirname)
+{
+  GDir *const dir = g_dir_open(dirname.c_str(), 0, nullptr);
+
+  if (!dir)
+    return;
+
+  std::vector<std::pair<gint64, std::string>> entries;
+
+  while (const char *const name = g_dir_read_name(dir))
+  {
+    if (!g_str_has_suffix(name, ".bin"))
+      continue;
+
+    std::string filename = Glib::build_filename(dirname, name);
+    GStatBuf info;
+
+    if (g_stat(filename.c_str(), &info) == 0)
+      entries.emplace_back(info.st_mtime, std::move(filename));
+  }
+  g_dir_close(dir);
+
+  if (entries.size() <= program_cache_max_files)
+    return;
+
+  const auto first_kept = entries.end() - program_cache_max_files;
+  std::nth_element(entries.begin(), first_kept, entries.end());
+
+  for (auto pos = entries.begin(); pos != first_kept; ++pos)
+  {
+    if (g_unlink(pos->second.c_str()) == 0)
+      g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Pruned program binary %s", pos->second.c_str());
+  }
+}
+
+void store_program_binary(GLuint program, const std::string& filename)
+{
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+  if (length <= 0)
+    return;
+
+  guint32 header[2] = {program_cache_magic, 0};
+  std::vector<char> buffer (sizeof header + length);
+
+  GLenum  format  = 0;
+  GLsizei written = 0;
+  glGetProgramBinary(program, length, &written, &format, &buffer[sizeof header]);
+
+  if (written <= 0)
+    return;
+
+  header[1] = format;
+  std::memcpy(&buffer[0], header, sizeof header);
+
+  const std::string dirname = Glib::path_get_dirname(filename);
+  GError* error = nullptr;
+
+  if (g_mkdir_with_parents(dirname.c_str(), 0700) == 0
+      && g_file_set_contents(filename.c_str(), &buffer[0], sizeof header + written, &error))
+  {
+    g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Stored program binary %s", filename.c_str());
+    prune_program_cache(dirname);
+  }
+  else
+  {
+    g_log(GL::log_domain, G_LOG_LEVEL_WARNING, "Failed to store program binary %s: %s",
+          filename.c_str(), (error) ? error->message : g_strerror(errno));
+    if (error)
+      g_error_free(error);
+  }
 }
 
 } // anonymous namespace
@@ -131,9 +307,9 @@ GLuint compile_shader(GLenum type, const std::string& resource)
 namespace GL
 {
 
-ShaderObject::ShaderObject(unsigned int type, const std::string& resource)
+ShaderObject::ShaderObject(unsigned int type, const std::string& resource, bool deferred)
 :
-  shader_ {compile_shader(type, resource)}
+  shader_ {compile_shader(type, resource, deferred)}
 {}
 
 ShaderObject::~ShaderObject()
@@ -150,24 +326,14 @@ ShaderProgram::~ShaderProgram()
 
 void ShaderProgram::set_label(const char* label)
 {
-  if (!program_)
-  {
-    program_ = glCreateProgram();
-    GL::Error::throw_if_fail(program_ != 0);
-  }
+  ensure_created();
   GL::set_object_label(GL_PROGRAM, program_, label);
 }
 
-void ShaderProgram::attach(const ShaderObject& shader)
+void ShaderProgram::attach(const ShaderSource& source)
 {
-  g_return_if_fail(shader);
-
-  if (!program_)
-  {
-    program_ = glCreateProgram();
-    GL::Error::throw_if_fail(program_ != 0);
-  }
-  glAttachShader(program_, shader.get());
+  ensure_created();
+  sources_.push_back(source);
 }
 
 void ShaderProgram::bind_attrib_location(unsigned int idx, const char* name)
@@ -175,6 +341,8 @@ void ShaderProgram::bind_attrib_location(unsigned int idx, const char* name)
   g_return_if_fail(program_ != 0);
 
   glBindAttribLocation(program_, idx, name);
+
+  bindings_ += "attrib " + std::to_string(idx) + ' ' + name + '\n';
 }
 
 void ShaderProgram::bind_frag_data_location(unsigned int color_number, const char* name)
@@ -183,36 +351,53 @@ void ShaderProgram::bind_frag_data_location(unsigned int color_number, const cha
 
   if (!GL::extensions().is_gles)
     glBindFragDataLocation(program_, color_number, name);
+
+  bindings_ += "fragdata " + std::to_string(color_number) + ' ' + name + '\n';
 }
 
+/*
+ * Link the program, loading it from the program binary cache if possible.
+ * Otherwise, the attached shader sources are compiled and linked, and the
+ * resulting binary is stored in the cache for the next time around.
+ */
 void ShaderProgram::link()
 {
-  g_return_if_fail(program_ != 0);
+  if (start_link(false))
+    finish_link();
+}
 
-  glLinkProgram(program_);
+/*
+ * Like link(), but do not wait for the compiler if the implementation
+ * supports parallel shader compilation. The program must not be used
+ * before poll_link() returns true.
+ */
+void ShaderProgram::link_async()
+{
+  const bool deferred = GL::extensions().parallel_shader_compile;
 
-  GLint success = GL_FALSE;
-  glGetProgramiv(program_, GL_LINK_STATUS, &success);
+  if (start_link(deferred) && !deferred)
+    finish_link();
+}
 
-  GLint bufsize = 0;
-  glGetProgramiv(program_, GL_INFO_LOG_LENGTH, &bufsize);
+/*
+ * Return whether linking has completed, and finish it if so. Throws
+ * GL::Error if compiling or linking failed.
+ */
+bool ShaderProgram::poll_link()
+{
+  g_return_val_if_fail(program_ != 0, false);
 
-  if (bufsize > 0)
-  {
-    const auto buffer = std::make_unique<char[]>(bufsize + 1);
+  if (shaders_.empty())
+    return true;
 
-    GLsizei length = 0;
-    glGetProgramInfoLog(program_, bufsize, &length, buffer.get());
+  GLint completed = GL_FALSE;
+  glGetProgramiv(program_, GL_COMPLETION_STATUS_KHR, &completed);
 
-    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == '\0'))
-      --length;
-    buffer[length] = '\0';
+  if (!completed)
+    return false;
 
-    g_log(GL::log_domain, (success) ? G_LOG_LEVEL_INFO : G_LOG_LEVEL_WARNING,
-          "%s", buffer.get());
-  }
-  if (!success)
-    throw GL::Error{"Linking of shader program failed"};
+  finish_link();
+  return true;
 }
 
 int ShaderProgram::get_uniform_location(const char* name) const
@@ -237,6 +422,11 @@ void ShaderProgram::unuse()
 
 void ShaderProgram::reset()
 {
+  sources_.clear();
+  bindings_.clear();
+  shaders_.clear();
+  cache_file_.clear();
+
   if (const GLuint program = program_)
   {
     program_ = 0;
@@ -244,4 +434,123 @@ void ShaderProgram::reset()
   }
 }
 
+void ShaderProgram::ensure_created()
+{
+  if (!program_)
+  {
+    program_ = glCreateProgram();
+    GL::Error::throw_if_fail(program_ != 0);
+  }
+}
+
+/*
+ * Issue the link command, unless a cached program binary could be loaded.
+ * Return whether finish_link() needs to be called to complete the process.
+ */
+bool ShaderProgram::start_link(bool deferred)
+{
+  g_return_val_if_fail(program_ != 0, false);
+  g_return_val_if_fail(shaders_.empty(), false);
+
+  cache_file_.clear();
+
+  if (GL::extensions().program_binary)
+  {
+    std::string cache_file = Glib::build_filename(get_program_cache_dir(),
+                                                  get_cache_key() + ".bin");
+    if (load_program_binary(program_, cache_file))
+    {
+      g_log(GL::log_domain, G_LOG_LEVEL_DEBUG, "Loaded program binary %s", cache_file.c_str());
+      sources_.clear();
+      return false;
+    }
+    glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    cache_file_ = std::move(cache_file);
+  }
+  std::vector<ShaderObject> shaders;
+  shaders.reserve(sources_.size());
+
+  for (const auto& source : sources_)
+  {
+    shaders.emplace_back(source.type, source.resource, deferred);
+    glAttachShader(program_, shaders.back().get());
+  }
+  glLinkProgram(program_);
+
+  shaders_ = std::move(shaders);
+  return true;
+}
+
+/*
+ * Detach and release the shader objects after linking, check the link
+ * status and store the program binary in the cache.
+ */
+void ShaderProgram::finish_link()
+{
+  const std::vector<ShaderObject> shaders = std::move(shaders_);
+  const std::vector<ShaderSource> sources = std::move(sources_);
+  const std::string cache_file = std::move(cache_file_);
+
+  shaders_.clear();
+  sources_.clear();
+  cache_file_.clear();
+
+  for (const auto& shader : shaders)
+    glDetachShader(program_, shader.get());
+
+  GLint success = GL_FALSE;
+  glGetProgramiv(program_, GL_LINK_STATUS, &success);
+
+  if (!success)
+  {
+    // With deferred compilation, compile errors only surface now.
+    for (std::size_t i = 0; i < shaders.size() && i < sources.size(); ++i)
+    {
+      GLint compiled = GL_FALSE;
+      glGetShaderiv(shaders[i].get(), GL_COMPILE_STATUS, &compiled);
+
+      if (!compiled)
+        check_compile_status(shaders[i].get(), sources[i].resource);
+    }
+  }
+  log_program_info(program_, success);
+
+  if (!success)
+    throw GL::Error{"Linking of shader program failed"};
+
+  if (!cache_file.empty())
+    store_program_binary(program_, cache_file);
+}
+
+/*
+ * Compute the program binary cache key from the driver identification,
+ * the GLSL sources and the location bindings.
+ */
+std::string ShaderProgram::get_cache_key() const
+{
+  Glib::Checksum checksum {Glib::Checksum::CHECKSUM_SHA1};
+
+  for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+  {
+    if (const auto *const str = glGetString(name))
+      checksum.update(str, std::strlen(reinterpret_cast<const char*>(str)));
+    checksum.update("\n");
+  }
+  checksum.update(get_shader_preamble());
+
+  for (const auto& source : sources_)
+  {
+    checksum.update(std::to_string(source.type) + ' ' + source.resource + '\n');
+
+    const auto resource = Gio::Resource::lookup_data_global(source.resource);
+    gsize size = 0;
+    const auto *const data = static_cast<const guchar*>(resource->get_data(size));
+
+    checksum.update(data, size);
+  }
+  checksum.update(bindings_);
+
+  return checksum.get_string();
+}
+
 } // namespace GL
@@ -22,15 +22,26 @@
 
 #include <algorithm>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace GL
 {
 
+/* Shader stage type and resource path of its GLSL source text.
+ */
+struct ShaderSource
+{
+  unsigned int type;
+  std::string  resource;
+};
+
 class ShaderObject
 {
 public:
   ShaderObject() : shader_ {0} {}
-  ShaderObject(unsigned int type, const std::string& resource);
+  // With deferred set, return without waiting for the compile status.
+  ShaderObject(unsigned int type, const std::string& resource, bool deferred = false);
   ~ShaderObject();
 
   ShaderObject(const ShaderObject&) = delete;
@@ -52,6 +63,13 @@ private:
   unsigned int shader_;
 };
 
+/*
+ * Shader program object. Attached shader sources are compiled when the
+ * program is linked, unless a matching program binary has previously been
+ * stored in the user's cache directory, in which case it is loaded instead.
+ * With link_async(), compilation proceeds in the background if supported
+ * by the implementation, and poll_link() reports when it has completed.
+ */
 class ShaderProgram
 {
 public:
@@ -62,21 +80,31 @@ public:
   ShaderProgram& operator=(const ShaderProgram&) = delete;
 
   ShaderProgram(ShaderProgram&& other)
-    : program_ {other.program_} { other.program_ = 0; }
+    : program_ {other.program_}, sources_ {std::move(other.sources_)},
+      bindings_ {std::move(other.bindings_)}, shaders_ {std::move(other.shaders_)},
+      cache_file_ {std::move(other.cache_file_)} { other.program_ = 0; }
   ShaderProgram& operator=(ShaderProgram&& other)
-    { std::swap(program_, other.program_); return *this; }
+    { swap(*this, other); return *this; }
 
   friend void swap(ShaderProgram& a, ShaderProgram& b)
-    { std::swap(a.program_, b.program_); }
+  {
+    std::swap(a.program_, b.program_);
+    a.sources_.swap(b.sources_);
+    a.bindings_.swap(b.bindings_);
+    a.shaders_.swap(b.shaders_);
+    a.cache_file_.swap(b.cache_file_);
+  }
 
   explicit operator bool() const { return (program_ != 0); }
 
   void set_label(const char* label);
 
-  void attach(const ShaderObject& shader);
+  void attach(const ShaderSource& source);
   void bind_attrib_location(unsigned int idx, const char* name);
   void bind_frag_data_location(unsigned int color_number, const char* name);
   void link();
+  void link_async();
+  bool poll_link();
 
   int get_uniform_location(const char* name) const;
 
@@ -86,7 +114,16 @@ public:
   void reset();
 
 private:
-  unsigned int program_;
+  void ensure_created();
+  bool start_link(bool deferred);
+  void finish_link();
+  std::string get_cache_key() const;
+
+  unsigned int              program_;
+  std::vector<ShaderSource> sources_;
+  std::string               bindings_;   // location bindings, part of cache key
+  std::vector<ShaderObject> shaders_;    // attached while linking is pending
+  std::string               cache_file_; // where to store the linked binary
 };
 
 } // namespace GL
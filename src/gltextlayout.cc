@@ -25,10 +25,13 @@
 #include <glib.h>
 #include <cairomm/context.h>
 #include <cairomm/surface.h>
+#include <pango/pangocairo.h>
 #include <epoxy/gl.h>
 
 #include <cstddef>
+#include <cstring>
 #include <algorithm>
+#include <exception>
 #include <memory>
 #include <utility>
 
@@ -54,7 +57,7 @@ struct LayoutVertex
 
 /* Text layout element index type.
  */
-using LayoutIndex = GLushort;
+using LayoutIndex = GLuint;
 
 /* Index usage convention for arrays of buffer objects.
  */
@@ -80,9 +83,9 @@ enum
   SAMPLER_LAYOUT = 0
 };
 
-/* Texture atlas tile dimensions for 8 bit per texel. Note that the tile
- * width is expected to be an integer multiple of the Cairo image surface
- * row alignment, so that it always equals the row stride.
+/* Texture atlas tile dimensions for 8 bit per texel. The distance field
+ * images from the GlyphRenderer are copied into a CPU-side atlas image of
+ * ATLAS_WIDTH texels per row, from which dirty rectangles are uploaded.
  * The specified dimensions match the tile size used by Intel hardware.
  */
 enum
@@ -91,23 +94,48 @@ enum
   TILE_HEIGHT = 32
 };
 
-/* Element counts per text layout item.
+/* Glyph atlas dimensions. The width is fixed, while the height starts
+ * out small and is doubled whenever the shelves run out of space.
+ */
+enum : int
+{
+  ATLAS_WIDTH      = 4 * TILE_WIDTH,
+  ATLAS_MIN_HEIGHT = 4 * TILE_HEIGHT,
+  ATLAS_MAX_HEIGHT = 32 * TILE_HEIGHT
+};
+
+/* Element counts per glyph quad.
  */
 enum
 {
-  ITEM_PRIMITIVES = 2,
-  ITEM_VERTICES   = 4,
-  ITEM_INDICES    = 6
+  QUAD_PRIMITIVES = 2,
+  QUAD_VERTICES   = 4,
+  QUAD_INDICES    = 6
+};
+
+/* Maximum number of glyph quads, the granularity by which the buffer
+ * capacity grows, and the granularity of the vertex buffer slot reserved
+ * for each text layout item.
+ */
+enum : unsigned int
+{
+  MAX_QUADS  = 0x40000,
+  QUAD_CHUNK = 64,
+  SLOT_CHUNK = 8
 };
 
-/* Ink spill margins and padding between adjacent sub-images.
+/* Padding between adjacent glyph images.
  */
 enum : int
 {
-  MARGIN  = 1,
   PADDING = 1
 };
 
+/* Maximum time in nanoseconds to wait for the GPU to release a vertex
+ * stream segment, which normally has long been consumed.
+ */
+const GLuint64 stream_fence_timeout = 1000000000;
+
 /* Text intensity without and with focus.
  */
 const GLfloat focus_intensity[] = { 0.6, 1. };
@@ -125,11 +153,19 @@ TextLayoutAtlas::~TextLayoutAtlas()
   g_warn_if_fail(!buffers_[VERTICES] && !buffers_[INDICES] && !tex_name_ && !vao_);
 }
 
+/*
+ * Set the number of text layout items. This may be changed at any time,
+ * and only the vertex buffer slots are reassigned as a consequence.
+ */
 void TextLayoutAtlas::set_layout_count(unsigned int count)
 {
-  g_return_if_fail(!vao_);
+  if (count != items_.size())
+  {
+    items_.resize(count);
 
-  items_.resize(count);
+    need_repack_ = true;
+    need_repos_  = true;
+  }
 }
 
 void TextLayoutAtlas::set_layout_text(unsigned int idx, Glib::ustring text)
@@ -143,13 +179,16 @@ void TextLayoutAtlas::set_layout_text(unsigned int idx, Glib::ustring text)
 
     if (item.content.empty())
     {
-      item.ink_width  = 0;
-      item.ink_height = 0;
-
-      need_repos_ = true; // rebuild vertices only
+      item.glyphs.clear();
+      item.dirty = false;
     }
     else
-      need_repaint_ = true; // full texture repaint
+    {
+      item.dirty   = true;
+      need_layout_ = true; // shape this item only
+    }
+    item.repos  = true;
+    need_repos_ = true;
   }
 }
 
@@ -161,6 +200,7 @@ void TextLayoutAtlas::set_layout_color(unsigned int idx, Packed4u8 color)
   if (color != item.color)
   {
     item.color  = color;
+    item.repos  = true;
     need_repos_ = true;
   }
 }
@@ -175,6 +215,7 @@ void TextLayoutAtlas::set_layout_pos(unsigned int idx, TextLayout::Anchor anchor
     item.anchor = anchor;
     item.pos_x  = x;
     item.pos_y  = y;
+    item.repos  = true;
     need_repos_ = true;
   }
 }
@@ -187,7 +228,14 @@ void TextLayoutAtlas::set_pango_context(Glib::RefPtr<Pango::Context> context)
   context->update_from_cairo_context(Cairo::Context::create(surface));
 
   context_ = std::move(context);
-  need_repaint_ = true;
+
+  // Glyph images do not depend on the resolution, so the atlas can be
+  // kept. Only the shaping needs to be redone.
+  for (TextLayout& item : items_)
+    item.dirty = !item.content.empty();
+
+  need_layout_ = true;
+  need_repos_  = true;
 }
 
 void TextLayoutAtlas::unset_pango_context()
@@ -205,19 +253,22 @@ void TextLayoutAtlas::gl_init()
   glUniform1i(uf_texture_, SAMPLER_LAYOUT);
   glUniform1fv(uf_intensity_, 1, &focus_intensity[had_focus_]);
 
-  need_repos_ = need_repaint_ = !items_.empty();
+  // The glyph cache survives, but the new texture needs all of it.
+  mark_dirty(0, 0, ATLAS_WIDTH, atlas_height_);
 
-  for (TextLayout& item : items_)
-  {
-    item.ink_width  = 0;
-    item.ink_height = 0;
-  }
+  // Force reallocation of vertex buffer slots.
+  view_width_  = 0;
+  view_height_ = 0;
+  need_repack_ = true;
+  need_repos_  = true;
 }
 
 void TextLayoutAtlas::gl_delete()
 {
   draw_count_ = 0;
 
+  gl_delete_fences();
+
   if (vao_)
   {
     glDeleteVertexArrays(1, &vao_);
@@ -234,16 +285,24 @@ void TextLayoutAtlas::gl_delete()
     glDeleteTextures(1, &tex_name_);
     tex_name_ = 0;
   }
-  uf_texture_   = -1;
-  uf_intensity_ = -1;
+  stream_data_   = nullptr;
+  quad_capacity_ = 0;
+  uf_texture_    = -1;
+  uf_intensity_  = -1;
   shader_.reset();
+
+  staging_.clear();
+  staging_.shrink_to_fit();
 }
 
 void TextLayoutAtlas::gl_update(int view_width, int view_height)
 {
   g_return_if_fail(context_);
 
-  if (need_repaint_)
+  if (need_layout_)
+    update_layouts();
+
+  if (dirty_top_ < dirty_bottom_)
     gl_update_texture();
 
   if (need_repos_)
@@ -262,11 +321,17 @@ int TextLayoutAtlas::gl_draw_layouts(bool has_focus)
   if (draw_count_ > 0)
   {
     glBindVertexArray(vao_);
-    glDrawRangeElements(GL_TRIANGLES, 0, ITEM_VERTICES * draw_count_ - 1,
-                        ITEM_INDICES * draw_count_, GL::attrib_type<LayoutIndex>,
-                        GL::buffer_offset<LayoutIndex>(0));
+
+    if (stream_)
+      glDrawRangeElementsBaseVertex(GL_TRIANGLES, 0, QUAD_VERTICES * draw_count_ - 1,
+                                    QUAD_INDICES * draw_count_, GL::attrib_type<LayoutIndex>,
+                                    GL::buffer_offset<LayoutIndex>(0), base_vertex_);
+    else
+      glDrawRangeElements(GL_TRIANGLES, 0, QUAD_VERTICES * draw_count_ - 1,
+                          QUAD_INDICES * draw_count_, GL::attrib_type<LayoutIndex>,
+                          GL::buffer_offset<LayoutIndex>(0));
   }
-  return draw_count_ * ITEM_PRIMITIVES;
+  return draw_count_ * QUAD_PRIMITIVES;
 }
 
 void TextLayoutAtlas::gl_create_shader()
@@ -309,15 +374,22 @@ void TextLayoutAtlas::gl_create_texture()
                             ? GL_CLAMP_TO_BORDER : GL_CLAMP_TO_EDGE;
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, clamp_mode);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, clamp_mode);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 }
 
 void TextLayoutAtlas::gl_create_array()
 {
   g_return_if_fail(!vao_ && !buffers_[VERTICES] && !buffers_[INDICES]);
 
-  draw_count_ = 0;
+  draw_count_    = 0;
+  quad_capacity_ = 0;
+  segment_       = 0;
+  base_vertex_   = 0;
+
+  // Vertices are streamed through a persistently mapped ring of buffer
+  // segments if possible, so that updates never stall on the GPU.
+  stream_ = (GL::extensions().buffer_storage && GL::extensions().draw_base_vertex);
 
   glGenVertexArrays(1, &vao_);
   GL::Error::throw_if_fail(vao_ != 0);
@@ -331,10 +403,25 @@ void TextLayoutAtlas::gl_create_array()
   glBindBuffer(GL_ARRAY_BUFFER, buffers_[VERTICES]);
   GL::set_object_label(GL_BUFFER, buffers_[VERTICES], "layoutVertices");
 
-  glBufferData(GL_ARRAY_BUFFER,
-               items_.size() * ITEM_VERTICES * sizeof(LayoutVertex),
-               nullptr, GL_DYNAMIC_DRAW);
+  gl_set_vertex_format();
+
+  glEnableVertexAttribArray(ATTRIB_POSITION);
+  glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+  glEnableVertexAttribArray(ATTRIB_COLOR);
 
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[INDICES]);
+  GL::set_object_label(GL_BUFFER, buffers_[INDICES], "layoutIndices");
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+ * Point the vertex attributes at the currently bound vertex buffer.
+ * Expects the vertex array object to be bound.
+ */
+void TextLayoutAtlas::gl_set_vertex_format()
+{
   glVertexAttribPointer(ATTRIB_POSITION,
                         GL::attrib_size<decltype(LayoutVertex::position)>,
                         GL::attrib_type<decltype(LayoutVertex::position)>,
@@ -350,230 +437,652 @@ void TextLayoutAtlas::gl_create_array()
                         GL::attrib_type<decltype(LayoutVertex::color)>,
                         GL_TRUE, sizeof(LayoutVertex),
                         GL::buffer_offset(offsetof(LayoutVertex, color)));
+}
 
-  glEnableVertexAttribArray(ATTRIB_POSITION);
-  glEnableVertexAttribArray(ATTRIB_TEXCOORD);
-  glEnableVertexAttribArray(ATTRIB_COLOR);
+/*
+ * Grow the vertex and index buffers to hold at least the given number of
+ * glyph quads. Expects the vertex array object and the vertex buffer to be
+ * bound. Growth is rounded up so that typing does not reallocate each time.
+ */
+void TextLayoutAtlas::gl_reserve_quads(unsigned int count)
+{
+  if (count <= quad_capacity_)
+    return;
 
-  gl_create_indices();
+  const unsigned int capacity = std::min<unsigned int>(Math::align(count, QUAD_CHUNK),
+                                                       MAX_QUADS);
+  const std::size_t  bytes    = capacity * QUAD_VERTICES * sizeof(LayoutVertex);
 
-  glBindVertexArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
+  if (stream_)
+  {
+    // Immutable storage cannot be resized, so replace the buffer object.
+    // The GL keeps the old storage alive for draws still in flight.
+    gl_delete_fences();
 
-void TextLayoutAtlas::gl_create_indices()
-{
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[INDICES]);
-  GL::set_object_label(GL_BUFFER, buffers_[INDICES], "layoutIndices");
+    glDeleteBuffers(1, &buffers_[VERTICES]);
+    buffers_[VERTICES] = 0;
+    stream_data_ = nullptr;
+
+    glGenBuffers(1, &buffers_[VERTICES]);
+    GL::Error::throw_if_fail(buffers_[VERTICES] != 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers_[VERTICES]);
+    GL::set_object_label(GL_BUFFER, buffers_[VERTICES], "layoutVertices");
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const std::size_t size = G_N_ELEMENTS(fences_) * bytes;
+
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    stream_data_ = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    GL::Error::throw_if_fail(stream_data_ != nullptr);
 
-  const auto indices = std::make_unique<LayoutIndex[]>(items_.size() * ITEM_INDICES);
+    gl_set_vertex_format();
 
-  // Generate a triangle pair for each text layout item.
-  for (std::size_t i = 0; i < items_.size(); ++i)
+    staging_.resize(bytes);
+    segment_     = 0;
+    base_vertex_ = 0;
+  }
+  else
+    glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+
+  const auto indices = std::make_unique<LayoutIndex[]>(capacity * QUAD_INDICES);
+
+  // Generate a triangle pair for each glyph quad.
+  for (unsigned int i = 0; i < capacity; ++i)
   {
-    indices[ITEM_INDICES*i + 0] = ITEM_VERTICES*i + 0;
-    indices[ITEM_INDICES*i + 1] = ITEM_VERTICES*i + 1;
-    indices[ITEM_INDICES*i + 2] = ITEM_VERTICES*i + 2;
-    indices[ITEM_INDICES*i + 3] = ITEM_VERTICES*i + 3;
-    indices[ITEM_INDICES*i + 4] = ITEM_VERTICES*i + 2;
-    indices[ITEM_INDICES*i + 5] = ITEM_VERTICES*i + 1;
+    indices[QUAD_INDICES*i + 0] = QUAD_VERTICES*i + 0;
+    indices[QUAD_INDICES*i + 1] = QUAD_VERTICES*i + 1;
+    indices[QUAD_INDICES*i + 2] = QUAD_VERTICES*i + 2;
+    indices[QUAD_INDICES*i + 3] = QUAD_VERTICES*i + 3;
+    indices[QUAD_INDICES*i + 4] = QUAD_VERTICES*i + 2;
+    indices[QUAD_INDICES*i + 5] = QUAD_VERTICES*i + 1;
   }
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-               items_.size() * ITEM_INDICES * sizeof(LayoutIndex),
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity * QUAD_INDICES * sizeof(LayoutIndex),
                indices.get(), GL_STATIC_DRAW);
+
+  quad_capacity_ = capacity;
 }
 
 void TextLayoutAtlas::gl_update_texture()
 {
-  std::vector<Glib::RefPtr<Pango::Layout>> layouts;
-  layouts.reserve(items_.size());
+  glActiveTexture(GL_TEXTURE0 + SAMPLER_LAYOUT);
 
-  int img_width  = 0;
-  int img_height = 0;
+  g_return_if_fail(tex_name_);
+  glBindTexture(GL_TEXTURE_2D, tex_name_);
 
-  for (TextLayout& item : items_)
+  if (tex_width_ != ATLAS_WIDTH || tex_height_ != atlas_height_)
   {
-    layouts.push_back(create_pango_layout(item));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, atlas_height_,
+                 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    tex_width_  = ATLAS_WIDTH;
+    tex_height_ = atlas_height_;
+
+    mark_dirty(0, 0, ATLAS_WIDTH, atlas_height_);
+
+    // The texture coordinate scale changed along with the size.
+    for (TextLayout& item : items_)
+      item.repos = true;
+
+    need_repos_ = true;
+  }
+  // Upload only the rectangle touched by newly rasterized glyphs.
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, ATLAS_WIDTH);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, dirty_left_, dirty_top_,
+                  dirty_right_ - dirty_left_, dirty_bottom_ - dirty_top_,
+                  GL_RED, GL_UNSIGNED_BYTE,
+                  &atlas_image_[std::size_t{ATLAS_WIDTH} * dirty_top_ + dirty_left_]);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+  dirty_left_   = 0;
+  dirty_top_    = 0;
+  dirty_right_  = 0;
+  dirty_bottom_ = 0;
+}
+
+/*
+ * Regenerate the vertices of text layout items that changed. Each item
+ * owns a slot of quads in the vertex buffer, so that changed items can be
+ * rewritten in place. Unused quads of a slot are collapsed to nothing.
+ * Slots are only reassigned when an item outgrows its current slot.
+ */
+void TextLayoutAtlas::gl_update_vertices(int view_width, int view_height)
+{
+  g_return_if_fail(tex_width_ > 0 && tex_height_ > 0);
+  g_return_if_fail(vao_ && buffers_[VERTICES]);
+
+  if (view_width != view_width_ || view_height != view_height_)
+  {
+    view_width_  = view_width;
+    view_height_ = view_height;
+
+    for (TextLayout& item : items_)
+      item.repos = true;
+  }
+  // An item cut short by the quad limit only triggers another repack once
+  // its glyph count changes, instead of on every update.
+  const bool repack = need_repack_
+      || std::any_of(cbegin(items_), cend(items_), [](const TextLayout& t)
+                     { return (t.glyphs.size() > t.quad_slots && t.glyphs.size() != t.packed); });
+
+  const std::size_t  quad_size    = QUAD_VERTICES * sizeof(LayoutVertex);
+  const unsigned int all_segments = (1u << G_N_ELEMENTS(fences_)) - 1;
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers_[VERTICES]);
+
+  if (repack)
+  {
+    unsigned int total = 0;
+
+    for (TextLayout& item : items_)
+    {
+      const unsigned int slots = Math::align(static_cast<unsigned int>(item.glyphs.size()),
+                                             SLOT_CHUNK);
+
+      item.quad_first = total;
+      item.quad_slots = std::min(slots, MAX_QUADS - total);
+      item.packed     = item.glyphs.size();
+      item.repos      = true;
 
-    if (layouts.back())
+      total += item.quad_slots;
+    }
+    if (total == MAX_QUADS)
+      g_warning("Text layout glyph count exceeds limit");
+
+    glBindVertexArray(vao_);
+    gl_reserve_quads(total);
+    glBindVertexArray(0);
+
+    draw_count_  = 0;
+    need_repack_ = false;
+
+    if (stream_)
     {
-      if (item.tex_y != img_height)
+      for (TextLayout& item : items_)
       {
-        item.tex_y  = img_height;
-        need_repos_ = true;
+        write_vertices(item, staging_.data() + item.quad_first * quad_size);
+        item.stale = all_segments;
       }
-      img_height += item.ink_height + PADDING;
-      img_width = std::max(img_width, item.ink_width);
     }
+    else if (total > 0)
+    {
+      const bool ok = access_mapped_buffer(GL_ARRAY_BUFFER, 0, total * quad_size,
+                                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT,
+                                           [this](volatile void* data)
+      {
+        auto* const pv = static_cast<volatile LayoutVertex*>(data);
+
+        for (const TextLayout& item : items_)
+          write_vertices(item, pv + QUAD_VERTICES * item.quad_first);
+      });
+      if (!ok)
+        return;
+    }
+    draw_count_ = total;
   }
-  if (img_height <= PADDING)
+  else
+    for (TextLayout& item : items_)
+      if (item.repos && item.quad_slots > 0)
+      {
+        if (stream_)
+        {
+          write_vertices(item, staging_.data() + item.quad_first * quad_size);
+          item.stale = all_segments;
+          continue;
+        }
+        const bool ok = access_mapped_buffer(GL_ARRAY_BUFFER, item.quad_first * quad_size,
+                                             item.quad_slots * quad_size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT,
+                                             [this, &item](volatile void* data)
+        {
+          write_vertices(item, data);
+        });
+        if (!ok)
+          return;
+      }
+
+  // The segment drawn from is always current, so a stale mark on it
+  // means that vertices changed in this update.
+  if (stream_ && draw_count_ > 0
+      && std::any_of(cbegin(items_), cend(items_), [this](const TextLayout& t)
+                     { return (t.stale & (1u << segment_)) != 0; }))
+    gl_stream_vertices();
+
+  for (TextLayout& item : items_)
+    item.repos = false;
+
+  need_repos_ = false;
+}
+
+/*
+ * Switch to the next segment of the persistently mapped stream buffer,
+ * which subsequent draws will then source from, and copy over the staged
+ * vertices of the items that changed since the segment was last written.
+ * The segment left behind is fenced, and the segment about to be written
+ * is waited on, which only blocks if the GPU lags several updates behind.
+ */
+void TextLayoutAtlas::gl_stream_vertices()
+{
+  g_return_if_fail(stream_data_);
+
+  const unsigned int segments = G_N_ELEMENTS(fences_);
+
+  if (fences_[segment_])
+    glDeleteSync(fences_[segment_]);
+
+  fences_[segment_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  segment_ = (segment_ + 1) % segments;
+
+  if (GLsync fence = fences_[segment_])
   {
-    draw_count_   = 0;
-    need_repaint_ = false;
-    need_repos_   = false;
+    if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                         stream_fence_timeout) == GL_TIMEOUT_EXPIRED)
+      g_warning("Timeout waiting for text vertex stream segment");
+
+    glDeleteSync(fence);
+    fences_[segment_] = nullptr;
+  }
+  const unsigned int segment_vertices = QUAD_VERTICES * quad_capacity_;
+  const std::size_t  quad_size = QUAD_VERTICES * sizeof(LayoutVertex);
+  const unsigned int segment_bit = 1u << segment_;
+
+  auto *const dest = static_cast<unsigned char*>(stream_data_)
+                     + std::size_t{segment_} * segment_vertices * sizeof(LayoutVertex);
+
+  for (TextLayout& item : items_)
+    if ((item.stale & segment_bit) != 0)
+    {
+      std::memcpy(dest + item.quad_first * quad_size,
+                  staging_.data() + item.quad_first * quad_size,
+                  item.quad_slots * quad_size);
+      item.stale &= ~segment_bit;
+    }
+  base_vertex_ = segment_ * segment_vertices;
+}
+
+void TextLayoutAtlas::gl_delete_fences()
+{
+  for (GLsync& fence : fences_)
+    if (fence)
+    {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+}
+
+/*
+ * Write the glyph quads of a text layout item into its slot of the mapped
+ * vertex buffer or the staging copy, pointed to by data.
+ */
+void TextLayoutAtlas::write_vertices(const TextLayout& item, volatile void* data) const
+{
+  if (!item.repos || item.quad_slots == 0)
     return;
+
+  const float scale_s = 0.5f / tex_width_;
+  const float scale_t = 0.5f / tex_height_;
+  const float scale_x = 1.f / view_width_;
+  const float scale_y = 1.f / view_height_;
+
+  const float origin_x = 2 * item.origin_x() - view_width_;
+  const float origin_y = 2 * item.origin_y() - view_height_;
+  const auto  color    = item.color;
+
+  auto* pv = static_cast<volatile LayoutVertex*>(data);
+
+  const unsigned int count = std::min<std::size_t>(item.glyphs.size(), item.quad_slots);
+
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    const TextGlyph&  glyph = item.glyphs[i];
+    const AtlasGlyph& image = *glyph.image;
+
+    if (image.ready && image.width > 0)
+    {
+      // Texture coordinates in half texels, shifted into normalized
+      // [-1, 1] range (reversed in shader).
+      const float s0 = scale_s * (2 * image.tex_x - tex_width_);
+      const float s1 = scale_s * (2 * (image.tex_x + image.width) - tex_width_);
+      const float t0 = scale_t * (2 * (image.tex_y + image.height) - tex_height_);
+      const float t1 = scale_t * (2 * image.tex_y - tex_height_);
+
+      // Scale the image from reference size to display size.
+      const float left   = glyph.x + glyph.scale * image.ink_x;
+      const float top    = glyph.y - glyph.scale * image.ink_y;
+      const float width  = glyph.scale * image.width;
+      const float height = glyph.scale * image.height;
+
+      const float x0 = scale_x * (origin_x + 2 * left);
+      const float x1 = scale_x * (origin_x + 2 * (left + width));
+      const float y0 = scale_y * (origin_y + 2 * (top - height));
+      const float y1 = scale_y * (origin_y + 2 * top);
+
+      pv[0].set(x0, y0, pack_2i16_norm(s0, t0), color);
+      pv[1].set(x1, y0, pack_2i16_norm(s1, t0), color);
+      pv[2].set(x0, y1, pack_2i16_norm(s0, t1), color);
+      pv[3].set(x1, y1, pack_2i16_norm(s1, t1), color);
+    }
+    else // not rendered yet, or blank
+      for (int k = 0; k < QUAD_VERTICES; ++k)
+        pv[k].set(0.f, 0.f, Packed2i16{}, Packed4u8{});
+
+    pv += QUAD_VERTICES;
   }
-  // Remove the padding overshoot before adding alignment.
-  img_height = Math::align(img_height - PADDING, TILE_HEIGHT);
-  img_width  = Math::align(img_width, TILE_WIDTH);
-
-  // Create a Cairo surface for the texture image. Note that the image will be
-  // upside-down from the point of view of OpenGL, thus the texture coordinates
-  // need to be adjusted accordingly.
-  const auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_A8,
-                                                   img_width, img_height);
+  // Collapse the unused remainder of the slot to degenerate triangles.
+  for (unsigned int i = count; i < item.quad_slots; ++i)
   {
-    const auto cairo = Cairo::Context::create(surface);
-    cairo->set_operator(Cairo::OPERATOR_SOURCE);
+    for (int k = 0; k < QUAD_VERTICES; ++k)
+      pv[k].set(0.f, 0.f, Packed2i16{}, Packed4u8{});
 
-    for (std::size_t i = 0; i < layouts.size(); ++i)
-      if (const auto& layout = layouts[i])
-      {
-        const TextLayout& item = items_[i];
+    pv += QUAD_VERTICES;
+  }
+}
+
+/*
+ * Extend the atlas rectangle pending upload to include the given area.
+ */
+void TextLayoutAtlas::mark_dirty(int x, int y, int width, int height)
+{
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (dirty_left_ < dirty_right_ && dirty_top_ < dirty_bottom_)
+  {
+    dirty_left_   = std::min(dirty_left_,   x);
+    dirty_top_    = std::min(dirty_top_,    y);
+    dirty_right_  = std::max(dirty_right_,  x + width);
+    dirty_bottom_ = std::max(dirty_bottom_, y + height);
+  }
+  else
+  {
+    dirty_left_   = x;
+    dirty_top_    = y;
+    dirty_right_  = x + width;
+    dirty_bottom_ = y + height;
+  }
+}
+
+/*
+ * Drop all cached glyphs and start over with an empty atlas image.
+ * Text layouts referring to the old glyph images must be redone.
+ */
+void TextLayoutAtlas::reset_atlas()
+{
+  glyph_cache_.clear();
+  shelves_.clear();
+
+  atlas_height_ = ATLAS_MIN_HEIGHT;
+  atlas_image_.assign(std::size_t{ATLAS_WIDTH} * atlas_height_, 0);
 
-        cairo->move_to(item.surface_x, item.tex_y + item.surface_y);
-        layout->show_in_cairo_context(cairo);
+  mark_dirty(0, 0, ATLAS_WIDTH, atlas_height_);
+}
+
+/*
+ * Find room for a glyph image in the atlas, using the shelf with the
+ * least wasted height that still has enough horizontal space left.
+ * Opens a new shelf, or doubles the atlas height, if none fits.
+ */
+bool TextLayoutAtlas::place_glyph(int width, int height, int& x, int& y)
+{
+  AtlasShelf* best = nullptr;
+
+  for (AtlasShelf& shelf : shelves_)
+    if (height <= shelf.height && shelf.fill + width <= ATLAS_WIDTH
+        && (!best || shelf.height < best->height))
+      best = &shelf;
+
+  // Avoid parking small glyphs on much taller shelves.
+  if (!best || best->height > height + height / 2)
+  {
+    const int top = (shelves_.empty()) ? 0
+                    : shelves_.back().y + shelves_.back().height + PADDING;
+    const int shelf_height = Math::align(height, 4);
+
+    int atlas_height = atlas_height_;
+    while (top + shelf_height > atlas_height && atlas_height < ATLAS_MAX_HEIGHT)
+      atlas_height *= 2;
+
+    if (top + shelf_height <= atlas_height && width <= ATLAS_WIDTH)
+    {
+      if (atlas_height != atlas_height_)
+      {
+        atlas_height_ = atlas_height;
+        atlas_image_.resize(std::size_t{ATLAS_WIDTH} * atlas_height_, 0);
       }
+      shelves_.push_back({top, shelf_height, 0});
+      best = &shelves_.back();
+    }
+    else if (!best)
+      return false;
   }
-  surface->flush();
+  x = best->fill;
+  y = best->y;
+  best->fill += width + PADDING;
 
-  glActiveTexture(GL_TEXTURE0 + SAMPLER_LAYOUT);
+  return true;
+}
 
-  g_return_if_fail(tex_name_);
-  glBindTexture(GL_TEXTURE_2D, tex_name_);
+/*
+ * Copy a rendered glyph image into the atlas. Returns false if the
+ * atlas is out of space.
+ */
+bool TextLayoutAtlas::store_glyph(const GlyphImage& image, AtlasGlyph& glyph)
+{
+  glyph.ink_x  = image.ink_x;
+  glyph.ink_y  = image.ink_y;
+  glyph.width  = image.width;
+  glyph.height = image.height;
+  glyph.ready  = true;
 
-  if (tex_width_ != img_width || tex_height_ != img_height)
+  if (image.width <= 0 || image.height <= 0)
   {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, img_width, img_height,
-                 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
-    tex_width_  = img_width;
-    tex_height_ = img_height;
+    glyph.width = 0;
+    return true;
   }
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img_width, img_height,
-                  GL_RED, GL_UNSIGNED_BYTE, surface->get_data());
+  g_return_val_if_fail(image.pixels.size() == std::size_t(image.width) * image.height, true);
+
+  if (!place_glyph(image.width, image.height, glyph.tex_x, glyph.tex_y))
+    return false;
+
+  for (int row = 0; row < image.height; ++row)
+    std::copy_n(&image.pixels[std::size_t(image.width) * row], image.width,
+                &atlas_image_[std::size_t{ATLAS_WIDTH} * (glyph.tex_y + row) + glyph.tex_x]);
+
+  mark_dirty(glyph.tex_x, glyph.tex_y, glyph.width, glyph.height);
 
-  need_repaint_ = false;
+  return true;
 }
 
-void TextLayoutAtlas::gl_update_vertices(int view_width, int view_height)
+/*
+ * Look up a glyph in the atlas. On first use, an entry is created in
+ * pending state and the glyph is queued for rendering in the background.
+ */
+const AtlasGlyph* TextLayoutAtlas::lookup_glyph(const std::string& face, PangoGlyph glyph)
 {
-  draw_count_ = 0;
+  GlyphKey key {face, glyph};
+  auto pos = glyph_cache_.find(key);
 
-  const std::size_t count = std::count_if(cbegin(items_), cend(items_),
-                                          [](const TextLayout& t) { return t.valid(); });
-  if (count == 0)
+  if (pos == glyph_cache_.end())
   {
-    need_repos_ = false;
-    return;
+    requests_.push_back({face, glyph});
+    pos = glyph_cache_.emplace(std::move(key), AtlasGlyph{}).first;
   }
-  g_return_if_fail(tex_width_ > 0 && tex_height_ > 0);
+  return &pos->second;
+}
 
-  g_return_if_fail(buffers_[VERTICES]);
-  glBindBuffer(GL_ARRAY_BUFFER, buffers_[VERTICES]);
+/*
+ * Shape the text of a layout item and translate the resulting glyph runs
+ * into quads referring to glyph images in the atlas. The glyph images are
+ * rendered at a fixed reference size, so the quads carry the scale from
+ * reference size to the font size at the current resolution.
+ */
+void TextLayoutAtlas::layout_item(TextLayout& item)
+{
+  item.glyphs.clear();
+  item.repos  = true;
+  need_repos_ = true;
+
+  if (item.content.empty())
+    return;
+
+  const auto layout = Pango::Layout::create(context_);
+  layout->set_text(item.content);
+
+  const Pango::Rectangle logical = layout->get_logical_extents();
+  const int log_left   = logical.get_x();
+  const int log_bottom = logical.get_y() + logical.get_height();
 
-  const bool ok = access_mapped_buffer(GL_ARRAY_BUFFER, 0,
-                                       count * ITEM_VERTICES * sizeof(LayoutVertex),
-                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT,
-                                       [=](volatile void* data)
+  // Expand the logical rectangle to account for the shadow offset.
+  item.log_width  = PANGO_PIXELS(logical.get_width())  + 1;
+  item.log_height = PANGO_PIXELS(logical.get_height()) + 1;
+
+  const double resolution = pango_cairo_context_get_resolution(context_->gobj());
+  const float  unit = 1.f / PANGO_SCALE;
+
+  PangoLayoutIter *const iter = pango_layout_get_iter(layout->gobj());
+  do
   {
-    const float scale_s = 0.5f / tex_width_;
-    const float scale_t = 0.5f / tex_height_;
-    const float scale_x = 1.f / view_width;
-    const float scale_y = 1.f / view_height;
+    PangoLayoutRun *const run = pango_layout_iter_get_run_readonly(iter);
+    if (!run)
+      continue; // end of line
 
-    // Shift coordinates to center of 2x2 block for texture gather.
-    const int shadow_offset = (GL::extensions().texture_gather) ? -1 : -2;
+    PangoRectangle run_rect;
+    pango_layout_iter_get_run_extents(iter, nullptr, &run_rect);
 
-    // Shift coordinates into normalized [-1, 1] range (reversed in shader).
-    const int s_offset = shadow_offset - tex_width_;
-    const int t_offset = shadow_offset - tex_height_;
+    // Identify the font by its description without size, and work out
+    // the pixel size of the font at the current resolution.
+    PangoFontDescription *const desc = pango_font_describe(run->item->analysis.font);
 
-    auto* pv = static_cast<volatile LayoutVertex*>(data);
+    float font_size = unit * pango_font_description_get_size(desc);
+    if (!pango_font_description_get_size_is_absolute(desc))
+      font_size *= resolution / 72.;
 
-    for (const TextLayout& item : items_)
-    {
-      if (!item.valid())
-        continue;
+    pango_font_description_unset_fields(desc, PANGO_FONT_MASK_SIZE);
 
-      const int width  = item.ink_width  + 1;
-      const int height = item.ink_height + 1;
+    char *const face = pango_font_description_to_string(desc);
+    const std::string face_name {face};
+    g_free(face);
+    pango_font_description_free(desc);
 
-      const float s0 = scale_s * (s_offset);
-      const float s1 = scale_s * (s_offset + 2 * width);
-      const float t0 = scale_t * (2 * item.tex_y + t_offset + 2 * height);
-      const float t1 = scale_t * (2 * item.tex_y + t_offset);
+    const float scale = font_size / GlyphRenderer::EM_SIZE;
+    const int baseline = pango_layout_iter_get_baseline(iter);
+    int pen_x = run_rect.x;
 
-      const int view_x = 2 * (item.origin_x() + item.ink_x) - view_width;
-      const int view_y = 2 * (item.origin_y() + item.ink_y) - view_height;
+    for (int i = 0; i < run->glyphs->num_glyphs; ++i)
+    {
+      const PangoGlyphInfo& info = run->glyphs->glyphs[i];
 
-      const float x0 = scale_x * (view_x);
-      const float x1 = scale_x * (view_x + 2 * width);
-      const float y0 = scale_y * (view_y);
-      const float y1 = scale_y * (view_y + 2 * height);
+      if (info.glyph != PANGO_GLYPH_EMPTY)
+      {
+        TextGlyph quad;
+        quad.image = lookup_glyph(face_name, info.glyph);
+        quad.x     = unit * (pen_x + info.geometry.x_offset - log_left);
+        quad.y     = unit * (log_bottom - baseline - info.geometry.y_offset);
+        quad.scale = scale;
 
-      const auto color = item.color;
+        item.glyphs.push_back(quad);
+      }
+      pen_x += info.geometry.width;
+    }
+  }
+  while (pango_layout_iter_next_run(iter));
 
-      pv[0].set(x0, y0, pack_2i16_norm(s0, t0), color);
-      pv[1].set(x1, y0, pack_2i16_norm(s1, t0), color);
-      pv[2].set(x0, y1, pack_2i16_norm(s0, t1), color);
-      pv[3].set(x1, y1, pack_2i16_norm(s1, t1), color);
+  pango_layout_iter_free(iter);
+}
 
-      pv += ITEM_VERTICES;
+/*
+ * Shape all items whose text changed, and hand any glyphs not seen
+ * before to the background renderer.
+ */
+void TextLayoutAtlas::update_layouts()
+{
+  need_layout_ = false;
+
+  if (atlas_height_ == 0)
+    reset_atlas();
+
+  for (TextLayout& item : items_)
+    if (item.dirty)
+    {
+      item.dirty = false;
+      layout_item(item);
     }
-  });
 
-  if (ok)
+  start_renderer();
+}
+
+void TextLayoutAtlas::start_renderer()
+{
+  if (requests_.empty() || (renderer_ && renderer_->running()))
+    return;
+
+  if (!renderer_)
   {
-    draw_count_ = count;
-    need_repos_ = false;
+    renderer_ = std::make_unique<GlyphRenderer>();
+    renderer_->signal_done().connect(sigc::mem_fun(*this, &TextLayoutAtlas::on_glyphs_rendered));
   }
+  renderer_->set_requests(std::move(requests_));
+  requests_.clear();
+
+  renderer_->run();
 }
 
-Glib::RefPtr<Pango::Layout> TextLayoutAtlas::create_pango_layout(TextLayout& item)
+/*
+ * Place freshly rendered glyphs into the atlas. If the atlas fills up, it
+ * is cleared once and repopulated with just the glyphs currently in use.
+ */
+void TextLayoutAtlas::on_glyphs_rendered()
 {
-  if (item.content.empty())
-    return {};
+  std::vector<GlyphImage> images;
+  try
+  {
+    images = renderer_->acquire_results();
+  }
+  catch (const std::exception& error)
+  {
+    g_warning("Glyph rendering failed: %s", error.what());
+  }
+  bool overflow = false;
 
-  auto layout = Pango::Layout::create(context_);
-  layout->set_text(item.content);
+  for (const GlyphImage& image : images)
+  {
+    // Skip results made obsolete by clearing the atlas meanwhile.
+    const auto pos = glyph_cache_.find({image.face, image.glyph});
 
-  Pango::Rectangle ink, logical;
-  // Measure ink extents to determine the dimensions of the image, but
-  // keep the logical extents and the ink offsets around for positioning.
-  layout->get_pixel_extents(ink, logical);
+    if (pos == glyph_cache_.end() || pos->second.ready)
+      continue;
 
-  // Make sure the extents are within reasonable boundaries.
-  g_return_val_if_fail(ink.get_width() < 4095 && ink.get_height() < 4095, layout);
+    if (!store_glyph(image, pos->second))
+    {
+      pos->second.width = 0; // drop the image
+      overflow = true;
+    }
+  }
+  if (overflow && !overflowed_)
+  {
+    // Start over, so that glyphs no longer in use are evicted.
+    reset_atlas();
+    requests_.clear();
 
-  item.surface_x = MARGIN - ink.get_x();
-  item.surface_y = MARGIN - ink.get_y();
+    for (TextLayout& item : items_)
+    {
+      item.glyphs.clear();
+      item.dirty = !item.content.empty();
+    }
+    need_layout_ = true;
+  }
+  else if (overflow)
+    g_warning("Text layout glyphs exceed atlas capacity");
 
-  const int ink_x = ink.get_x() - logical.get_x() - MARGIN;
-  const int ink_y = logical.get_y() + logical.get_height()
-                  - ink.get_y() - ink.get_height() - MARGIN;
+  overflowed_ = overflow;
 
-  const int ink_width  = std::max(0, ink.get_width())  + 2 * MARGIN;
-  const int ink_height = std::max(0, ink.get_height()) + 2 * MARGIN;
+  for (TextLayout& item : items_)
+    item.repos = true;
 
-  // Expand the logical rectangle to account for the shadow offset.
-  const int log_width  = logical.get_width()  + 1;
-  const int log_height = logical.get_height() + 1;
+  need_repos_ = true;
 
-  // Compare to previous dimensions to minimize vertex buffer updates.
-  if ((ink_x ^ item.ink_x) | (ink_y ^ item.ink_y)
-      | (ink_width ^ item.ink_width) | (ink_height ^ item.ink_height)
-      | (log_width ^ item.log_width) | (log_height ^ item.log_height))
-  {
-    item.ink_x = ink_x;
-    item.ink_y = ink_y;
-    item.ink_width  = ink_width;
-    item.ink_height = ink_height;
-    item.log_width  = log_width;
-    item.log_height = log_height;
+  start_renderer();
 
-    need_repos_ = true;
-  }
-  return std::move(layout);
+  signal_glyphs_ready_(); // emit
 }
 
 } // namespace GL
@@ -22,16 +22,47 @@
 
 #include "glshader.h"
 #include "glutils.h"
+#include "glyphrenderer.h"
 
+#include <sigc++/sigc++.h>
 #include <glibmm/ustring.h>
 #include <pangomm/context.h>
 #include <pangomm/layout.h>
 
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace GL
 {
 
+/* Distance field image of a glyph in the atlas texture, in pixels
+ * of the reference size it was rendered at.
+ */
+struct AtlasGlyph
+{
+  int  ink_x  = 0;     // x offset from glyph origin to image
+  int  ink_y  = 0;     // y offset from baseline to image top
+  int  tex_x  = 0;     // horizontal position in atlas texture
+  int  tex_y  = 0;     // vertical position in atlas texture
+  int  width  = 0;     // width of image, 0 if blank
+  int  height = 0;     // height of image
+  bool ready  = false; // image has been rendered and placed
+};
+
+/* Quad of a single glyph within a text layout, referencing the
+ * glyph image in the atlas texture.
+ */
+struct TextGlyph
+{
+  const AtlasGlyph* image = nullptr; // glyph image in the atlas
+  float             x     = 0.f;     // x offset from logical origin to glyph origin
+  float             y     = 0.f;     // y offset from logical origin to baseline
+  float             scale = 1.f;     // display size relative to reference size
+};
+
 struct TextLayout
 {
   enum Anchor : unsigned int { BOTTOM_LEFT, TOP_LEFT, BOTTOM_RIGHT, TOP_RIGHT };
@@ -43,23 +74,23 @@ struct TextLayout
   int    pos_x  = 0;           // logical x position within viewport window
   int    pos_y  = 0;           // logical y position within viewport window
 
-  int surface_x  = 0; // x position on Cairo surface
-  int surface_y  = 0; // y position on Cairo surface sub-image
+  std::vector<TextGlyph> glyphs; // glyph quads in visual order
 
-  int ink_x      = 0; // x offset from logical origin to ink origin
-  int ink_y      = 0; // y offset from logical origin to ink origin
-  int ink_width  = 0; // width of ink rectangle
-  int ink_height = 0; // height of ink rectangle
+  int  log_width  = 0;     // logical width of layout
+  int  log_height = 0;     // logical height of layout
 
-  int log_width  = 0; // logical width of layout
-  int log_height = 0; // logical height of layout
+  unsigned int quad_first = 0; // first quad of slot in vertex buffer
+  unsigned int quad_slots = 0; // number of quads reserved for layout
+  unsigned int packed     = 0; // glyph count at time of slot assignment
+  unsigned int stale      = 0; // mask of stream segments lacking vertices
 
-  int tex_y      = 0; // vertical offset in atlas texture
+  bool dirty      = false; // layout needs to be shaped again
+  bool repos      = false; // vertices need to be regenerated
 
   int origin_x() const { return pos_x - ((anchor & BOTTOM_RIGHT) ? log_width  : 0); }
   int origin_y() const { return pos_y - ((anchor & TOP_LEFT)     ? log_height : 0); }
 
-  bool valid() const { return (ink_height > 0); }
+  bool valid() const { return !glyphs.empty(); }
 };
 
 class TextLayoutAtlas
@@ -69,6 +100,7 @@ public:
   ~TextLayoutAtlas();
 
   void set_layout_count(unsigned int count);
+  unsigned int get_layout_count() const { return items_.size(); }
   void set_layout_text(unsigned int idx, Glib::ustring text);
   void set_layout_color(unsigned int idx, Packed4u8 color);
   void set_layout_pos(unsigned int idx, TextLayout::Anchor anchor, int x, int y);
@@ -77,7 +109,11 @@ public:
   void unset_pango_context();
   bool has_pango_context() const { return !!context_; }
 
-  bool update_needed() const { return (need_repaint_ || need_repos_); }
+  // Emitted when glyphs rendered in the background become available.
+  sigc::signal<void>& signal_glyphs_ready() { return signal_glyphs_ready_; }
+
+  bool update_needed() const
+    { return (need_layout_ || need_repos_ || dirty_top_ < dirty_bottom_); }
   bool is_drawable() const { return (draw_count_ > 0 && vao_ && shader_); }
 
   void gl_init();
@@ -86,20 +122,51 @@ public:
   int  gl_draw_layouts(bool has_focus);
 
 private:
+  using GlyphKey = std::pair<std::string, PangoGlyph>;
+
+  /* Horizontal strip of the atlas holding glyph images of similar height.
+   */
+  struct AtlasShelf
+  {
+    int y;      // top row of the shelf
+    int height; // height of the shelf
+    int fill;   // horizontal space used up so far
+  };
+
   void gl_create_shader();
   void gl_create_texture();
   void gl_create_array();
-  void gl_create_indices();
+  void gl_set_vertex_format();
+  void gl_reserve_quads(unsigned int count);
+  void gl_stream_vertices();
+  void gl_delete_fences();
 
   void gl_update_texture();
   void gl_update_vertices(int view_width, int view_height);
-
-  Glib::RefPtr<Pango::Layout> create_pango_layout(TextLayout& item);
+  void write_vertices(const TextLayout& item, volatile void* data) const;
+
+  void mark_dirty(int x, int y, int width, int height);
+  void reset_atlas();
+  bool place_glyph(int width, int height, int& x, int& y);
+  bool store_glyph(const GlyphImage& image, AtlasGlyph& glyph);
+  const AtlasGlyph* lookup_glyph(const std::string& face, PangoGlyph glyph);
+  void layout_item(TextLayout& item);
+  void update_layouts();
+  void start_renderer();
+  void on_glyphs_rendered();
 
   std::vector<TextLayout>       items_;   // list of text layout items
   Glib::RefPtr<Pango::Context>  context_; // Pango context for text layout
   GL::ShaderProgram             shader_;  // text layout shader program object
 
+  std::map<GlyphKey, AtlasGlyph>  glyph_cache_; // glyphs present or pending
+  std::vector<AtlasShelf>         shelves_;     // atlas shelves from top to bottom
+  std::vector<unsigned char>      atlas_image_; // CPU copy of the atlas texels
+  std::vector<unsigned char>      staging_;     // CPU copy of streamed vertices
+  std::vector<GlyphRequest>       requests_;    // glyphs waiting to be rendered
+  std::unique_ptr<GlyphRenderer>  renderer_;    // background glyph renderer
+  sigc::signal<void>              signal_glyphs_ready_;
+
   int          uf_texture_    = -1;       // texture sampler uniform ID
   int          uf_intensity_  = -1;       // text intensity uniform ID
 
@@ -108,11 +175,26 @@ private:
   unsigned int tex_name_      = 0;        // texture ID
   int          tex_width_     = 0;        // layout texture width
   int          tex_height_    = 0;        // layout texture height
-  unsigned int draw_count_    = 0;        // number of items ready for drawing
-
-  bool         need_repaint_  = false;    // texture needs to be repainted
+  int          atlas_height_  = 0;        // height of the atlas image
+  int          dirty_left_    = 0;        // dirty atlas rectangle to upload
+  int          dirty_top_     = 0;
+  int          dirty_right_   = 0;
+  int          dirty_bottom_  = 0;
+  int          view_width_    = 0;        // viewport width of current vertices
+  int          view_height_   = 0;        // viewport height of current vertices
+  unsigned int quad_capacity_ = 0;        // glyph quads the buffers can hold
+  unsigned int draw_count_    = 0;        // number of glyph quads to draw
+  void*        stream_data_   = nullptr;  // persistently mapped vertex storage
+  GLsync       fences_[3]     = {};       // fences guarding stream segments
+  unsigned int segment_       = 0;        // stream segment currently drawn from
+  int          base_vertex_   = 0;        // first vertex of current segment
+
+  bool         need_layout_   = false;    // some items need to be shaped
   bool         need_repos_    = false;    // vertices need to be regenerated
+  bool         need_repack_   = false;    // vertex slots need to be reassigned
+  bool         stream_        = false;    // stream vertices via persistent mapping
   bool         had_focus_     = true;     // last remembered focus state
+  bool         overflowed_    = false;    // atlas was cleared for lack of space
 };
 
 } // namespace GL
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "gltexture.h"
+#include "glutils.h"
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+#ifdef SOMATO_HAVE_ZSTD
+# include <zstd.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <epoxy/gl.h>
+
+namespace
+{
+
+const guint8 ktx1_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+const guint8 ktx2_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+enum
+{
+  KTX1_HEADER_SIZE = 64,
+  KTX2_HEADER_SIZE = 80, // including the data format and key/value index
+  KTX2_LEVEL_SIZE  = 24
+};
+
+enum KTX2Supercompression
+{
+  SUPERCOMPRESSION_NONE = 0,
+  SUPERCOMPRESSION_ZSTD = 2
+};
+
+inline guint32 read_le32(const guint8* data)
+{
+  guint32 value;
+  std::memcpy(&value, data, sizeof value);
+  return GUINT32_FROM_LE(value);
+}
+
+inline guint64 read_le64(const guint8* data)
+{
+  guint64 value;
+  std::memcpy(&value, data, sizeof value);
+  return GUINT64_FROM_LE(value);
+}
+
+/*
+ * Map the Vulkan block compression formats which KTX2 files may hold
+ * to GL internal formats, or return 0 if not supported.
+ */
+unsigned int format_from_vk_format(guint32 vk_format)
+{
+  switch (vk_format)
+  {
+    case 131: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;        // BC1_RGB_UNORM
+    case 132: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;       // BC1_RGB_SRGB
+    case 133: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;       // BC1_RGBA_UNORM
+    case 134: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; // BC1_RGBA_SRGB
+    case 135: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;       // BC2_UNORM
+    case 136: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; // BC2_SRGB
+    case 137: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;       // BC3_UNORM
+    case 138: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; // BC3_SRGB
+    case 139: return GL_COMPRESSED_RED_RGTC1;                // BC4_UNORM
+    case 140: return GL_COMPRESSED_SIGNED_RED_RGTC1;         // BC4_SNORM
+    case 141: return GL_COMPRESSED_RG_RGTC2;                 // BC5_UNORM
+    case 142: return GL_COMPRESSED_SIGNED_RG_RGTC2;          // BC5_SNORM
+    case 147: return GL_COMPRESSED_RGB8_ETC2;                // ETC2_R8G8B8_UNORM
+    case 148: return GL_COMPRESSED_SRGB8_ETC2;               // ETC2_R8G8B8_SRGB
+    case 149: return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+    case 150: return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+    case 151: return GL_COMPRESSED_RGBA8_ETC2_EAC;           // ETC2_R8G8B8A8_UNORM
+    case 152: return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;    // ETC2_R8G8B8A8_SRGB
+    case 153: return GL_COMPRESSED_R11_EAC;                  // EAC_R11_UNORM
+    case 154: return GL_COMPRESSED_SIGNED_R11_EAC;           // EAC_R11_SNORM
+    case 155: return GL_COMPRESSED_RG11_EAC;                 // EAC_R11G11_UNORM
+    case 156: return GL_COMPRESSED_SIGNED_RG11_EAC;          // EAC_R11G11_SNORM
+  }
+  return 0;
+}
+
+void set_level_size(GL::TextureLevel& level, unsigned int base_width,
+                    unsigned int base_height, unsigned int index)
+{
+  level.width  = std::max(1u, base_width  >> index);
+  level.height = std::max(1u, base_height >> index);
+}
+
+GL::CompressedImage parse_ktx1(const Glib::RefPtr<const Glib::Bytes>& file,
+                               const guint8* data, gsize size)
+{
+  if (size < KTX1_HEADER_SIZE || read_le32(data + 12) != 0x04030201)
+    throw GL::ImageError{"Unsupported KTX file header"};
+
+  // A compressed format has neither type nor format, and a type size of 1.
+  if (read_le32(data + 16) != 0 || read_le32(data + 20) != 1 || read_le32(data + 24) != 0)
+    throw GL::ImageError{"KTX texture image is not compressed"};
+
+  const unsigned int base_width  = read_le32(data + 36);
+  const unsigned int base_height = read_le32(data + 40);
+  const unsigned int num_mipmaps = read_le32(data + 56);
+
+  if (base_width == 0 || base_height == 0 || num_mipmaps == 0 || num_mipmaps > 32
+      || read_le32(data + 44) != 0 || read_le32(data + 48) != 0 || read_le32(data + 52) != 1)
+    throw GL::ImageError{"KTX texture is not a 2D image with mipmaps"};
+
+  GL::CompressedImage image;
+  image.data   = file;
+  image.format = read_le32(data + 28);
+  image.levels.resize(num_mipmaps);
+
+  gsize offset = KTX1_HEADER_SIZE + gsize{read_le32(data + 60)};
+
+  for (unsigned int i = 0; i < num_mipmaps; ++i)
+  {
+    if (offset > size || size - offset < 4)
+      throw GL::ImageError{"Truncated KTX texture image"};
+
+    const gsize level_size = read_le32(data + offset);
+    offset += 4;
+
+    if (level_size > size - offset)
+      throw GL::ImageError{"Truncated KTX texture image"};
+
+    auto& level = image.levels[i];
+    set_level_size(level, base_width, base_height, i);
+    level.offset = offset;
+    level.size   = level_size;
+
+    offset += (level_size + 3) & ~gsize{3}; // mip padding
+  }
+  return image;
+}
+
+GL::CompressedImage parse_ktx2(const Glib::RefPtr<const Glib::Bytes>& file,
+                               const guint8* data, gsize size)
+{
+  if (size < KTX2_HEADER_SIZE)
+    throw GL::ImageError{"Unsupported KTX2 file header"};
+
+  const unsigned int format      = format_from_vk_format(read_le32(data + 12));
+  const unsigned int base_width  = read_le32(data + 20);
+  const unsigned int base_height = read_le32(data + 24);
+  const unsigned int num_levels  = read_le32(data + 40);
+  const guint32      scheme      = read_le32(data + 44);
+
+  if (format == 0)
+    throw GL::ImageError{"Unsupported KTX2 texture format"};
+
+  if (base_width == 0 || base_height == 0 || num_levels == 0 || num_levels > 32
+      || read_le32(data + 28) != 0 || read_le32(data + 32) != 0 || read_le32(data + 36) != 1)
+    throw GL::ImageError{"KTX2 texture is not a 2D image with mipmaps"};
+
+  if (scheme != SUPERCOMPRESSION_NONE && scheme != SUPERCOMPRESSION_ZSTD)
+    throw GL::ImageError{Glib::ustring::compose("Unsupported KTX2 supercompression scheme %1",
+                                                scheme)};
+#ifndef SOMATO_HAVE_ZSTD
+  if (scheme == SUPERCOMPRESSION_ZSTD)
+    throw GL::ImageError{"KTX2 zstd supercompression not supported by this build"};
+#endif
+  if ((size - KTX2_HEADER_SIZE) / KTX2_LEVEL_SIZE < num_levels)
+    throw GL::ImageError{"Truncated KTX2 level index"};
+
+  GL::CompressedImage image;
+  image.format = format;
+  image.levels.resize(num_levels);
+
+  gsize decoded_size = 0;
+
+  for (unsigned int i = 0; i < num_levels; ++i)
+  {
+    const guint8 *const entry = data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_SIZE;
+
+    const guint64 offset      = read_le64(entry);
+    const guint64 length      = read_le64(entry + 8);
+    const guint64 full_length = read_le64(entry + 16);
+
+    if (offset > size || length > size - offset || full_length > G_MAXUINT32
+        || (scheme == SUPERCOMPRESSION_NONE && full_length != length))
+      throw GL::ImageError{Glib::ustring::compose("Invalid KTX2 mipmap level %1", i)};
+
+    auto& level = image.levels[i];
+    set_level_size(level, base_width, base_height, i);
+    level.offset = offset;
+    level.size   = length;
+
+    decoded_size += full_length;
+  }
+  if (scheme == SUPERCOMPRESSION_NONE)
+  {
+    image.data = file;
+    return image;
+  }
+#ifdef SOMATO_HAVE_ZSTD
+  // Decompress all levels into a single buffer, in the same order.
+  std::unique_ptr<guint8, decltype(&g_free)>
+    decoded {static_cast<guint8*>(g_malloc(decoded_size)), &g_free};
+  gsize decoded_offset = 0;
+
+  for (unsigned int i = 0; i < num_levels; ++i)
+  {
+    auto& level = image.levels[i];
+    const guint64 full_length = read_le64(data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_SIZE + 16);
+
+    const std::size_t result = ZSTD_decompress(decoded.get() + decoded_offset, full_length,
+                                               data + level.offset, level.size);
+    if (ZSTD_isError(result) || result != full_length)
+      throw GL::ImageError{Glib::ustring::compose("Failed to decompress KTX2 mipmap level %1", i)};
+
+    level.offset = decoded_offset;
+    level.size   = full_length;
+
+    decoded_offset += full_length;
+  }
+  image.data = Glib::wrap(g_bytes_new_take(decoded.release(), decoded_size));
+#endif
+  return image;
+}
+
+} // anonymous namespace
+
+GL::CompressedImage GL::parse_ktx_image(const Glib::RefPtr<const Glib::Bytes>& file)
+{
+  gsize size = 0;
+  const auto *const data = static_cast<const guint8*>(file->get_data(size));
+
+  if (size >= sizeof ktx1_identifier
+      && std::memcmp(data, ktx1_identifier, sizeof ktx1_identifier) == 0)
+    return parse_ktx1(file, data, size);
+
+  if (size >= sizeof ktx2_identifier
+      && std::memcmp(data, ktx2_identifier, sizeof ktx2_identifier) == 0)
+    return parse_ktx2(file, data, size);
+
+  throw GL::ImageError{"Unknown texture file format"};
+}
+
+GL::TextureUpload::TextureUpload(CompressedImage image, unsigned int texture)
+:
+  image_      {std::move(image)},
+  texture_    {texture},
+  next_level_ {static_cast<int>(image_.levels.size()) - 1}
+{}
+
+bool GL::TextureUpload::gl_upload_step(std::size_t budget)
+{
+  g_return_val_if_fail(!done(), true);
+
+  glBindTexture(GL_TEXTURE_2D, texture_);
+
+  if (!pixel_buffer_)
+  {
+    glGenBuffers(1, &pixel_buffer_);
+    GL::Error::throw_if_fail(pixel_buffer_ != 0);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_);
+    GL::set_object_label(GL_BUFFER, pixel_buffer_, "TextureUpload");
+
+    std::size_t total_size = 0;
+
+    for (const auto& level : image_.levels)
+      total_size += level.size;
+
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image_.levels.size() - 1);
+  }
+  else
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_);
+
+  // Gather the levels of this step, from coarse to fine.
+  const int first = next_level_;
+  int last = first;
+  std::size_t batch_size = image_.levels[first].size;
+
+  while (last > 0 && batch_size + image_.levels[last - 1].size <= budget)
+    batch_size += image_.levels[--last].size;
+
+  gsize data_size = 0;
+  const auto *const data = static_cast<const guint8*>(image_.data->get_data(data_size));
+
+  // Each range of the staging buffer is written only once, so there
+  // is no need to synchronize with pending uploads.
+  const bool staged = GL::access_mapped_buffer(
+      GL_PIXEL_UNPACK_BUFFER, staged_size_, batch_size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT,
+      [this, data, first, last](void* dest)
+      {
+        auto *const pos = static_cast<guint8*>(dest);
+        std::size_t offset = 0;
+
+        for (int i = first; i >= last; --i)
+        {
+          const auto& level = image_.levels[i];
+          std::memcpy(pos + offset, data + level.offset, level.size);
+          offset += level.size;
+        }
+      });
+  if (!staged)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  for (int i = first; i >= last; --i)
+  {
+    const auto& level = image_.levels[i];
+
+    glCompressedTexImage2D(GL_TEXTURE_2D, i, image_.format, level.width, level.height, 0,
+                           level.size, (staged) ? GL::buffer_offset(staged_size_)
+                                                : data + level.offset);
+    staged_size_ += level.size;
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, last);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  next_level_ = last - 1;
+
+  if (done())
+  {
+    gl_delete();
+    image_.data.reset();
+  }
+  return done();
+}
+
+void GL::TextureUpload::gl_delete()
+{
+  if (pixel_buffer_)
+  {
+    glDeleteBuffers(1, &pixel_buffer_);
+    pixel_buffer_ = 0;
+  }
+}
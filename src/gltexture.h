@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_GLTEXTURE_H_INCLUDED
+#define SOMATO_GLTEXTURE_H_INCLUDED
+
+#include <glibmm/bytes.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace GL
+{
+
+/* Location and dimensions of a mipmap level within the image data.
+ */
+struct TextureLevel
+{
+  unsigned int width  = 0;
+  unsigned int height = 0;
+  std::size_t  offset = 0;
+  std::size_t  size   = 0;
+};
+
+/* Compressed 2D texture image with a complete mipmap chain, base level
+ * first. The data may be a view of the original file contents.
+ */
+struct CompressedImage
+{
+  Glib::RefPtr<const Glib::Bytes> data;
+  std::vector<TextureLevel>       levels;
+  unsigned int                    format = 0; // GL internal format
+};
+
+/* Exception class for malformed or unsupported texture image files.
+ */
+class ImageError : public std::runtime_error
+{
+public:
+  explicit ImageError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/* Parse a compressed 2D texture image from a KTX or KTX2 file, and
+ * decompress zstd supercompressed KTX2 levels. This does not call into
+ * GL and is safe to use from any thread. Throws GL::ImageError on failure.
+ */
+CompressedImage parse_ktx_image(const Glib::RefPtr<const Glib::Bytes>& file);
+
+/*
+ * Progressive upload of a compressed texture image through a pixel
+ * buffer object. The mipmap levels are uploaded smallest first, and
+ * the base level of the texture is lowered as finer levels arrive, so
+ * that the texture is complete after the first step already.
+ */
+class TextureUpload
+{
+public:
+  TextureUpload(CompressedImage image, unsigned int texture);
+
+  TextureUpload(const TextureUpload& other) = delete;
+  TextureUpload& operator=(const TextureUpload& other) = delete;
+
+  // Upload mipmap levels, at least one, until the size exceeds the
+  // budget. Binds the texture to the active unit. Return whether done.
+  bool gl_upload_step(std::size_t budget);
+  bool done() const { return (next_level_ < 0); }
+
+  void gl_delete();
+
+private:
+  CompressedImage image_;
+  unsigned int    texture_;
+  unsigned int    pixel_buffer_ = 0;
+  std::size_t     staged_size_  = 0;
+  int             next_level_;
+};
+
+} // namespace GL
+
+#endif // !SOMATO_GLTEXTURE_H_INCLUDED
@@ -27,10 +27,31 @@
 namespace GL
 {
 
+enum Packed2i8  : unsigned short {};
 enum Packed2i16 : unsigned int {};
 enum Packed4u8  : unsigned int {};
 enum Int_2_10_10_10_rev : unsigned int {};
 
+inline Packed2i8 pack_2i8(int x, int y)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return static_cast<Packed2i8>((x & 0xFFu) | ((y & 0xFFu) << 8));
+#elif G_BYTE_ORDER == G_BIG_ENDIAN
+  return static_cast<Packed2i8>(((x & 0xFFu) << 8) | (y & 0xFFu));
+#endif
+}
+
+inline Packed2i8 pack_2i8_norm(float x, float y)
+{
+  const float scale = 127.f;
+  return pack_2i8(std::lrint(x * scale), std::lrint(y * scale));
+}
+
+inline Packed2i8 pack_2i8_norm(std::tuple<float, float> xy)
+{
+  return pack_2i8_norm(std::get<0>(xy), std::get<1>(xy));
+}
+
 inline Packed2i16 pack_2i16(int x, int y)
 {
 #if G_BYTE_ORDER == G_LITTLE_ENDIAN
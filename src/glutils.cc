@@ -117,9 +117,41 @@ void GL::Extensions::query_(bool use_es, int ver)
   debug_output = debug
       || epoxy_has_gl_extension("GL_ARB_debug_output");
 
+  buffer_storage = (!use_es && ver >= 44)
+      || epoxy_has_gl_extension("GL_ARB_buffer_storage")
+      || epoxy_has_gl_extension("GL_EXT_buffer_storage");
+
+  draw_base_vertex = (!use_es || ver >= 32)
+      || epoxy_has_gl_extension("GL_OES_draw_elements_base_vertex")
+      || epoxy_has_gl_extension("GL_EXT_draw_elements_base_vertex");
+
   geometry_shader = (!use_es || ver >= 32)
       || epoxy_has_gl_extension("GL_EXT_geometry_shader");
 
+  // Drawing with a base vertex is a prerequisite of multi-draw here,
+  // since the index data of the meshes is relative to the base vertex.
+  // No version of OpenGL ES has glMultiDrawElementsBaseVertex() in core;
+  // it is provided by the base vertex extensions only if multi-draw is
+  // supported as well.
+  multi_draw = !use_es
+      || (epoxy_has_gl_extension("GL_EXT_multi_draw_arrays")
+          && (epoxy_has_gl_extension("GL_OES_draw_elements_base_vertex")
+              || epoxy_has_gl_extension("GL_EXT_draw_elements_base_vertex")));
+
+  parallel_shader_compile = epoxy_has_gl_extension("GL_KHR_parallel_shader_compile")
+      || epoxy_has_gl_extension("GL_ARB_parallel_shader_compile");
+
+  program_binary = (ver >= ((use_es) ? 30 : 41))
+      || epoxy_has_gl_extension("GL_ARB_get_program_binary");
+
+  if (program_binary)
+  {
+    // Some drivers expose the entry points without supporting any format.
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    program_binary = (num_formats > 0);
+  }
+
   texture_border_clamp = (!use_es || ver >= 32)
       || epoxy_has_gl_extension("GL_EXT_texture_border_clamp");
 
@@ -192,45 +224,6 @@ bool GL::ScopedMapBuffer::unmap_checked(unsigned int target)
   return false;
 }
 
-void GL::tex_image_from_ktx(const guint32* ktx, unsigned int ktx_size)
-{
-  const unsigned int magic0 = GUINT32_TO_BE(0xAB4B5458);
-  const unsigned int magic1 = GUINT32_TO_BE(0x203131BB);
-  const unsigned int magic2 = GUINT32_TO_BE(0x0D0A1A0A);
-  const unsigned int little_endian = GUINT32_TO_LE(0x04030201);
-  const unsigned int le_1 = GUINT32_TO_LE(1);
-
-  g_return_if_fail(ktx_size > 16);
-  g_return_if_fail(ktx[0] == magic0 && ktx[1] == magic1 && ktx[2] == magic2);
-  g_return_if_fail(ktx[3] == little_endian);
-  g_return_if_fail(ktx[4] == 0 && ktx[5] == le_1 && ktx[6] == 0); // compressed?
-
-  const unsigned int int_format  = GUINT32_FROM_LE(ktx[7]);
-  const unsigned int base_width  = GUINT32_FROM_LE(ktx[9]);
-  const unsigned int base_height = GUINT32_FROM_LE(ktx[10]);
-  const unsigned int num_mipmaps = GUINT32_FROM_LE(ktx[14]);
-
-  g_return_if_fail(base_width > 0 && base_height > 0 && num_mipmaps > 0);
-  g_return_if_fail(ktx[11] == 0 && ktx[12] == 0 && ktx[13] == le_1); // 2D?
-
-  unsigned int offset = 16 + GUINT32_FROM_LE(ktx[15]) / 4;
-
-  for (unsigned int level = 0; level < num_mipmaps; ++level)
-  {
-    g_return_if_fail(offset < ktx_size);
-
-    const unsigned int width  = std::max(1u, base_width  >> level);
-    const unsigned int height = std::max(1u, base_height >> level);
-    const unsigned int size   = GUINT32_FROM_LE(ktx[offset]) / 4;
-    ++offset;
-    g_return_if_fail(offset + size <= ktx_size);
-
-    glCompressedTexImage2D(GL_TEXTURE_2D, level, int_format,
-                           width, height, 0, size * 4, &ktx[offset]);
-    offset += size;
-  }
-}
-
 void GL::set_object_label(GLenum identifier, GLuint name, const char* label)
 {
   if (extensions().debug)
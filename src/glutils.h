@@ -44,9 +44,14 @@ struct Extensions
 {
   int   version                    = 0;
   bool  is_gles                    = false;
+  bool  buffer_storage             = false;
   bool  debug                      = false;
   bool  debug_output               = false;
+  bool  draw_base_vertex           = false;
   bool  geometry_shader            = false;
+  bool  multi_draw                 = false;
+  bool  parallel_shader_compile    = false;
+  bool  program_binary             = false;
   bool  texture_border_clamp       = false;
   bool  texture_filter_anisotropic = false;
   bool  texture_gather             = false;
@@ -142,10 +147,6 @@ inline bool access_mapped_buffer(unsigned int target, std::size_t offset,
   return false;
 }
 
-/* Load a compressed 2D texture image from a KTX file memory buffer.
- */
-void tex_image_from_ktx(const guint32* ktx, unsigned int ktx_size);
-
 template <typename T> constexpr GLenum attrib_type_;
 
 template <> constexpr GLenum attrib_type_<GLbyte>     = GL_BYTE;
@@ -155,6 +156,7 @@ template <> constexpr GLenum attrib_type_<GLushort>   = GL_UNSIGNED_SHORT;
 template <> constexpr GLenum attrib_type_<GLint>      = GL_INT;
 template <> constexpr GLenum attrib_type_<GLuint>     = GL_UNSIGNED_INT;
 template <> constexpr GLenum attrib_type_<GLfloat>    = GL_FLOAT;
+template <> constexpr GLenum attrib_type_<Packed2i8>  = GL_BYTE;
 template <> constexpr GLenum attrib_type_<Packed2i16> = GL_SHORT;
 template <> constexpr GLenum attrib_type_<Packed4u8>  = GL_UNSIGNED_BYTE;
 template <> constexpr GLenum attrib_type_<Int_2_10_10_10_rev> = GL_INT_2_10_10_10_REV;
@@ -165,6 +167,7 @@ template <typename T> constexpr GLenum attrib_type =
 template <typename T>           constexpr int attrib_size_ = 1;
 template <typename T, size_t N> constexpr int attrib_size_<T[N]> = N;
 
+template <> constexpr int attrib_size_<Packed2i8>  = 2;
 template <> constexpr int attrib_size_<Packed2i16> = 2;
 template <> constexpr int attrib_size_<Packed4u8>  = 4;
 template <> constexpr int attrib_size_<Int_2_10_10_10_rev> = 4;
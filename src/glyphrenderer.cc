@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "glyphrenderer.h"
+
+#include <glib.h>
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+#include <pango/pangocairo.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <utility>
+
+namespace
+{
+
+/* Squared distance standing in for infinity, chosen to stay well clear
+ * of overflow when combined with squared texel offsets.
+ */
+const float far_distance = 1e10f;
+
+/* Release a GObject reference held by a standard smart pointer.
+ */
+struct ObjectUnref
+{
+  void operator()(void* obj) const { g_object_unref(obj); }
+};
+
+/*
+ * Compute the exact one-dimensional squared Euclidean distance transform
+ * of the sampled function f into d, following Felzenszwalb & Huttenlocher.
+ * The scratch arrays v and z must hold n and n + 1 elements, respectively.
+ */
+void distance_transform_1d(const float* f, float* d, int n, int* v, float* z)
+{
+  int k = 0;
+  v[0] = 0;
+  z[0] = -far_distance;
+  z[1] = far_distance;
+
+  for (int q = 1; q < n; ++q)
+  {
+    float s;
+    for (;;)
+    {
+      const int p = v[k];
+      s = ((f[q] + q * q) - (f[p] + p * p)) / (2 * (q - p));
+
+      if (k == 0 || s > z[k])
+        break;
+      --k;
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = far_distance;
+  }
+  k = 0;
+  for (int q = 0; q < n; ++q)
+  {
+    while (z[k + 1] < q)
+      ++k;
+
+    const int p = v[k];
+    d[q] = (q - p) * (q - p) + f[p];
+  }
+}
+
+/*
+ * Transform a grid of zero-or-infinity samples in place into squared
+ * distances to the nearest zero sample, separably along columns and rows.
+ */
+void distance_transform(std::vector<float>& grid, int width, int height)
+{
+  const int n = std::max(width, height);
+
+  std::vector<float> f(n);
+  std::vector<float> d(n);
+  std::vector<float> z(n + 1);
+  std::vector<int>   v(n);
+
+  for (int x = 0; x < width; ++x)
+  {
+    for (int y = 0; y < height; ++y)
+      f[y] = grid[width * y + x];
+
+    distance_transform_1d(f.data(), d.data(), height, v.data(), z.data());
+
+    for (int y = 0; y < height; ++y)
+      grid[width * y + x] = d[y];
+  }
+  for (int y = 0; y < height; ++y)
+  {
+    float* const row = &grid[width * y];
+
+    distance_transform_1d(row, d.data(), width, v.data(), z.data());
+    std::copy_n(d.data(), width, row);
+  }
+}
+
+} // anonymous namespace
+
+namespace GL
+{
+
+GlyphRenderer::GlyphRenderer()
+{}
+
+GlyphRenderer::~GlyphRenderer()
+{
+  wait_finish();
+
+  if (context_)
+    g_object_unref(context_);
+  if (font_map_)
+    g_object_unref(font_map_);
+}
+
+void GlyphRenderer::set_requests(std::vector<GlyphRequest> requests)
+{
+  g_return_if_fail(!running());
+
+  requests_ = std::move(requests);
+}
+
+std::vector<GlyphImage> GlyphRenderer::acquire_results()
+{
+  rethrow_any_error();
+  return std::move(results_);
+}
+
+void GlyphRenderer::execute()
+{
+  if (!font_map_)
+  {
+    font_map_ = pango_cairo_font_map_new();
+    context_  = pango_font_map_create_context(font_map_);
+
+    // The outlines are scaled freely, so do not snap them to the pixel grid.
+    cairo_font_options_t *const options = cairo_font_options_create();
+    cairo_font_options_set_antialias(options, CAIRO_ANTIALIAS_GRAY);
+    cairo_font_options_set_hint_style(options, CAIRO_HINT_STYLE_NONE);
+    cairo_font_options_set_hint_metrics(options, CAIRO_HINT_METRICS_OFF);
+    pango_cairo_context_set_font_options(context_, options);
+    cairo_font_options_destroy(options);
+  }
+  std::map<std::string, std::unique_ptr<PangoFont, ObjectUnref>> fonts;
+
+  results_.clear();
+  results_.reserve(requests_.size());
+
+  for (const GlyphRequest& request : requests_)
+  {
+    auto pos = fonts.find(request.face);
+
+    if (pos == fonts.end())
+    {
+      PangoFontDescription *const desc = pango_font_description_from_string(request.face.c_str());
+      pango_font_description_set_absolute_size(desc, EM_SIZE * PANGO_SCALE);
+
+      pos = fonts.emplace(request.face, std::unique_ptr<PangoFont, ObjectUnref>
+                                        {pango_context_load_font(context_, desc)}).first;
+      pango_font_description_free(desc);
+    }
+    if (PangoFont *const font = pos->second.get())
+    {
+      results_.push_back(render_glyph(font, request));
+    }
+    else
+    {
+      g_warning("Failed to load font \"%s\"", request.face.c_str());
+
+      GlyphImage blank;
+      blank.face  = request.face;
+      blank.glyph = request.glyph;
+      results_.push_back(std::move(blank));
+    }
+  }
+  requests_.clear();
+}
+
+/*
+ * Render a glyph with antialiasing and derive the signed distance field
+ * from the coverage. Texels fully inside or outside get their exact
+ * distance to the nearest texel on the other side, while the coverage of
+ * texels on the outline locates the edge with sub-texel precision.
+ */
+GlyphImage GlyphRenderer::render_glyph(PangoFont* font, const GlyphRequest& request)
+{
+  GlyphImage image;
+  image.face  = request.face;
+  image.glyph = request.glyph;
+
+  PangoRectangle ink;
+  pango_font_get_glyph_extents(font, request.glyph, &ink, nullptr);
+  pango_extents_to_pixels(&ink, nullptr);
+
+  // Blank glyphs such as spaces occupy no atlas space.
+  if (ink.width <= 0 || ink.height <= 0)
+    return image;
+
+  // Make sure the extents are within reasonable boundaries.
+  g_return_val_if_fail(ink.width < 16 * EM_SIZE && ink.height < 16 * EM_SIZE, image);
+
+  const int border = SPREAD + 1;
+  const int width  = ink.width  + 2 * border;
+  const int height = ink.height + 2 * border;
+
+  image.ink_x  = ink.x - border;
+  image.ink_y  = ink.y - border;
+  image.width  = width;
+  image.height = height;
+
+  const auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_A8, width, height);
+  {
+    const auto cairo = Cairo::Context::create(surface);
+    cairo->move_to(-image.ink_x, -image.ink_y);
+
+    PangoGlyphInfo info {};
+    info.glyph = request.glyph;
+    info.attr.is_cluster_start = 1;
+
+    PangoGlyphString glyphs {};
+    glyphs.num_glyphs = 1;
+    glyphs.glyphs = &info;
+
+    pango_cairo_show_glyph_string(cairo->cobj(), font, &glyphs);
+  }
+  surface->flush();
+
+  const unsigned char* const coverage = surface->get_data();
+  const int stride = surface->get_stride();
+
+  // Squared distances to the nearest texel inside and outside the glyph.
+  std::vector<float> to_inside(width * height);
+  std::vector<float> to_outside(width * height);
+
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+    {
+      const bool inside = (coverage[stride * y + x] >= 128);
+
+      to_inside [width * y + x] = (inside) ? 0.f : far_distance;
+      to_outside[width * y + x] = (inside) ? far_distance : 0.f;
+    }
+
+  distance_transform(to_inside,  width, height);
+  distance_transform(to_outside, width, height);
+
+  image.pixels.resize(width * height);
+
+  const float scale = 127.f / SPREAD;
+
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+    {
+      const int   i = width * y + x;
+      const float c = coverage[stride * y + x] * (1.f / 255.f);
+
+      // Signed distance from the outline in pixels, positive inside.
+      float dist;
+      if (c > 0.f && c < 1.f)
+        dist = c - 0.5f;
+      else if (c > 0.f)
+        dist = std::sqrt(to_outside[i]) - 0.5f;
+      else
+        dist = 0.5f - std::sqrt(to_inside[i]);
+
+      const float value = std::round(128.f + scale * dist);
+      image.pixels[i] = static_cast<unsigned char>(std::min(std::max(value, 0.f), 255.f));
+    }
+
+  return image;
+}
+
+} // namespace GL
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_GLYPHRENDERER_H_INCLUDED
+#define SOMATO_GLYPHRENDERER_H_INCLUDED
+
+#include "asynctask.h"
+
+#include <pango/pango.h>
+
+#include <string>
+#include <vector>
+
+namespace GL
+{
+
+/* Glyph to be rendered, identified by a size-less font description
+ * string and the glyph index within that font.
+ */
+struct GlyphRequest
+{
+  std::string face;
+  PangoGlyph  glyph;
+};
+
+/* Signed distance field image of a glyph at the reference size. Texels
+ * on the outline have the value 128, and values increase towards the
+ * inside of the glyph. The full 8 bit range covers SPREAD pixels to
+ * either side of the outline.
+ */
+struct GlyphImage
+{
+  std::string face;
+  PangoGlyph  glyph;
+
+  int ink_x  = 0; // x offset from glyph origin to image
+  int ink_y  = 0; // y offset from baseline to image top
+  int width  = 0; // width of image, 0 if blank
+  int height = 0; // height of image
+
+  std::vector<unsigned char> pixels;
+};
+
+/*
+ * Rasterize glyphs into signed distance fields on a worker thread. The
+ * glyphs are rendered once at a fixed reference size, independent of the
+ * display resolution, and can then be scaled freely when drawn. The worker
+ * uses a font map of its own, which it alone accesses.
+ */
+class GlyphRenderer : public Async::Task
+{
+public:
+  enum : int
+  {
+    EM_SIZE = 32, // reference font size in pixels
+    SPREAD  = 4   // distance range in pixels to either side of the outline
+  };
+
+  GlyphRenderer();
+  virtual ~GlyphRenderer();
+
+  void set_requests(std::vector<GlyphRequest> requests);
+  std::vector<GlyphImage> acquire_results();
+
+private:
+  void execute() override;
+  GlyphImage render_glyph(PangoFont* font, const GlyphRequest& request);
+
+  std::vector<GlyphRequest> requests_;
+  std::vector<GlyphImage>   results_;
+  PangoFontMap*             font_map_ = nullptr;
+  PangoContext*             context_  = nullptr;
+};
+
+} // namespace GL
+
+#endif // !SOMATO_GLYPHRENDERER_H_INCLUDED
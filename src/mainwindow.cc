@@ -74,6 +74,7 @@ MainWindow::MainWindow(BaseObjectType* obj, const Glib::RefPtr<Gtk::Builder>& ui
   action_cycle_        {add_action_bool("cycle", true)},
   action_grid_         {add_action_bool("grid")},
   action_outline_      {add_action_bool("outline")},
+  action_voxel_        {add_action_bool("voxel")},
   action_antialias_    {add_action_bool("antialias", true)},
 
   action_zoom_plus_    {add_action("zoom-plus",  sigc::bind(&step_increment, zoom_))},
@@ -96,6 +97,7 @@ MainWindow::MainWindow(BaseObjectType* obj, const Glib::RefPtr<Gtk::Builder>& ui
   action_cycle_    ->signal_change_state().connect(sigc::mem_fun(*this, &MainWindow::set_cycle));
   action_grid_     ->signal_change_state().connect(sigc::mem_fun(*this, &MainWindow::set_cell_grid));
   action_outline_  ->signal_change_state().connect(sigc::mem_fun(*this, &MainWindow::set_outline));
+  action_voxel_    ->signal_change_state().connect(sigc::mem_fun(*this, &MainWindow::set_voxel));
   action_antialias_->signal_change_state().connect(sigc::mem_fun(*this, &MainWindow::set_antialias));
 
   zoom_->signal_value_changed().connect(
@@ -117,9 +119,9 @@ MainWindow::MainWindow(BaseObjectType* obj, const Glib::RefPtr<Gtk::Builder>& ui
 MainWindow::~MainWindow()
 {}
 
-void MainWindow::run_puzzle_solver()
+void MainWindow::run_puzzle_solver(const PuzzleDefinition& puzzle, bool dump_stats)
 {
-  auto thread = std::make_unique<PuzzleThread>();
+  auto thread = std::make_unique<PuzzleThread>(puzzle, dump_stats);
 
   thread->signal_done().connect(sigc::mem_fun(*this, &MainWindow::start_animation));
   thread->run();
@@ -294,6 +296,14 @@ void MainWindow::set_outline(const Glib::VariantBase& state)
   cube_scene_->set_show_outline(outline);
 }
 
+void MainWindow::set_voxel(const Glib::VariantBase& state)
+{
+  action_voxel_->set_state(state);
+  const bool voxel = static_cast<const Glib::Variant<bool>&>(state).get();
+
+  cube_scene_->set_voxel_meshes(voxel);
+}
+
 void MainWindow::set_cell_grid(const Glib::VariantBase& state)
 {
   action_grid_->set_state(state);
@@ -50,7 +50,7 @@ public:
   MainWindow(BaseObjectType* obj, const Glib::RefPtr<Gtk::Builder>& ui);
   virtual ~MainWindow();
 
-  void run_puzzle_solver();
+  void run_puzzle_solver(const PuzzleDefinition& puzzle, bool dump_stats = false);
 
 protected:
   bool on_window_state_event(GdkEventWindowState* event) override;
@@ -70,6 +70,7 @@ private:
                                   action_cycle_,
                                   action_grid_,
                                   action_outline_,
+                                  action_voxel_,
                                   action_antialias_,
                                   action_zoom_plus_,
                                   action_zoom_minus_,
@@ -105,6 +106,7 @@ private:
   void set_pause(const Glib::VariantBase& state);
   void toggle_fullscreen();
   void set_outline(const Glib::VariantBase& state);
+  void set_voxel(const Glib::VariantBase& state);
   void set_cell_grid(const Glib::VariantBase& state);
   void set_antialias(const Glib::VariantBase& state);
 
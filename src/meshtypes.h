@@ -23,6 +23,7 @@
 #include "gltypes.h"
 
 #include <glib.h>
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <tuple>
@@ -47,56 +48,113 @@ inline std::tuple<float, float> wrap_octahedron_normal(float x, float y, float z
                          std::copysign(1.f - std::abs(u), v));
 }
 
+/* Quantize a coordinate in the range [-1, 1] to a signed normalized
+ * 16-bit integer.
+ */
+inline short quantize_snorm16(float value)
+{
+  return std::lrint(std::min(std::max(value, -1.f), 1.f) * 32767.f);
+}
+
+/* Mesh vertex with quantized position and normal. The position is
+ * mapped to the range [-1, 1] by a per-mesh scale and bias, which the
+ * renderer folds into the model-view transformation.
+ */
 struct MeshVertex
 {
-  float           position[3];
-  GL::Packed2i16  normal;
+  short          position[3];
+  GL::Packed2i8  normal;
 
   void set(float px, float py, float pz, float nx, float ny, float nz)
   {
-    position[0] = px;
-    position[1] = py;
-    position[2] = pz;
-    normal = GL::pack_2i16_norm(wrap_octahedron_normal(nx, ny, nz));
+    position[0] = quantize_snorm16(px);
+    position[1] = quantize_snorm16(py);
+    position[2] = quantize_snorm16(pz);
+    normal = GL::pack_2i8_norm(wrap_octahedron_normal(nx, ny, nz));
   }
   void set(float px, float py, float pz)
   {
-    position[0] = px;
-    position[1] = py;
-    position[2] = pz;
-    normal = static_cast<GL::Packed2i16>(0);
+    position[0] = quantize_snorm16(px);
+    position[1] = quantize_snorm16(py);
+    position[2] = quantize_snorm16(pz);
+    normal = static_cast<GL::Packed2i8>(0);
   }
   void swap_bytes()
   {
-    guint32 words[4];
-    std::memcpy(words, this, sizeof words);
-
-    words[0] = GUINT32_SWAP_LE_BE(words[0]);
-    words[1] = GUINT32_SWAP_LE_BE(words[1]);
-    words[2] = GUINT32_SWAP_LE_BE(words[2]);
-    words[3] = GUINT32_SWAP_LE_BE((words[3] << 16) | (words[3] >> 16));
-
-    std::memcpy(this, words, sizeof words);
+    // The normal components are single bytes and need no swapping.
+    for (auto& coord : position)
+      coord = GUINT16_SWAP_LE_BE(coord);
   }
 };
 
+/* Element index types. Indices are relative to the first vertex of
+ * each mesh, which is applied as base vertex when drawing. Meshes with
+ * more than 65535 vertices are stored with 32-bit indices.
+ */
 typedef unsigned short MeshIndex;
+typedef unsigned int   MeshIndex32;
 
-struct MeshDesc
+/* Number of levels of detail stored for each mesh.
+ */
+enum { MESH_LOD_COUNT = 3 };
+
+struct MeshLod
 {
   unsigned int triangle_count; // number of triangles
-  unsigned int indices_offset; // offset into element indices array
-  unsigned int element_first;  // minimum referenced element index
-  unsigned int element_last;   // maximum referenced element index
+  unsigned int indices_offset; // byte offset into element indices array
+};
+
+struct MeshDesc
+{
+  MeshLod      lod[MESH_LOD_COUNT]; // from full detail to coarsest
+  unsigned int element_first;  // first vertex, applied as base vertex
+  unsigned int element_last;   // last vertex of the mesh
+  unsigned int index_size;     // size of element indices in bytes
+  unsigned int cluster_first;  // first cluster of the full detail level
+  unsigned int cluster_count;  // number of clusters, or zero if none
+  float        scale;          // uniform scale of quantized positions
+  float        bias[3];        // position offset after scaling
 
   unsigned int element_count() const { return element_last - element_first + 1; }
 
   void swap_bytes()
   {
-    triangle_count = GUINT32_SWAP_LE_BE(triangle_count);
-    indices_offset = GUINT32_SWAP_LE_BE(indices_offset);
-    element_first  = GUINT32_SWAP_LE_BE(element_first);
-    element_last   = GUINT32_SWAP_LE_BE(element_last);
+    guint32 words[2 * MESH_LOD_COUNT + 9];
+    static_assert(sizeof words == sizeof(MeshDesc), "unexpected MeshDesc layout");
+
+    std::memcpy(words, this, sizeof words);
+
+    for (auto& word : words)
+      word = GUINT32_SWAP_LE_BE(word);
+
+    std::memcpy(this, words, sizeof words);
+  }
+};
+
+/* Run of consecutive triangles of the full detail level of a mesh, with
+ * a bounding sphere and a normal cone to cull clusters facing away from
+ * the viewer. Positions are in model units, like dequantized vertices.
+ */
+struct MeshCluster
+{
+  float        center[3];      // bounding sphere center
+  float        radius;         // bounding sphere radius
+  float        cone_axis[3];   // unit axis of the normal cone
+  float        cone_cutoff;    // cosine of the cone half-angle, or -1
+  unsigned int triangle_first; // first triangle within the full detail level
+  unsigned int triangle_count; // number of triangles
+
+  void swap_bytes()
+  {
+    guint32 words[10];
+    static_assert(sizeof words == sizeof(MeshCluster), "unexpected MeshCluster layout");
+
+    std::memcpy(words, this, sizeof words);
+
+    for (auto& word : words)
+      word = GUINT32_SWAP_LE_BE(word);
+
+    std::memcpy(this, words, sizeof words);
   }
 };
 
@@ -113,9 +171,79 @@ enum
  */
 constexpr float grid_cell_size = 1.;
 
+/* Scale of the quantized cell grid vertex positions.
+ */
+constexpr float grid_position_scale = 0.5f * GRID_CUBE_SIZE * grid_cell_size;
+
 inline unsigned int aligned_index_count(unsigned int count)
   { return (count + 7) & ~7u; }
 
+/* Round up the size of an index array of either type to the same
+ * 16-byte alignment as provided by aligned_index_count().
+ */
+inline unsigned int aligned_index_bytes(unsigned int size)
+  { return (size + 15) & ~15u; }
+
+/* Encoding of a chunk of a compressed mesh data stream. Indices and
+ * vertex attributes are stored as the difference to the preceding
+ * element, mapped to unsigned by zigzag encoding and written as a
+ * variable-length integer of 7 bits per byte.
+ */
+enum MeshChunkEncoding
+{
+  MESH_CHUNK_RAW       = 0, // plain copy
+  MESH_CHUNK_INDICES16 = 1, // 16-bit element indices
+  MESH_CHUNK_INDICES32 = 2, // 32-bit element indices
+  MESH_CHUNK_VERTICES  = 3  // MeshVertex array
+};
+
+/* "SMZ1" in the byte order of the data.
+ */
+const guint32 MESH_STREAM_MAGIC = 0x315A4D53;
+
+/* Header of a compressed mesh data stream, followed by the chunk table
+ * and the encoded chunk data. The decoded chunks are contiguous.
+ */
+struct MeshStreamHeader
+{
+  guint32 magic;
+  guint32 chunk_count;
+  guint32 decoded_size;
+  guint32 encoded_size; // size of the encoded data after the chunk table
+
+  void swap_bytes()
+  {
+    magic        = GUINT32_SWAP_LE_BE(magic);
+    chunk_count  = GUINT32_SWAP_LE_BE(chunk_count);
+    decoded_size = GUINT32_SWAP_LE_BE(decoded_size);
+    encoded_size = GUINT32_SWAP_LE_BE(encoded_size);
+  }
+};
+
+struct MeshStreamChunk
+{
+  guint32 encoding;       // MeshChunkEncoding
+  guint32 decoded_offset; // relative to the start of the decoded data
+  guint32 decoded_size;
+  guint32 encoded_offset; // relative to the start of the encoded data
+  guint32 encoded_size;
+
+  void swap_bytes()
+  {
+    encoding       = GUINT32_SWAP_LE_BE(encoding);
+    decoded_offset = GUINT32_SWAP_LE_BE(decoded_offset);
+    decoded_size   = GUINT32_SWAP_LE_BE(decoded_size);
+    encoded_offset = GUINT32_SWAP_LE_BE(encoded_offset);
+    encoded_size   = GUINT32_SWAP_LE_BE(encoded_size);
+  }
+};
+
+inline guint32 zigzag_encode(gint32 value)
+  { return (guint32(value) << 1) ^ guint32(value >> 31); }
+
+inline gint32 zigzag_decode(guint32 value)
+  { return gint32(value >> 1) ^ -gint32(value & 1); }
+
 } // namespace Somato
 
 #endif // !SOMATO_MESHTYPES_H_INCLUDED
@@ -21,115 +21,14 @@
 #include "puzzle.h"
 
 #include <glib.h>
-#include <algorithm>
 #include <chrono>
-#include <functional>
-#include <iterator>
-#include <numeric>
+#include <utility>
 
 namespace
 {
 
 using namespace Somato;
 
-typedef std::vector<SomaBitCube> PieceStore;
-
-class PuzzleSolver
-{
-public:
-  PuzzleSolver() = default;
-  std::vector<SomaCube> execute();
-
-  PuzzleSolver(const PuzzleSolver&) = delete;
-  PuzzleSolver& operator=(const PuzzleSolver&) = delete;
-
-private:
-  std::array<SomaBitCube, SomaCube::COUNT> state_;
-  std::array<PieceStore,  SomaCube::COUNT> columns_;
-  std::vector<SomaCube>                    solutions_;
-
-  void recurse(std::size_t col, SomaBitCube cube);
-};
-
-/*
- * Cube pieces rearranged for maximum efficiency.  It is about 15 times
- * faster than with the original order from the project description.
- * The cube piece at index 0 should be suitable for use as the anchor.
- */
-const std::array<SomaBitCube, SomaCube::COUNT> cube_piece_data
-{{
-  {{0,0,0}, {0,0,1}, {1,0,0}, {1,1,0}}, // orange
-  {{0,0,0}, {0,0,1}, {0,1,0}, {1,0,0}}, // green
-  {{0,0,0}, {0,0,1}, {0,1,1}, {1,0,0}}, // red
-  {{0,0,0}, {0,1,0}, {1,1,0}, {1,2,0}}, // yellow
-  {{0,0,0}, {0,1,0}, {0,2,0}, {1,1,0}}, // blue
-  {{0,0,0}, {0,1,0}, {0,2,0}, {1,0,0}}, // lavender
-  {{0,0,0}, {0,1,0}, {1,0,0}}           // cyan
-}};
-
-/*
- * Rotate the cube.  This takes care of all orientations possible.
- */
-void compute_rotations(SomaBitCube cube, PieceStore& store)
-{
-  for (unsigned int i = 0;; ++i)
-  {
-    SomaBitCube temp = cube;
-
-    // Add the 4 possible orientations of each cube side.
-    store.push_back(temp);
-    store.push_back(temp.rotate_z());
-    store.push_back(temp.rotate_z());
-    store.push_back(temp.rotate_z());
-
-    if (i == 5)
-      break;
-
-    // Due to the zigzagging performed here, only 5 rotations are
-    // necessary to move each of the 6 cube sides in turn to the front.
-    if ((i % 2) == 0)
-      cube.rotate_x();
-    else
-      cube.rotate_y();
-  }
-}
-
-/*
- * Push the Soma block around; into every position respectively rotation
- * imaginable.  Note that the block is assumed to be positioned initially
- * in the (0, 0, 0) corner of the cube.
- */
-void shuffle_cube_piece(SomaBitCube cube, PieceStore& store)
-{
-  // Make sure the piece is positioned where we expect it to be.
-  g_return_if_fail(cube.get(0, 0, 0));
-
-  for (SomaBitCube z = cube; z; z.shift(AXIS_Z))
-    for (SomaBitCube y = z; y; y.shift(AXIS_Y))
-      for (SomaBitCube x = y; x; x.shift(AXIS_X))
-      {
-        compute_rotations(x, store);
-      }
-}
-
-/*
- * Replace store by a new set of piece placements that contains only those
- * items from the source which cannot be reproduced by rotating any other
- * item.  This is not a universally applicable utility function; the input
- * is assumed to have come straight out of shuffle_cube_piece().
- */
-void filter_rotations(PieceStore& store)
-{
-  g_return_if_fail(store.size() % 24 == 0);
-
-  auto pdest = begin(store);
-
-  for (auto p = cbegin(store); p != cend(store); p += 24)
-    *pdest++ = *std::min_element(p, p + 24, SomaBitCube::SortPredicate{});
-
-  store.erase(pdest, end(store));
-}
-
 bool find_piece_translation(SomaBitCube original, SomaBitCube piece, Math::Matrix4& transform)
 {
   int z = 0;
@@ -158,67 +57,37 @@ bool find_piece_translation(SomaBitCube original, SomaBitCube piece, Math::Matri
   return false;
 }
 
-std::vector<SomaCube> PuzzleSolver::execute()
+bool find_piece_orientation(SomaBitCube original, SomaBitCube piece, Math::Matrix4& transform)
 {
-  solutions_.reserve(480);
-
-  for (size_t i = 0; i < SomaCube::COUNT; ++i)
+  static const Math::Matrix4 rotate90[3] =
   {
-    PieceStore& store = columns_[i];
-
-    store.reserve(256);
-    shuffle_cube_piece(cube_piece_data[i], store);
-
-    if (i == 0)
-      filter_rotations(store);
-
-    std::sort(begin(store), end(store), SomaBitCube::SortPredicate{});
-    store.erase(std::unique(begin(store), end(store)), end(store));
-  }
-
-  const SomaBitCube common = std::accumulate(cbegin(columns_[0]), cend(columns_[0]),
-                                             ~SomaBitCube{}, std::bit_and<SomaBitCube>{});
-  if (common)
-    for (auto pcol = begin(columns_) + 1; pcol != end(columns_); ++pcol)
-    {
-      const auto pend = std::remove_if(begin(*pcol), end(*pcol),
-                                       [common](SomaBitCube c) { return (c & common); });
-      pcol->erase(pend, end(*pcol));
-    }
-
-  // Add zero-termination.
-  for (auto& column : columns_)
-    column.push_back({});
-
-  recurse(0, {});
-
-  return std::move(solutions_);
-}
-
-void PuzzleSolver::recurse(std::size_t col, SomaBitCube cube)
-{
-  auto row = cbegin(columns_[col]);
+    {{1, 0,  0}, { 0, 0, -1}, {0, 1, 0}}, // 90 deg around x
+    {{0, 0, -1}, { 0, 1,  0}, {1, 0, 0}}, // 90 deg around y
+    {{0, 1,  0}, {-1, 0,  0}, {0, 0, 1}}  // 90 deg around z
+  };
 
-  for (;;)
+  for (size_t i = 0; i < 6; ++i)
   {
-    SomaBitCube piece;
-    do
+    // Add the 4 possible orientations of each cube side.
+    for (int k = 0; k < 4; ++k)
     {
-      piece = *row;
-      ++row;
-    }
-    while (piece & cube);
-
-    if (!piece)
-      break;
+      if (find_piece_translation(original, piece, transform))
+        return true;
 
-    state_[col] = piece;
+      piece.rotate_z();
+      transform *= rotate90[AXIS_Z];
+    }
 
-    if (col < SomaCube::COUNT - 1)
-      recurse(col + 1, cube | piece);
+    // Due to the zigzagging performed here, only 5 rotations are
+    // necessary to move each of the 6 cube sides in turn to the front.
+    if ((i % 2) == 0)
+      piece.rotate_x();
     else
-      solutions_.emplace_back(state_);
+      piece.rotate_y();
+
+    transform *= rotate90[i % 2];
   }
+  return false;
 }
 
 } // anonymous namespace
@@ -226,7 +95,10 @@ void PuzzleSolver::recurse(std::size_t col, SomaBitCube cube)
 namespace Somato
 {
 
-PuzzleThread::PuzzleThread()
+PuzzleThread::PuzzleThread(PuzzleDefinition puzzle, bool dump_stats)
+:
+  puzzle_     {std::move(puzzle)},
+  dump_stats_ {dump_stats}
 {}
 
 PuzzleThread::~PuzzleThread()
@@ -243,54 +115,45 @@ std::vector<SomaCube> PuzzleThread::acquire_results()
 void PuzzleThread::execute()
 {
   const auto start = std::chrono::steady_clock::now();
-  {
-    PuzzleSolver solver;
+  PuzzleSolver solver {puzzle_.bit_cubes<3>()};
+  SolverStats  stats;
+
+  if (dump_stats_)
+    solutions_ = solver.execute(stats);
+  else
     solutions_ = solver.execute();
-  }
+
   const auto stop = std::chrono::steady_clock::now();
   const std::chrono::duration<double, std::milli> elapsed = stop - start;
 
   g_info("Puzzle solve time: %0.1f ms", elapsed.count());
+
+  if (dump_stats_)
+    g_print("%s", stats.to_json().c_str());
 }
 
-Math::Matrix4 find_puzzle_piece_orientation(int piece_idx, SomaBitCube piece)
+void check_puzzle_displayable(const PuzzleDefinition& puzzle)
 {
-  static const Math::Matrix4 rotate90[3] =
-  {
-    {{1, 0,  0}, { 0, 0, -1}, {0, 1, 0}}, // 90 deg around x
-    {{0, 0, -1}, { 0, 1,  0}, {1, 0, 0}}, // 90 deg around y
-    {{0, 1,  0}, {-1, 0,  0}, {0, 0, 1}}  // 90 deg around z
-  };
-  Math::Matrix4 transform;
-
-  g_return_val_if_fail(piece_idx >= 0 && piece_idx < SomaCube::COUNT, transform);
+  if (puzzle.size() != SomaBitCube::N || puzzle.pieces().size() > SomaCube::COUNT)
+    throw PuzzleDefinition::Error{"Only puzzles of at most seven pieces in a 3x3x3 cube "
+                                  "can be displayed"};
+}
 
-  const SomaBitCube original = cube_piece_data[piece_idx];
+int find_puzzle_piece_orientation(int piece_idx, SomaBitCube piece, Math::Matrix4& transform)
+{
+  g_return_val_if_fail(piece_idx >= 0 && piece_idx < SomaCube::COUNT, -1);
 
-  for (size_t i = 0; i < 6; ++i)
+  // Try the mesh of the same index first, so that the pieces of the Soma
+  // cube itself keep their meshes.
+  for (int i = 0; i < SomaCube::COUNT; ++i)
   {
-    // Add the 4 possible orientations of each cube side.
-    for (int k = 0; k < 4; ++k)
-    {
-      if (find_piece_translation(original, piece, transform))
-        return transform;
+    const int mesh_idx = (piece_idx + i) % SomaCube::COUNT;
+    transform = Math::Matrix4{};
 
-      piece.rotate_z();
-      transform *= rotate90[AXIS_Z];
-    }
-
-    // Due to the zigzagging performed here, only 5 rotations are
-    // necessary to move each of the 6 cube sides in turn to the front.
-    if ((i % 2) == 0)
-      piece.rotate_x();
-    else
-      piece.rotate_y();
-
-    transform *= rotate90[i % 2];
+    if (find_piece_orientation(cube_piece_data[mesh_idx], piece, transform))
+      return mesh_idx;
   }
-
-  g_warn_if_reached();
-  return transform;
+  return -1;
 }
 
 } // namespace Somato
@@ -21,23 +21,19 @@
 #define SOMATO_PUZZLE_H_INCLUDED
 
 #include "asynctask.h"
-#include "bitcube.h"
-#include "puzzlecube.h"
+#include "puzzledef.h"
+#include "puzzlesolver.h"
 #include "vectormath.h"
 
-#include <array>
 #include <vector>
 
 namespace Somato
 {
 
-typedef BitCube<3>       SomaBitCube;
-typedef PuzzleCube<3, 7> SomaCube;
-
 class PuzzleThread : public Async::Task
 {
 public:
-  PuzzleThread();
+  explicit PuzzleThread(PuzzleDefinition puzzle, bool dump_stats = false);
   virtual ~PuzzleThread();
 
   std::vector<SomaCube> acquire_results();
@@ -45,10 +41,19 @@ public:
 private:
   void execute() override;
 
+  PuzzleDefinition      puzzle_;
   std::vector<SomaCube> solutions_;
+  bool                  dump_stats_;
 };
 
-Math::Matrix4 find_puzzle_piece_orientation(int piece_idx, SomaBitCube piece);
+// Throw PuzzleDefinition::Error unless the puzzle fits into the cube
+// representation used for display.
+void check_puzzle_displayable(const PuzzleDefinition& puzzle);
+
+// Find a Soma cube piece of the same shape as the given piece, and the
+// orientation which maps its baked mesh onto the piece. Return the index
+// of the mesh, or -1 if the piece matches none of the Soma cube pieces.
+int find_puzzle_piece_orientation(int piece_idx, SomaBitCube piece, Math::Matrix4& transform);
 
 } // namespace Somato
 
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "puzzledef.h"
+#include "puzzlesolver.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+namespace
+{
+
+using namespace Somato;
+
+const char *const soma_piece_names[SomaCube::COUNT] =
+{
+  "orange", "green", "red", "yellow", "blue", "lavender", "cyan"
+};
+
+bool parse_cell(const std::string& token, PuzzleDefinition::Cell& cell)
+{
+  char trail = '\0';
+
+  return (std::sscanf(token.c_str(), "%d,%d,%d%c",
+                      &cell[0], &cell[1], &cell[2], &trail) == 3);
+}
+
+std::string line_error(int line_number, const std::string& message)
+{
+  return "Line " + std::to_string(line_number) + ": " + message;
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+PuzzleDefinition PuzzleDefinition::parse(const std::string& text)
+{
+  PuzzleDefinition definition;
+  std::istringstream input {text};
+  std::string line;
+
+  for (int line_number = 1; std::getline(input, line); ++line_number)
+  {
+    std::istringstream tokens {line};
+    std::string token;
+
+    if (!(tokens >> token) || token[0] == '#')
+      continue;
+
+    if (token == "size")
+    {
+      int size = 0;
+
+      if (!(tokens >> size) || (tokens >> token))
+        throw Error{line_error(line_number, "expected a single cube size")};
+
+      if (size != 3 && size != 4)
+        throw Error{line_error(line_number, "unsupported cube size " + std::to_string(size))};
+
+      definition.size_ = size;
+      continue;
+    }
+    Piece piece;
+    Cell  cell;
+
+    if (token == "piece")
+    {
+      if (!(tokens >> token))
+        throw Error{line_error(line_number, "piece without cells")};
+
+      if (!parse_cell(token, cell))
+      {
+        piece.name = token;
+
+        if (!(tokens >> token))
+          throw Error{line_error(line_number, "piece without cells")};
+      }
+    }
+    do
+    {
+      if (!parse_cell(token, cell))
+        throw Error{line_error(line_number, "invalid cell \"" + token + '"')};
+
+      piece.cells.push_back(cell);
+    }
+    while (tokens >> token);
+
+    definition.pieces_.push_back(std::move(piece));
+  }
+  if (definition.pieces_.size() < 2)
+    throw Error{"A puzzle needs at least two pieces"};
+
+  return definition;
+}
+
+PuzzleDefinition PuzzleDefinition::load(const std::string& filename)
+{
+  char*   contents = nullptr;
+  GError* error    = nullptr;
+
+  if (!g_file_get_contents(filename.c_str(), &contents, nullptr, &error))
+  {
+    const std::string message = error->message;
+    g_error_free(error);
+    throw Error{message};
+  }
+  const std::unique_ptr<char[], decltype(&g_free)> contents_del {contents, &g_free};
+
+  try
+  {
+    return parse(contents);
+  }
+  catch (const Error& parse_error)
+  {
+    throw Error{filename + ": " + parse_error.what()};
+  }
+}
+
+PuzzleDefinition PuzzleDefinition::soma_cube()
+{
+  PuzzleDefinition definition;
+
+  for (std::size_t i = 0; i < cube_piece_data.size(); ++i)
+  {
+    Piece piece;
+    piece.name = soma_piece_names[i];
+
+    for (int x = 0; x < SomaBitCube::N; ++x)
+      for (int y = 0; y < SomaBitCube::N; ++y)
+        for (int z = 0; z < SomaBitCube::N; ++z)
+          if (cube_piece_data[i].get(x, y, z))
+            piece.cells.push_back({{x, y, z}});
+
+    definition.pieces_.push_back(std::move(piece));
+  }
+  return definition;
+}
+
+template <int N>
+std::vector<BitCube<N>> PuzzleDefinition::bit_cubes() const
+{
+  std::vector<BitCube<N>> result;
+  int volume = 0;
+
+  for (std::size_t i = 0; i < pieces_.size(); ++i)
+  {
+    const Piece& piece = pieces_[i];
+    const std::string label = (piece.name.empty()) ? "Piece " + std::to_string(i + 1)
+                                                   : "Piece " + piece.name;
+    if (piece.cells.empty())
+      throw Error{label + " has no cells"};
+
+    Cell lower = piece.cells.front();
+
+    for (const Cell& cell : piece.cells)
+      for (int k = 0; k < 3; ++k)
+        lower[k] = std::min(lower[k], cell[k]);
+
+    BitCube<N> cube;
+
+    for (const Cell& cell : piece.cells)
+    {
+      const int x = cell[0] - lower[0];
+      const int y = cell[1] - lower[1];
+      const int z = cell[2] - lower[2];
+
+      if (x >= N || y >= N || z >= N)
+        throw Error{label + " does not fit into the cube"};
+
+      if (cube.get(x, y, z))
+        throw Error{label + " lists a cell twice"};
+
+      cube.put(x, y, z, true);
+    }
+    volume += piece.cells.size();
+    result.push_back(cube);
+  }
+  if (volume > N * N * N)
+    throw Error{"The pieces have more cells than the cube"};
+
+  return result;
+}
+
+template std::vector<BitCube<3>> PuzzleDefinition::bit_cubes<3>() const;
+template std::vector<BitCube<4>> PuzzleDefinition::bit_cubes<4>() const;
+
+} // namespace Somato
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_PUZZLEDEF_H_INCLUDED
+#define SOMATO_PUZZLEDEF_H_INCLUDED
+
+#include "bitcube.h"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Somato
+{
+
+/* Puzzle definition loaded at run time.  The text format consists of one
+ * statement per line, and lines starting with '#' are ignored.  "size N"
+ * sets the edge length of the cube to fill, which defaults to 3.  Each
+ * "piece [NAME] x,y,z ..." line adds a piece made up of the listed cells,
+ * and a line of cells alone adds an unnamed piece.
+ */
+class PuzzleDefinition
+{
+public:
+  typedef std::array<int, 3> Cell;
+
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit Error(const std::string& message) : std::runtime_error(message) {}
+  };
+
+  struct Piece
+  {
+    std::string       name;
+    std::vector<Cell> cells;
+  };
+
+  PuzzleDefinition() = default;
+
+  static PuzzleDefinition parse(const std::string& text);
+  static PuzzleDefinition load(const std::string& filename);
+  static PuzzleDefinition soma_cube();
+
+  int size() const { return size_; }
+  void set_size(int size) { size_ = size; }
+
+  const std::vector<Piece>& pieces() const { return pieces_; }
+
+  // Get the cell masks of the pieces, moved to the origin corner.
+  // Throws Error if the pieces do not fit into a cube of N^3 cells.
+  template <int N> std::vector<BitCube<N>> bit_cubes() const;
+
+private:
+  int                size_ = 3;
+  std::vector<Piece> pieces_;
+};
+
+extern template std::vector<BitCube<3>> PuzzleDefinition::bit_cubes<3>() const;
+extern template std::vector<BitCube<4>> PuzzleDefinition::bit_cubes<4>() const;
+
+} // namespace Somato
+
+#endif // !SOMATO_PUZZLEDEF_H_INCLUDED
@@ -0,0 +1,798 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "puzzlesolver.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <locale>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+using namespace Somato;
+
+typedef std::chrono::steady_clock Clock;
+
+/*
+ * Statistics policy of the solver when no statistics have been requested.
+ * All hooks compile to nothing.
+ */
+struct NullStats
+{
+  explicit NullStats(std::size_t) {}
+
+  void node(std::size_t) {}
+  void accepted(std::size_t) {}
+  void scanned(std::size_t, std::ptrdiff_t) {}
+  void task() {}
+  void solution() {}
+  void start() {}
+  void stop() {}
+  void merge(SolverStats&) const {}
+};
+
+/*
+ * Statistics policy which counts into the worker's own counters.  These
+ * are only merged into the shared result after the search has finished,
+ * so that the workers never need to synchronize.
+ */
+class CountingStats
+{
+public:
+  explicit CountingStats(std::size_t depth) : columns_ (depth) {}
+
+  void node(std::size_t col) { ++columns_[col].nodes; }
+  void accepted(std::size_t col) { ++columns_[col].accepted; }
+  void scanned(std::size_t col, std::ptrdiff_t count) { columns_[col].scanned += count; }
+  void task() { ++thread_.tasks; }
+  void solution() { ++thread_.solutions; }
+  void start() { start_ = Clock::now(); }
+  void stop();
+  void merge(SolverStats& stats) const;
+
+private:
+  std::vector<SolverStats::Column> columns_;
+  SolverStats::Thread              thread_;
+  Clock::time_point                start_;
+};
+
+void CountingStats::stop()
+{
+  const std::chrono::duration<double> elapsed = Clock::now() - start_;
+  thread_.seconds = elapsed.count();
+
+  for (const auto& column : columns_)
+    thread_.nodes += column.nodes;
+}
+
+void CountingStats::merge(SolverStats& stats) const
+{
+  for (std::size_t i = 0; i < columns_.size(); ++i)
+  {
+    stats.columns[i].nodes    += columns_[i].nodes;
+    stats.columns[i].scanned  += columns_[i].scanned;
+    stats.columns[i].accepted += columns_[i].accepted;
+  }
+  stats.threads.push_back(thread_);
+  stats.solutions += thread_.solutions;
+}
+
+/*
+ * Rotate the cube.  This takes care of all orientations possible.
+ */
+template <int N>
+void compute_rotations(BitCube<N> cube, std::vector<BitCube<N>>& store)
+{
+  for (unsigned int i = 0;; ++i)
+  {
+    BitCube<N> temp = cube;
+
+    // Add the 4 possible orientations of each cube side.
+    store.push_back(temp);
+    store.push_back(temp.rotate_z());
+    store.push_back(temp.rotate_z());
+    store.push_back(temp.rotate_z());
+
+    if (i == 5)
+      break;
+
+    // Due to the zigzagging performed here, only 5 rotations are
+    // necessary to move each of the 6 cube sides in turn to the front.
+    if ((i % 2) == 0)
+      cube.rotate_x();
+    else
+      cube.rotate_y();
+  }
+}
+
+/*
+ * Return whether a piece touches the lower bound of each axis.
+ */
+template <int N>
+bool is_origin_aligned(BitCube<N> cube)
+{
+  for (int axis = AXIS_X; axis <= AXIS_Z; ++axis)
+  {
+    BitCube<N> temp = cube;
+
+    if (temp.shift_rev(axis).shift(axis) == cube)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Push the Soma block around; into every position respectively rotation
+ * imaginable.  Note that the block is assumed to be positioned initially
+ * in the (0, 0, 0) corner of the cube.
+ */
+template <int N>
+void shuffle_cube_piece(BitCube<N> cube, std::vector<BitCube<N>>& store)
+{
+  // Make sure the piece is positioned where we expect it to be.
+  g_return_if_fail(is_origin_aligned(cube));
+
+  for (BitCube<N> z = cube; z; z.shift(AXIS_Z))
+    for (BitCube<N> y = z; y; y.shift(AXIS_Y))
+      for (BitCube<N> x = y; x; x.shift(AXIS_X))
+      {
+        compute_rotations(x, store);
+      }
+}
+
+/*
+ * Replace store by a new set of piece placements that contains only those
+ * items from the source which cannot be reproduced by rotating any other
+ * item.  This is not a universally applicable utility function; the input
+ * is assumed to have come straight out of shuffle_cube_piece().
+ */
+template <int N>
+void filter_rotations(std::vector<BitCube<N>>& store)
+{
+  g_return_if_fail(store.size() % 24 == 0);
+
+  auto pdest = begin(store);
+
+  for (auto p = cbegin(store); p != cend(store); p += 24)
+    *pdest++ = *std::min_element(p, p + 24, typename BitCube<N>::SortPredicate{});
+
+  store.erase(pdest, end(store));
+}
+
+/*
+ * Return whether no placement of a piece is mapped onto itself by any
+ * rotation of the cube.  The input is assumed to have come straight out
+ * of shuffle_cube_piece().
+ */
+template <int N>
+bool is_asymmetric(const std::vector<BitCube<N>>& store)
+{
+  for (auto p = cbegin(store); p + 24 <= cend(store); p += 24)
+  {
+    std::array<BitCube<N>, 24> rotations;
+    std::copy(p, p + 24, begin(rotations));
+    std::sort(begin(rotations), end(rotations), typename BitCube<N>::SortPredicate{});
+
+    if (std::adjacent_find(cbegin(rotations), cend(rotations)) != cend(rotations))
+      return false;
+  }
+  return true;
+}
+
+template <int N>
+void sort_unique(std::vector<BitCube<N>>& store)
+{
+  std::sort(begin(store), end(store), typename BitCube<N>::SortPredicate{});
+  store.erase(std::unique(begin(store), end(store)), end(store));
+}
+
+/*
+ * Return the cells occupied by every placement of the anchor piece.
+ * No other piece can be placed there.
+ */
+template <int N>
+BitCube<N> common_cells(const std::vector<BitCube<N>>& anchors)
+{
+  return std::accumulate(cbegin(anchors), cend(anchors),
+                         ~BitCube<N>{}, std::bit_and<BitCube<N>>{});
+}
+
+/*
+ * Pack the flat solver output of puzzles with up to seven pieces in the
+ * cube representation of the Soma cube.  Missing pieces are left empty.
+ */
+std::vector<SomaCube> to_soma_cubes(const std::vector<SomaBitCube>& pieces,
+                                    std::size_t piece_count)
+{
+  std::vector<SomaCube> cubes;
+  cubes.reserve(pieces.size() / piece_count);
+
+  std::array<SomaBitCube, SomaCube::COUNT> solution;
+
+  for (std::size_t i = 0; i + piece_count <= pieces.size(); i += piece_count)
+  {
+    std::copy_n(&pieces[i], piece_count, solution.begin());
+    cubes.emplace_back(solution);
+  }
+  return cubes;
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+/*
+ * Soma cube pieces in the order of their meshes.  The solver determines
+ * the order of the search by itself.
+ */
+const std::array<SomaBitCube, SomaCube::COUNT> cube_piece_data
+{{
+  {{0,0,0}, {0,0,1}, {1,0,0}, {1,1,0}}, // orange
+  {{0,0,0}, {0,0,1}, {0,1,0}, {1,0,0}}, // green
+  {{0,0,0}, {0,0,1}, {0,1,1}, {1,0,0}}, // red
+  {{0,0,0}, {0,1,0}, {1,1,0}, {1,2,0}}, // yellow
+  {{0,0,0}, {0,1,0}, {0,2,0}, {1,1,0}}, // blue
+  {{0,0,0}, {0,1,0}, {0,2,0}, {1,0,0}}, // lavender
+  {{0,0,0}, {0,1,0}, {1,0,0}}           // cyan
+}};
+
+/*
+ * Hands solutions to the sink in search order.  The solutions of each
+ * subtree are buffered in the slot reserved for it until all subtrees
+ * before it have been written out.  From then on, the worker searching
+ * the subtree writes out each solution as soon as it is found.  The slot
+ * of the next subtree to write is only accessed by its worker until the
+ * subtree is done, and all writes are serialized by the mutex.
+ */
+template <int N>
+struct BasicPuzzleSolver<N>::Output
+{
+  Output(const SolutionSink& s, std::size_t tasks, std::size_t cols, std::uint64_t max)
+    : sink (s), parts (tasks), done (tasks), depth {cols}, limit {max} {}
+
+  void write(std::vector<Piece>& part);
+  void flush(std::size_t task);
+  void finish(std::size_t task);
+
+  const SolutionSink&             sink;
+  std::vector<std::vector<Piece>> parts;
+  std::vector<char>               done;
+  std::mutex                      mutex;
+  std::atomic<std::size_t>        next {0}; // first subtree not written out
+  std::size_t                     depth;
+  std::uint64_t                   written = 0;
+  std::uint64_t                   limit;
+};
+
+/*
+ * Write out the solutions buffered in a slot, up to the limit.
+ * The mutex must be held.
+ */
+template <int N>
+void BasicPuzzleSolver<N>::Output::write(std::vector<Piece>& part)
+{
+  for (std::size_t i = 0; i < part.size() && written < limit; i += depth)
+  {
+    sink(&part[i]);
+    ++written;
+  }
+  part.clear();
+}
+
+/*
+ * Write out the solutions found so far in a subtree if all subtrees
+ * before it have been written out.
+ */
+template <int N>
+void BasicPuzzleSolver<N>::Output::flush(std::size_t task)
+{
+  if (next.load(std::memory_order_acquire) == task)
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    write(parts[task]);
+  }
+}
+
+/*
+ * Mark a subtree as done, and write out all done subtrees which are
+ * no longer preceded by pending ones.
+ */
+template <int N>
+void BasicPuzzleSolver<N>::Output::finish(std::size_t task)
+{
+  std::lock_guard<std::mutex> lock {mutex};
+  done[task] = true;
+
+  std::size_t index = next.load(std::memory_order_relaxed);
+
+  for (; index < done.size() && done[index]; ++index)
+  {
+    write(parts[index]);
+    std::vector<Piece>{}.swap(parts[index]);
+  }
+  next.store(index, std::memory_order_release);
+}
+
+/*
+ * Per-thread state of the search.  Each worker owns a copy of the stats
+ * policy, and writes the solutions found in a subtree to the slot reserved
+ * for that subtree.  No solutions are stored if there is no output.
+ */
+template <int N>
+template <typename S>
+struct BasicPuzzleSolver<N>::Worker
+{
+  explicit Worker(std::size_t depth) : state (depth), stats {depth} {}
+
+  std::vector<Piece> state;
+  Output*            output = nullptr;
+  std::size_t        task   = 0;
+  std::uint64_t      found  = 0; // solutions in the current subtree
+  std::uint64_t      limit  = 0;
+  S                  stats;
+};
+
+template <int N>
+BasicPuzzleSolver<N>::BasicPuzzleSolver(std::vector<Piece> pieces)
+:
+  pieces_ (std::move(pieces))
+{}
+
+template <int N>
+std::vector<BitCube<N>> BasicPuzzleSolver<N>::execute()
+{
+  std::vector<Piece> solutions;
+  const std::size_t count = pieces_.size();
+
+  execute([&solutions, count](const Piece* pieces)
+          { solutions.insert(end(solutions), pieces, pieces + count); });
+  return solutions;
+}
+
+template <int N>
+std::vector<BitCube<N>> BasicPuzzleSolver<N>::execute(SolverStats& stats)
+{
+  std::vector<Piece> solutions;
+  const std::size_t count = pieces_.size();
+
+  execute([&solutions, count](const Piece* pieces)
+          { solutions.insert(end(solutions), pieces, pieces + count); },
+          stats);
+  return solutions;
+}
+
+template <int N>
+std::uint64_t BasicPuzzleSolver<N>::execute(const SolutionSink& sink)
+{
+  return run(&sink, nullptr);
+}
+
+template <int N>
+std::uint64_t BasicPuzzleSolver<N>::execute(const SolutionSink& sink, SolverStats& stats)
+{
+  return run(&sink, &stats);
+}
+
+template <int N>
+std::uint64_t BasicPuzzleSolver<N>::count()
+{
+  return run(nullptr, nullptr);
+}
+
+template <int N>
+std::uint64_t BasicPuzzleSolver<N>::count(SolverStats& stats)
+{
+  return run(nullptr, &stats);
+}
+
+template <int N>
+std::uint64_t BasicPuzzleSolver<N>::run(const SolutionSink* sink, SolverStats* stats)
+{
+  g_return_val_if_fail(pieces_.size() >= 2, 0);
+
+  if (!stats)
+  {
+    setup(nullptr);
+    return search<NullStats>(sink, nullptr);
+  }
+  *stats = SolverStats{};
+  stats->columns.resize(pieces_.size());
+
+  const auto start = Clock::now();
+  setup(stats);
+  const auto stop = Clock::now();
+
+  const std::uint64_t count = search<CountingStats>(sink, stats);
+
+  const std::chrono::duration<double> setup_time = stop - start;
+  const std::chrono::duration<double> search_time = Clock::now() - stop;
+
+  stats->setup_seconds  = setup_time.count();
+  stats->search_seconds = search_time.count();
+
+  return count;
+}
+
+template <int N>
+void BasicPuzzleSolver<N>::setup(SolverStats* stats)
+{
+  const std::size_t count = pieces_.size();
+  std::vector<PieceStore> shuffled (count);
+
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    shuffled[i].reserve(256);
+    shuffle_cube_piece(pieces_[i], shuffled[i]);
+  }
+  order_.resize(count);
+  std::iota(begin(order_), end(order_), std::size_t{0});
+
+  if (piece_order_ == PieceOrder::AUTOMATIC)
+  {
+    // The anchor placements are reduced by rotational symmetry, so the
+    // fewer remain, the smaller the search tree is at its very root.  If
+    // a placement of the anchor is symmetric itself, rotated copies of
+    // some solutions are found as well, so avoid such pieces if possible.
+    std::size_t anchor = 0;
+    bool anchor_asymmetric = false;
+    PieceStore anchors;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const bool asymmetric = is_asymmetric(shuffled[i]);
+
+      if (i > 0 && asymmetric < anchor_asymmetric)
+        continue;
+
+      PieceStore store = shuffled[i];
+      filter_rotations(store);
+      sort_unique(store);
+
+      if (i == 0 || asymmetric > anchor_asymmetric || store.size() < anchors.size())
+      {
+        anchor = i;
+        anchor_asymmetric = asymmetric;
+        anchors.swap(store);
+      }
+    }
+    std::rotate(begin(order_), begin(order_) + anchor, begin(order_) + anchor + 1);
+
+    // Fail first: place the pieces with the fewest options early on, so
+    // that dead ends are detected close to the root.
+    const Piece common = common_cells(anchors);
+    std::vector<std::size_t> options (count);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      PieceStore store = shuffled[i];
+      sort_unique(store);
+      options[i] = std::count_if(cbegin(store), cend(store),
+                                 [common](Piece c) { return !(c & common); });
+    }
+    std::stable_sort(begin(order_) + 1, end(order_),
+                     [&options](std::size_t a, std::size_t b) { return (options[a] < options[b]); });
+  }
+
+  columns_.clear();
+  columns_.resize(count);
+
+  for (std::size_t col = 0; col < count; ++col)
+  {
+    PieceStore& store = columns_[col];
+    store.swap(shuffled[order_[col]]);
+
+    if (col == 0)
+      filter_rotations(store);
+
+    sort_unique(store);
+  }
+
+  const Piece common = common_cells(columns_[0]);
+  if (common)
+    for (auto pcol = begin(columns_) + 1; pcol != end(columns_); ++pcol)
+    {
+      const auto pend = std::remove_if(begin(*pcol), end(*pcol),
+                                       [common](Piece c) { return (c & common); });
+      if (stats)
+        stats->columns[pcol - begin(columns_)].pruned = end(*pcol) - pend;
+
+      pcol->erase(pend, end(*pcol));
+    }
+
+  if (stats)
+    for (std::size_t col = 0; col < count; ++col)
+    {
+      stats->columns[col].piece      = order_[col];
+      stats->columns[col].placements = columns_[col].size();
+    }
+
+  // Add zero-termination.
+  for (auto& column : columns_)
+    column.push_back({});
+}
+
+/*
+ * Expand the first two levels of the search tree up front, which yields
+ * enough independent subtrees to keep all worker threads busy.  Workers
+ * claim subtrees in order, and the solutions of each subtree are passed
+ * to the sink only after those of all preceding subtrees.  Thus, the
+ * result is the same as that of a sequential search regardless of
+ * scheduling.
+ *
+ * With a solution limit, workers stop claiming subtrees once enough
+ * solutions have been found.  Since the subtrees are claimed in order and
+ * each claimed subtree is searched to the end or up to the limit, the
+ * subtrees searched always form a prefix, which contains at least the
+ * first max_solutions_ solutions in search order.
+ */
+template <int N>
+template <typename S>
+std::uint64_t BasicPuzzleSolver<N>::search(const SolutionSink* sink,
+                                           SolverStats* stats) const
+{
+  const std::size_t depth = columns_.size();
+  const PieceStore& anchors = columns_[0];
+  const PieceStore& seconds = columns_[1];
+
+  std::vector<std::pair<Piece, Piece>> tasks;
+
+  for (auto a = cbegin(anchors); *a; ++a)
+    for (auto b = cbegin(seconds); *b; ++b)
+      if (!(*a & *b))
+        tasks.emplace_back(*a, *b);
+
+  std::size_t thread_count = thread_count_;
+
+  if (thread_count == 0)
+    thread_count = std::thread::hardware_concurrency();
+
+  thread_count = std::max<std::size_t>(1, std::min(thread_count, tasks.size()));
+
+  const std::uint64_t limit = (max_solutions_ > 0) ? max_solutions_
+                                                   : std::numeric_limits<std::uint64_t>::max();
+
+  std::unique_ptr<Output>    output;
+  std::vector<Worker<S>>     workers (thread_count, Worker<S>{depth});
+  std::atomic<std::size_t>   next_task {0};
+  std::atomic<std::uint64_t> found {0};
+
+  if (sink)
+    output = std::make_unique<Output>(*sink, tasks.size(), depth, limit);
+
+  const auto work = [this, &tasks, &output, &next_task, &found, limit](Worker<S>& worker)
+  {
+    worker.stats.start();
+    worker.output = output.get();
+    worker.limit  = limit;
+
+    while (found.load(std::memory_order_relaxed) < limit)
+    {
+      const std::size_t index = next_task.fetch_add(1, std::memory_order_relaxed);
+
+      if (index >= tasks.size())
+        break;
+
+      const auto& task = tasks[index];
+
+      worker.stats.task();
+      worker.state[0]  = task.first;
+      worker.state[1]  = task.second;
+      worker.task      = index;
+      worker.found     = 0;
+
+      if (columns_.size() > 2)
+        recurse(worker, 2, task.first | task.second);
+      else
+        store_solution(worker);
+
+      found.fetch_add(worker.found, std::memory_order_relaxed);
+
+      if (worker.output)
+        worker.output->finish(index);
+    }
+    worker.stats.stop();
+  };
+
+  if (thread_count > 1)
+  {
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+
+    for (std::size_t i = 1; i < thread_count; ++i)
+      threads.emplace_back(work, std::ref(workers[i]));
+
+    work(workers[0]);
+
+    for (auto& thread : threads)
+      thread.join();
+  }
+  else
+  {
+    work(workers[0]);
+  }
+
+  if (stats)
+  {
+    const std::size_t anchor_count = anchors.size() - 1;
+
+    // Account for the levels expanded up front.
+    stats->columns[0].nodes    = 1;
+    stats->columns[0].scanned  = anchor_count;
+    stats->columns[0].accepted = anchor_count;
+    stats->columns[1].nodes    = anchor_count;
+    stats->columns[1].scanned  = anchor_count * (seconds.size() - 1);
+    stats->columns[1].accepted = tasks.size();
+
+    for (const auto& worker : workers)
+      worker.stats.merge(*stats);
+  }
+
+  return std::min(found.load(), limit);
+}
+
+template <int N>
+template <typename S>
+void BasicPuzzleSolver<N>::recurse(Worker<S>& worker, std::size_t col, Piece cube) const
+{
+  const auto first = cbegin(columns_[col]);
+  auto row = first;
+
+  worker.stats.node(col);
+
+  for (;;)
+  {
+    Piece piece;
+    do
+    {
+      piece = *row;
+      ++row;
+    }
+    while (piece & cube);
+
+    if (!piece)
+      break;
+
+    worker.stats.accepted(col);
+    worker.state[col] = piece;
+
+    if (col < columns_.size() - 1)
+      recurse(worker, col + 1, cube | piece);
+    else
+      store_solution(worker);
+
+    if (worker.found >= worker.limit)
+    {
+      // The current placement has been scanned, the terminator has not.
+      worker.stats.scanned(col, row - first);
+      return;
+    }
+  }
+  // Do not count the zero terminator.
+  worker.stats.scanned(col, row - first - 1);
+}
+
+template <int N>
+template <typename S>
+void BasicPuzzleSolver<N>::store_solution(Worker<S>& worker) const
+{
+  ++worker.found;
+  worker.stats.solution();
+
+  if (worker.output)
+  {
+    // Store the pieces in the order they were passed in.
+    auto& part = worker.output->parts[worker.task];
+    const std::size_t base = part.size();
+    part.resize(base + worker.state.size());
+
+    for (std::size_t col = 0; col < worker.state.size(); ++col)
+      part[base + order_[col]] = worker.state[col];
+
+    worker.output->flush(worker.task);
+  }
+}
+
+template class BasicPuzzleSolver<3>;
+template class BasicPuzzleSolver<4>;
+
+PuzzleSolver::PuzzleSolver()
+:
+  solver_ {{cbegin(cube_piece_data), cend(cube_piece_data)}}
+{}
+
+PuzzleSolver::PuzzleSolver(std::vector<SomaBitCube> pieces)
+:
+  solver_ {std::move(pieces)}
+{}
+
+std::vector<SomaCube> PuzzleSolver::execute()
+{
+  const std::size_t piece_count = solver_.piece_count();
+  g_return_val_if_fail(piece_count > 0 && piece_count <= SomaCube::COUNT, std::vector<SomaCube>{});
+
+  return to_soma_cubes(solver_.execute(), piece_count);
+}
+
+std::vector<SomaCube> PuzzleSolver::execute(SolverStats& stats)
+{
+  const std::size_t piece_count = solver_.piece_count();
+  g_return_val_if_fail(piece_count > 0 && piece_count <= SomaCube::COUNT, std::vector<SomaCube>{});
+
+  return to_soma_cubes(solver_.execute(stats), piece_count);
+}
+
+std::string SolverStats::to_json() const
+{
+  std::ostringstream out;
+  out.imbue(std::locale::classic());
+
+  out << "{\n  \"solutions\": " << solutions
+      << ",\n  \"setup_time\": " << setup_seconds
+      << ",\n  \"search_time\": " << search_seconds
+      << ",\n  \"columns\": [";
+
+  for (std::size_t i = 0; i < columns.size(); ++i)
+  {
+    const Column& c = columns[i];
+    const double reject_rate = (c.scanned) ? 1. - double(c.accepted) / c.scanned : 0.;
+
+    out << ((i > 0) ? ",\n" : "\n")
+        << "    {\"depth\": " << i
+        << ", \"piece\": " << c.piece
+        << ", \"placements\": " << c.placements
+        << ", \"pruned_placements\": " << c.pruned
+        << ", \"nodes\": " << c.nodes
+        << ", \"scanned\": " << c.scanned
+        << ", \"accepted\": " << c.accepted
+        << ", \"rejected\": " << c.scanned - c.accepted
+        << ", \"reject_rate\": " << reject_rate << '}';
+  }
+  out << "\n  ],\n  \"threads\": [";
+
+  for (std::size_t i = 0; i < threads.size(); ++i)
+  {
+    const Thread& t = threads[i];
+
+    out << ((i > 0) ? ",\n" : "\n")
+        << "    {\"index\": " << i
+        << ", \"time\": " << t.seconds
+        << ", \"tasks\": " << t.tasks
+        << ", \"nodes\": " << t.nodes
+        << ", \"solutions\": " << t.solutions << '}';
+  }
+  out << "\n  ]\n}\n";
+
+  return out.str();
+}
+
+} // namespace Somato
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_PUZZLESOLVER_H_INCLUDED
+#define SOMATO_PUZZLESOLVER_H_INCLUDED
+
+#include "bitcube.h"
+#include "puzzlecube.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Somato
+{
+
+typedef BitCube<3>       SomaBitCube;
+typedef PuzzleCube<3, 7> SomaCube;
+
+/* The shapes of the Soma cube pieces, in the order of their meshes.
+ */
+extern const std::array<SomaBitCube, SomaCube::COUNT> cube_piece_data;
+
+/* Counters collected by the puzzle solver on request.  Column i refers
+ * to the i-th piece in solver order, which is also the search depth.
+ */
+struct SolverStats
+{
+  struct Column
+  {
+    std::size_t   piece      = 0; // index of the piece as passed in
+    std::uint64_t placements = 0; // candidate placements after setup
+    std::uint64_t pruned     = 0; // placements removed by the anchor filter
+    std::uint64_t nodes      = 0; // search nodes visited at this depth
+    std::uint64_t scanned    = 0; // candidates examined
+    std::uint64_t accepted   = 0; // candidates which did not overlap
+  };
+  struct Thread
+  {
+    double        seconds   = 0.;
+    std::uint64_t tasks     = 0; // subtrees searched
+    std::uint64_t nodes     = 0;
+    std::uint64_t solutions = 0;
+  };
+
+  std::vector<Column> columns;
+  std::vector<Thread> threads;
+  double              setup_seconds  = 0.;
+  double              search_seconds = 0.;
+  std::uint64_t       solutions      = 0;
+
+  std::string to_json() const;
+};
+
+/* Order in which the solver places the pieces.  With GIVEN, the first
+ * piece is the anchor and the rest follow in the order passed in.  With
+ * AUTOMATIC, the solver picks the anchor with the fewest placements up to
+ * rotation, followed by the other pieces in order of increasing number
+ * of placements.  Pieces which fit into the cube symmetrically are only
+ * picked as the anchor if all of them do, as otherwise some solutions
+ * would be reported in more than one orientation.
+ */
+enum class PieceOrder { GIVEN, AUTOMATIC };
+
+/* Exhaustive search for all distinct arrangements of a set of puzzle
+ * pieces within a cube of N^3 cells.  Solutions which are merely rotations
+ * of each other are excluded by restricting the anchor piece to a single
+ * orientation.  Each solution is returned as one cell mask per piece, in
+ * the order the pieces were passed in regardless of the search order.
+ */
+template <int N>
+class BasicPuzzleSolver
+{
+public:
+  typedef BitCube<N> Piece;
+
+  // Receives the piece_count() masks of each solution in the order the
+  // pieces were passed in.  The sink is called for one solution at a time,
+  // in search order, from whichever worker thread completes it.  It must
+  // not throw.
+  typedef std::function<void (const Piece* pieces)> SolutionSink;
+
+  // The pieces are expected to touch the lower bounds of each axis.
+  explicit BasicPuzzleSolver(std::vector<Piece> pieces);
+
+  std::size_t piece_count() const { return pieces_.size(); }
+
+  // Set the number of worker threads, or 0 for one per processor.
+  void set_thread_count(unsigned int count) { thread_count_ = count; }
+
+  void set_piece_order(PieceOrder order) { piece_order_ = order; }
+
+  // Stop after the first count solutions in search order, or never if 0.
+  void set_max_solutions(std::uint64_t count) { max_solutions_ = count; }
+
+  // Return the solutions as a flat array of piece_count() masks each.
+  std::vector<Piece> execute();
+  std::vector<Piece> execute(SolverStats& stats);
+
+  // Pass each solution to the sink as soon as it is final, and return
+  // the number of solutions.
+  std::uint64_t execute(const SolutionSink& sink);
+  std::uint64_t execute(const SolutionSink& sink, SolverStats& stats);
+
+  // Count the solutions without storing them.
+  std::uint64_t count();
+  std::uint64_t count(SolverStats& stats);
+
+  BasicPuzzleSolver(const BasicPuzzleSolver&) = delete;
+  BasicPuzzleSolver& operator=(const BasicPuzzleSolver&) = delete;
+
+private:
+  typedef std::vector<Piece> PieceStore;
+  struct Output;
+  template <typename S> struct Worker;
+
+  std::vector<Piece>       pieces_;
+  std::vector<PieceStore>  columns_;
+  std::vector<std::size_t> order_;   // piece index of each column
+  std::uint64_t            max_solutions_ = 0;
+  unsigned int             thread_count_  = 0;
+  PieceOrder               piece_order_   = PieceOrder::AUTOMATIC;
+
+  void setup(SolverStats* stats);
+  std::uint64_t run(const SolutionSink* sink, SolverStats* stats);
+  template <typename S> std::uint64_t search(const SolutionSink* sink,
+                                             SolverStats* stats) const;
+  template <typename S> void recurse(Worker<S>& worker, std::size_t col, Piece cube) const;
+  template <typename S> void store_solution(Worker<S>& worker) const;
+};
+
+extern template class BasicPuzzleSolver<3>;
+extern template class BasicPuzzleSolver<4>;
+
+/* Solver for puzzles of seven pieces in a cube of 3^3 cells, such as the
+ * Soma cube.  By default, the pieces of the Soma cube are used.
+ */
+class PuzzleSolver
+{
+public:
+  PuzzleSolver();
+  explicit PuzzleSolver(std::vector<SomaBitCube> pieces);
+
+  void set_thread_count(unsigned int count) { solver_.set_thread_count(count); }
+
+  std::vector<SomaCube> execute();
+  std::vector<SomaCube> execute(SolverStats& stats);
+
+private:
+  BasicPuzzleSolver<3> solver_;
+};
+
+} // namespace Somato
+
+#endif // !SOMATO_PUZZLESOLVER_H_INCLUDED
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "sceneloader.h"
+#include "meshtypes.h"
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+#include <giomm/resource.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace
+{
+
+using namespace Somato;
+
+Glib::RefPtr<const Glib::Bytes> lookup_resource(const char* name)
+{
+  const auto bytes = Gio::Resource::lookup_data_global(name);
+
+  if (!bytes)
+    throw SceneLoader::Error{Glib::ustring::compose("Resource %1 not found", name)};
+
+  return bytes;
+}
+
+/* Read a variable-length integer of 7 bits per byte.
+ */
+bool read_varint(const guint8*& pos, const guint8* end, guint32& value)
+{
+  value = 0;
+
+  for (int shift = 0; shift < 32 && pos < end; shift += 7)
+  {
+    const guint8 byte = *pos++;
+    value |= guint32{byte & 0x7Fu} << shift;
+
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool decode_indices(const guint8* pos, const guint8* end, guint8* dest, gsize count)
+{
+  guint32 index = 0;
+
+  for (gsize i = 0; i < count; ++i)
+  {
+    guint32 delta;
+
+    if (!read_varint(pos, end, delta))
+      return false;
+
+    index += zigzag_decode(delta);
+
+    const T value = index;
+    std::memcpy(dest + i * sizeof(T), &value, sizeof(T));
+  }
+  return (pos == end);
+}
+
+bool decode_vertices(const guint8* pos, const guint8* end, guint8* dest, gsize count)
+{
+  gint32 attribs[5] = {0, 0, 0, 0, 0};
+
+  for (gsize i = 0; i < count; ++i)
+  {
+    for (auto& attrib : attribs)
+    {
+      guint32 delta;
+
+      if (!read_varint(pos, end, delta))
+        return false;
+
+      attrib += zigzag_decode(delta);
+    }
+    guint8 *const vertex = dest + i * sizeof(MeshVertex);
+
+    for (int k = 0; k < 3; ++k)
+    {
+      const gint16 coord = attribs[k];
+      std::memcpy(vertex + offsetof(MeshVertex, position) + k * sizeof coord,
+                  &coord, sizeof coord);
+    }
+    vertex[offsetof(MeshVertex, normal)]     = attribs[3];
+    vertex[offsetof(MeshVertex, normal) + 1] = attribs[4];
+  }
+  return (pos == end);
+}
+
+/*
+ * Decode a single chunk of a compressed mesh data stream. The output
+ * is written front to back and never read, so that the destination may
+ * as well be a mapped buffer object.
+ */
+bool decode_mesh_chunk(const MeshStreamChunk& chunk, const guint8* source, guint8* dest)
+{
+  const guint8 *const end = source + chunk.encoded_size;
+
+  switch (chunk.encoding)
+  {
+    case MESH_CHUNK_RAW:
+      if (chunk.encoded_size != chunk.decoded_size)
+        return false;
+      std::memcpy(dest, source, chunk.decoded_size);
+      return true;
+    case MESH_CHUNK_INDICES16:
+      return (chunk.decoded_size % sizeof(MeshIndex) == 0)
+          && decode_indices<MeshIndex>(source, end, dest, chunk.decoded_size / sizeof(MeshIndex));
+    case MESH_CHUNK_INDICES32:
+      return (chunk.decoded_size % sizeof(MeshIndex32) == 0)
+          && decode_indices<MeshIndex32>(source, end, dest, chunk.decoded_size / sizeof(MeshIndex32));
+    case MESH_CHUNK_VERTICES:
+      return (chunk.decoded_size % sizeof(MeshVertex) == 0)
+          && decode_vertices(source, end, dest, chunk.decoded_size / sizeof(MeshVertex));
+  }
+  return false;
+}
+
+/*
+ * Decode mesh data resources stored as a compressed stream by the
+ * mesh baker. Raw data without the stream header is passed through.
+ */
+Glib::RefPtr<const Glib::Bytes> decode_mesh_stream(Glib::RefPtr<const Glib::Bytes> bytes)
+{
+  gsize size = 0;
+  const auto *const data = static_cast<const guint8*>(bytes->get_data(size));
+
+  MeshStreamHeader header;
+
+  if (size < sizeof header)
+    return bytes;
+
+  std::memcpy(&header, data, sizeof header);
+
+  if (header.magic != MESH_STREAM_MAGIC)
+    return bytes;
+
+  if (header.chunk_count > (size - sizeof header) / sizeof(MeshStreamChunk))
+    throw SceneLoader::Error{"Invalid mesh data stream"};
+
+  const gsize table_size = header.chunk_count * sizeof(MeshStreamChunk);
+
+  if (header.encoded_size != size - sizeof header - table_size)
+    throw SceneLoader::Error{"Invalid mesh data stream"};
+
+  const guint8 *const table   = data + sizeof header;
+  const guint8 *const encoded = table + table_size;
+
+  std::unique_ptr<guint8, decltype(&g_free)>
+    decoded {static_cast<guint8*>(g_malloc(header.decoded_size)), &g_free};
+  gsize decoded_end = 0;
+
+  for (guint32 i = 0; i < header.chunk_count; ++i)
+  {
+    MeshStreamChunk chunk;
+    std::memcpy(&chunk, table + i * sizeof chunk, sizeof chunk);
+
+    if (chunk.decoded_offset != decoded_end
+        || chunk.decoded_size > header.decoded_size - decoded_end
+        || chunk.encoded_offset > header.encoded_size
+        || chunk.encoded_size > header.encoded_size - chunk.encoded_offset
+        || !decode_mesh_chunk(chunk, encoded + chunk.encoded_offset,
+                              decoded.get() + chunk.decoded_offset))
+      throw SceneLoader::Error{Glib::ustring::compose("Invalid chunk %1 of mesh data stream", i)};
+
+    decoded_end += chunk.decoded_size;
+  }
+  if (decoded_end != header.decoded_size)
+    throw SceneLoader::Error{"Incomplete mesh data stream"};
+
+  return Glib::wrap(g_bytes_new_take(decoded.release(), header.decoded_size));
+}
+
+/* Check that all indices of an index array lie within the vertex
+ * range of the mesh, relative to its base vertex.
+ */
+template <typename T>
+bool check_index_range(const guint8* data, gsize count, unsigned int max_index)
+{
+  for (gsize i = 0; i < count; ++i)
+  {
+    T index;
+    std::memcpy(&index, data + i * sizeof(T), sizeof(T));
+
+    if (index > max_index)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Check that each mesh description refers to a valid range of the index
+ * array, and that all indices lie within the declared element range.
+ * Clusters must lie within the full detail level of their mesh.
+ */
+void validate_mesh_data(const SceneData& data)
+{
+  gsize desc_size = 0, vertices_size = 0, indices_size = 0, clusters_size = 0;
+
+  const auto *const desc    = static_cast<const MeshDesc*>(data.mesh_desc->get_data(desc_size));
+  const auto *const indices = static_cast<const guint8*>(data.mesh_indices->get_data(indices_size));
+  const auto *const clusters = static_cast<const MeshCluster*>(data.mesh_clusters->get_data(clusters_size));
+  data.mesh_vertices->get_data(vertices_size);
+
+  const gsize mesh_count   = desc_size     / sizeof(MeshDesc);
+  const gsize vertex_count = vertices_size / sizeof(MeshVertex);
+  const gsize cluster_count = clusters_size / sizeof(MeshCluster);
+
+  if (mesh_count == 0 || desc_size % sizeof(MeshDesc) != 0
+      || vertices_size % sizeof(MeshVertex) != 0 || indices_size % sizeof(MeshIndex) != 0
+      || clusters_size % sizeof(MeshCluster) != 0)
+    throw SceneLoader::Error{"Invalid mesh data size"};
+
+  for (gsize i = 0; i < mesh_count; ++i)
+  {
+    const MeshDesc& mesh = desc[i];
+
+    if (!(mesh.scale > 0.f)
+        || mesh.element_first > mesh.element_last || mesh.element_last >= vertex_count
+        || (mesh.index_size != sizeof(MeshIndex) && mesh.index_size != sizeof(MeshIndex32)))
+      throw SceneLoader::Error{Glib::ustring::compose("Invalid description of mesh %1", i)};
+
+    for (const MeshLod& lod : mesh.lod)
+    {
+      const gsize count = 3 * gsize{lod.triangle_count};
+
+      if (lod.indices_offset > indices_size || lod.indices_offset % mesh.index_size != 0
+          || count > (indices_size - lod.indices_offset) / mesh.index_size)
+        throw SceneLoader::Error{Glib::ustring::compose("Invalid index range of mesh %1", i)};
+
+      const guint8 *const first = indices + lod.indices_offset;
+      const unsigned int max_index = mesh.element_count() - 1;
+
+      if (!((mesh.index_size == sizeof(MeshIndex))
+            ? check_index_range<MeshIndex>(first, count, max_index)
+            : check_index_range<MeshIndex32>(first, count, max_index)))
+        throw SceneLoader::Error{Glib::ustring::compose("Element index out of range in mesh %1",
+                                                        i)};
+    }
+    if (mesh.cluster_first > cluster_count
+        || mesh.cluster_count > cluster_count - mesh.cluster_first)
+      throw SceneLoader::Error{Glib::ustring::compose("Invalid cluster range of mesh %1", i)};
+
+    for (unsigned int c = 0; c < mesh.cluster_count; ++c)
+    {
+      const MeshCluster& cluster = clusters[mesh.cluster_first + c];
+
+      if (cluster.triangle_first > mesh.lod[0].triangle_count
+          || cluster.triangle_count > mesh.lod[0].triangle_count - cluster.triangle_first)
+        throw SceneLoader::Error{Glib::ustring::compose("Invalid cluster %1 of mesh %2", c, i)};
+    }
+  }
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+SceneLoader::SceneLoader()
+{}
+
+SceneLoader::~SceneLoader()
+{
+  wait_finish();
+}
+
+SceneData SceneLoader::acquire_results()
+{
+  rethrow_any_error();
+  return std::move(data_);
+}
+
+void SceneLoader::execute()
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  data_.mesh_desc     = lookup_resource(RESOURCE_PREFIX "mesh-desc.bin");
+  data_.mesh_vertices = decode_mesh_stream(lookup_resource(RESOURCE_PREFIX "mesh-vertices.bin"));
+  data_.mesh_indices  = decode_mesh_stream(lookup_resource(RESOURCE_PREFIX "mesh-indices.bin"));
+  data_.mesh_clusters = lookup_resource(RESOURCE_PREFIX "mesh-clusters.bin");
+  data_.texture       = GL::parse_ktx_image(lookup_resource(RESOURCE_PREFIX "woodtexture.ktx"));
+
+  validate_mesh_data(data_);
+
+  const auto stop = std::chrono::steady_clock::now();
+  const std::chrono::duration<double, std::milli> elapsed = stop - start;
+
+  g_info("Scene data load time: %0.1f ms", elapsed.count());
+}
+
+} // namespace Somato
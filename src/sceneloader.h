@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_SCENELOADER_H_INCLUDED
+#define SOMATO_SCENELOADER_H_INCLUDED
+
+#include "asynctask.h"
+#include "gltexture.h"
+
+#include <glibmm/bytes.h>
+#include <stdexcept>
+#include <string>
+
+namespace Somato
+{
+
+/* Static cube scene data from the resource bundle.
+ */
+struct SceneData
+{
+  Glib::RefPtr<const Glib::Bytes> mesh_desc;
+  Glib::RefPtr<const Glib::Bytes> mesh_vertices;
+  Glib::RefPtr<const Glib::Bytes> mesh_indices;
+  Glib::RefPtr<const Glib::Bytes> mesh_clusters;
+  GL::CompressedImage             texture;
+};
+
+/*
+ * Fetch and validate the cube scene data on a worker thread, so that
+ * the main thread can set up the GL context and compile shaders in the
+ * meantime. The data is handed over to the GL thread for upload once
+ * the task is done.
+ */
+class SceneLoader : public Async::Task
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit Error(const std::string& message) : std::runtime_error(message) {}
+  };
+
+  SceneLoader();
+  virtual ~SceneLoader();
+
+  SceneData acquire_results();
+
+private:
+  void execute() override;
+
+  SceneData data_;
+};
+
+} // namespace Somato
+
+#endif // !SOMATO_SCENELOADER_H_INCLUDED
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "simd_dispatch.h"
+
+#if SOMATO_VECTOR_USE_AVX2
+# include <immintrin.h>
+
+/* The kernels in this file are compiled for AVX2 and FMA regardless of the
+ * baseline instruction set. They are only ever called through the dispatch
+ * table in simd_sse.cc, after the CPU features have been checked.
+ */
+#define SOMATO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+using Simd::V4f;
+
+namespace
+{
+
+/* Half precision reciprocal square root approximation followed by
+ * one fused Newton-Raphson iteration.
+ */
+SOMATO_TARGET_AVX2
+inline __m128 rsqrt4_fma(__m128 a)
+{
+  const __m128 x0    = _mm_rsqrt_ps(a);
+  const __m128 x0mh  = _mm_mul_ps(x0, _mm_set1_ps(-0.5f));
+  const __m128 m3axx = _mm_fmsub_ps(_mm_mul_ps(a, x0), x0, _mm_set1_ps(3.f));
+
+  return _mm_mul_ps(x0mh, m3axx);
+}
+
+} // anonymous namespace
+
+SOMATO_TARGET_AVX2
+V4f Simd::Avx2::norm4(V4f v)
+{
+  const __m128 d = dot4r(v, v);
+  return _mm_mul_ps(v, rsqrt4_fma(d));
+}
+
+SOMATO_TARGET_AVX2
+V4f Simd::Avx2::mat4_mul_mv(const V4f* a, V4f b)
+{
+  const __m128 c0 = _mm_mul_ps(_mm_permute_ps(b, _MM_SHUFFLE(0,0,0,0)), a[0]);
+  const __m128 c2 = _mm_mul_ps(_mm_permute_ps(b, _MM_SHUFFLE(2,2,2,2)), a[2]);
+
+  const __m128 s0 = _mm_fmadd_ps(_mm_permute_ps(b, _MM_SHUFFLE(1,1,1,1)), a[1], c0);
+  const __m128 s2 = _mm_fmadd_ps(_mm_permute_ps(b, _MM_SHUFFLE(3,3,3,3)), a[3], c2);
+
+  return _mm_add_ps(s0, s2);
+}
+
+/* Computes two result columns per iteration in 256-bit registers. Input a
+ * is loaded up front, so it may alias the result without restrictions.
+ * Input b may also alias the result, except that partial overlap is not
+ * allowed.
+ */
+SOMATO_TARGET_AVX2
+void Simd::Avx2::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
+{
+  const __m256 a0 = _mm256_broadcast_ps(&a[0]);
+  const __m256 a1 = _mm256_broadcast_ps(&a[1]);
+  const __m256 a2 = _mm256_broadcast_ps(&a[2]);
+  const __m256 a3 = _mm256_broadcast_ps(&a[3]);
+
+  for (int i = 0; i < 4; i += 2)
+  {
+    const __m256 bi = _mm256_loadu_ps(reinterpret_cast<const float*>(&b[i]));
+
+    const __m256 c0 = _mm256_mul_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(0,0,0,0)), a0);
+    const __m256 c2 = _mm256_mul_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(2,2,2,2)), a2);
+
+    const __m256 s0 = _mm256_fmadd_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(1,1,1,1)), a1, c0);
+    const __m256 s2 = _mm256_fmadd_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(3,3,3,3)), a3, c2);
+
+    _mm256_storeu_ps(reinterpret_cast<float*>(&result[i]), _mm256_add_ps(s0, s2));
+  }
+}
+
+/* Transforms eight vectors per iteration. The matrix elements are
+ * broadcast once up front.
+ */
+SOMATO_TARGET_AVX2
+void Simd::Avx2::mat4_mul_mv_batch(const V4f* a, const float* const* src,
+                                   float* const* dst, std::size_t count)
+{
+  __m256 m[4][4];
+
+  for (std::size_t c = 0; c < 4; ++c)
+    for (std::size_t r = 0; r < 4; ++r)
+      m[c][r] = _mm256_set1_ps(ref4s(a[c], r));
+
+  const std::size_t count8 = count & ~std::size_t{7};
+
+  for (std::size_t i = 0; i < count8; i += 8)
+  {
+    const __m256 x = _mm256_loadu_ps(src[0] + i);
+    const __m256 y = _mm256_loadu_ps(src[1] + i);
+    const __m256 z = _mm256_loadu_ps(src[2] + i);
+    const __m256 w = (src[3]) ? _mm256_loadu_ps(src[3] + i) : _mm256_set1_ps(1.f);
+
+    for (std::size_t r = 0; r < 4; ++r)
+      if (dst[r])
+      {
+        const __m256 s0 = _mm256_fmadd_ps(m[1][r], y, _mm256_mul_ps(m[0][r], x));
+        const __m256 s2 = _mm256_fmadd_ps(m[3][r], w, _mm256_mul_ps(m[2][r], z));
+
+        _mm256_storeu_ps(dst[r] + i, _mm256_add_ps(s0, s2));
+      }
+  }
+  mat4_mul_mv_scalar(a, src, dst, count8, count);
+}
+
+/* Same as mat4_mul_mm(), but over the columns of all matrices in input b
+ * as a single stream. The number of columns is always even.
+ */
+SOMATO_TARGET_AVX2
+void Simd::Avx2::mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result,
+                                   std::size_t count)
+{
+  const __m256 a0 = _mm256_broadcast_ps(&a[0]);
+  const __m256 a1 = _mm256_broadcast_ps(&a[1]);
+  const __m256 a2 = _mm256_broadcast_ps(&a[2]);
+  const __m256 a3 = _mm256_broadcast_ps(&a[3]);
+
+  for (std::size_t i = 0; i < 4 * count; i += 2)
+  {
+    const __m256 bi = _mm256_loadu_ps(reinterpret_cast<const float*>(&b[i]));
+
+    const __m256 c0 = _mm256_mul_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(0,0,0,0)), a0);
+    const __m256 c2 = _mm256_mul_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(2,2,2,2)), a2);
+
+    const __m256 s0 = _mm256_fmadd_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(1,1,1,1)), a1, c0);
+    const __m256 s2 = _mm256_fmadd_ps(_mm256_permute_ps(bi, _MM_SHUFFLE(3,3,3,3)), a3, c2);
+
+    _mm256_storeu_ps(reinterpret_cast<float*>(&result[i]), _mm256_add_ps(s0, s2));
+  }
+}
+
+/* Transposes two matrices per iteration, one in each 128-bit lane, and
+ * writes the 24 floats of both with three 256-bit stores.
+ */
+SOMATO_TARGET_AVX2
+void Simd::Avx2::mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count)
+{
+  const std::size_t count2 = count & ~std::size_t{1};
+
+  for (std::size_t i = 0; i < count2; i += 2)
+  {
+    const V4f *const p = &m[4 * i];
+
+    const __m256 c0 = _mm256_insertf128_ps(_mm256_castps128_ps256(p[0]), p[4], 1);
+    const __m256 c1 = _mm256_insertf128_ps(_mm256_castps128_ps256(p[1]), p[5], 1);
+    const __m256 c2 = _mm256_insertf128_ps(_mm256_castps128_ps256(p[2]), p[6], 1);
+    const __m256 c3 = _mm256_insertf128_ps(_mm256_castps128_ps256(p[3]), p[7], 1);
+
+    const __m256 t0 = _mm256_unpacklo_ps(c0, c1); // 00, 01, 10, 11
+    const __m256 t1 = _mm256_unpacklo_ps(c2, c3); // 02, 03, 12, 13
+    const __m256 t2 = _mm256_unpackhi_ps(c0, c1); // 20, 21, 30, 31
+    const __m256 t3 = _mm256_unpackhi_ps(c2, c3); // 22, 23, 32, 33
+
+    const __m256 r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1,0,1,0)); // 00, 01, 02, 03
+    const __m256 r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3,2,3,2)); // 10, 11, 12, 13
+    const __m256 r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1,0,1,0)); // 20, 21, 22, 23
+
+    float *const q = &result[12 * i];
+
+    _mm256_storeu_ps(q + 0,  _mm256_permute2f128_ps(r0, r1, 0x20));
+    _mm256_storeu_ps(q + 8,  _mm256_permute2f128_ps(r2, r0, 0x30));
+    _mm256_storeu_ps(q + 16, _mm256_permute2f128_ps(r1, r2, 0x31));
+  }
+  if (count2 < count)
+    Simd::Sse::mat4_transpose_3x4_batch(&m[4 * count2], &result[12 * count2], 1);
+}
+
+/* Same arrangement as the SSE version. With fused operations, the [oo]
+ * elements no longer cancel exactly, so they are cleared explicitly.
+ */
+SOMATO_TARGET_AVX2
+void Simd::Avx2::quat_to_matrix(V4f quat, V4f* result)
+{
+  const __m128 rxyz_t2 = _mm_add_ps(quat, quat);
+  const __m128 rxyz_p2 = _mm_mul_ps(quat, quat);
+
+  const __m128 ryzx    = _mm_permute_ps(quat, _MM_SHUFFLE(1,3,2,0));
+  const __m128 rzxy    = _mm_permute_ps(quat, _MM_SHUFFLE(2,1,3,0));
+  const __m128 rrrr_t2 = _mm_permute_ps(rxyz_t2, _MM_SHUFFLE(0,0,0,0));
+
+  const __m128 r2r_r2z_r2x_r2y = _mm_mul_ps(rrrr_t2, rzxy);
+
+  const __m128 rrrr_p2 = _mm_permute_ps(rxyz_p2, _MM_SHUFFLE(0,0,0,0));
+  const __m128 rzxy_p2 = _mm_permute_ps(rxyz_p2, _MM_SHUFFLE(2,1,3,0));
+
+  const __m128 rrrr2_rxyz2 = _mm_fmadd_ps(quat, quat, rrrr_p2);
+  const __m128 ryzx2_rzxy2 = _mm_fmadd_ps(ryzx, ryzx, rzxy_p2);
+  const __m128 xx_a1_b2_c0 = _mm_fmsub_ps(rxyz_t2, ryzx, r2r_r2z_r2x_r2y);
+  const __m128 nn_b0_c1_a2 = _mm_fmadd_ps(rxyz_t2, ryzx, r2r_r2z_r2x_r2y);
+  const __m128 xx_a0_b1_c2 = _mm_sub_ps(rrrr2_rxyz2, ryzx2_rzxy2);
+
+  const __m128 oo_a1_b2_c0 = _mm_blend_ps(xx_a1_b2_c0, _mm_setzero_ps(), 0x1);
+  const __m128 oo_a0_b1_c2 = _mm_blend_ps(xx_a0_b1_c2, _mm_setzero_ps(), 0x1);
+
+  result[3] = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+
+  const __m128 b1_c2_oo_a1 = _mm_shuffle_ps(oo_a0_b1_c2, oo_a1_b2_c0, _MM_SHUFFLE(1,0,3,2));
+  const __m128 b0_c1_oo_a0 = _mm_shuffle_ps(nn_b0_c1_a2, oo_a0_b1_c2, _MM_SHUFFLE(1,0,2,1));
+  const __m128 b2_c0_c1_a2 = _mm_movehl_ps(nn_b0_c1_a2, oo_a1_b2_c0);
+
+  result[1] = _mm_shuffle_ps(b1_c2_oo_a1, b0_c1_oo_a0, _MM_SHUFFLE(2,1,0,3));
+  result[0] = _mm_shuffle_ps(b0_c1_oo_a0, oo_a1_b2_c0, _MM_SHUFFLE(0,3,0,3));
+  result[2] = _mm_shuffle_ps(b2_c0_c1_a2, oo_a0_b1_c2, _MM_SHUFFLE(0,3,0,3));
+}
+
+SOMATO_TARGET_AVX2
+V4f Simd::Avx2::quat_mul(V4f a, V4f b)
+{
+  const __m128 a0 = _mm_permute_ps(a, _MM_SHUFFLE(0,0,0,0));
+  const __m128 a1 = _mm_permute_ps(a, _MM_SHUFFLE(3,2,1,1));
+  const __m128 a2 = _mm_permute_ps(a, _MM_SHUFFLE(1,3,2,2));
+  const __m128 a3 = _mm_permute_ps(a, _MM_SHUFFLE(2,1,3,3));
+
+  const __m128 b1 = _mm_permute_ps(b, _MM_SHUFFLE(0,0,0,1));
+  const __m128 b2 = _mm_permute_ps(b, _MM_SHUFFLE(2,1,3,2));
+  const __m128 b3 = _mm_permute_ps(b, _MM_SHUFFLE(1,3,2,3));
+
+  const __m128 c2 = _mm_mul_ps(a2, b2);
+  const __m128 c3 = _mm_mul_ps(a3, b3);
+
+  // Partially negate intermediate sum, as in the SSE version.
+  const __m128 rneg = _mm_set_ss(-0.f);
+
+  const __m128 c12 = _mm_fmadd_ps(a1, b1, c2);
+  const __m128 c03 = _mm_fmsub_ps(a0, b, c3);
+
+  return _mm_add_ps(_mm_xor_ps(c12, rneg), c03);
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_SIMD_DISPATCH_H_INCLUDED
+#define SOMATO_SIMD_DISPATCH_H_INCLUDED
+
+#include "simd_sse.h"
+
+namespace Simd
+{
+
+/* Scalar transformation of the vectors in the range [first, count) for the
+ * tail of mat4_mul_mv_batch().
+ */
+inline void mat4_mul_mv_scalar(const V4f* a, const float* const* src, float* const* dst,
+                               std::size_t first, std::size_t count)
+{
+  for (std::size_t i = first; i < count; ++i)
+  {
+    const float x = src[0][i];
+    const float y = src[1][i];
+    const float z = src[2][i];
+    const float w = (src[3]) ? src[3][i] : 1.f;
+
+    for (std::size_t r = 0; r < 4; ++r)
+      if (dst[r])
+        dst[r][i] = (ref4s(a[0], r) * x + ref4s(a[1], r) * y)
+                  + (ref4s(a[2], r) * z + ref4s(a[3], r) * w);
+  }
+}
+
+/* Baseline SSE implementations of the kernels selected at run time.
+ */
+namespace Sse
+{
+
+V4f  norm4(V4f v) G_GNUC_CONST;
+V4f  mat4_mul_mv(const V4f* a, V4f b) G_GNUC_PURE;
+void mat4_mul_mm(const V4f* a, const V4f* b, V4f* result);
+void mat4_mul_mv_batch(const V4f* a, const float* const* src, float* const* dst,
+                       std::size_t count);
+void mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result, std::size_t count);
+void mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count);
+void quat_to_matrix(V4f quat, V4f* result);
+V4f  quat_mul(V4f a, V4f b) G_GNUC_CONST;
+
+} // namespace Sse
+
+#if SOMATO_VECTOR_USE_AVX2
+
+/* AVX2 and FMA implementations of the kernels selected at run time.
+ * These must only be called if the CPU supports both extensions.
+ */
+namespace Avx2
+{
+
+V4f  norm4(V4f v) G_GNUC_CONST;
+V4f  mat4_mul_mv(const V4f* a, V4f b) G_GNUC_PURE;
+void mat4_mul_mm(const V4f* a, const V4f* b, V4f* result);
+void mat4_mul_mv_batch(const V4f* a, const float* const* src, float* const* dst,
+                       std::size_t count);
+void mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result, std::size_t count);
+void mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count);
+void quat_to_matrix(V4f quat, V4f* result);
+V4f  quat_mul(V4f a, V4f b) G_GNUC_CONST;
+
+} // namespace Avx2
+
+#endif
+
+} // namespace Simd
+
+#endif // !SOMATO_SIMD_DISPATCH_H_INCLUDED
@@ -23,6 +23,10 @@
 #include <cmath>
 #include <cstring>
 
+#if SOMATO_VECTOR_USE_NEON
+# include <arm_neon.h>
+#endif
+
 namespace
 {
 
@@ -36,6 +40,22 @@ inline void set_v4f(V4f& result, float x, float y, float z, float w)
   result[3] = w;
 }
 
+#if SOMATO_VECTOR_USE_NEON
+
+inline float32x4_t load4(const V4f& v)
+{
+  return vld1q_f32(v.data());
+}
+
+inline V4f store4(float32x4_t v)
+{
+  V4f result;
+  vst1q_f32(result.data(), v);
+  return result;
+}
+
+#endif
+
 } // anonymous namespace
 
 V4f Simd::cross3(const V4f& a, const V4f& b)
@@ -53,8 +73,15 @@ float Simd::mag4s(const V4f& v)
 
 V4f Simd::norm4(const V4f& v)
 {
+#if SOMATO_VECTOR_USE_NEON
+  const float32x4_t x = load4(v);
+  const float       d = std::sqrt(vaddvq_f32(vmulq_f32(x, x)));
+
+  return store4(vmulq_n_f32(x, 1.f / d));
+#else
   const float d = std::sqrt(dot4s(v, v));
   return mul4s(v, 1.f / d);
+#endif
 }
 
 void Simd::mat4_transpose(const V4f* m, V4f* result)
@@ -76,6 +103,15 @@ void Simd::mat4_transpose(const V4f* m, V4f* result)
 
 V4f Simd::mat4_mul_mv(const V4f* a, const V4f& b)
 {
+#if SOMATO_VECTOR_USE_NEON
+  const float32x4_t x  = load4(b);
+  const float32x4_t c0 = vmulq_laneq_f32(load4(a[0]), x, 0);
+  const float32x4_t c2 = vmulq_laneq_f32(load4(a[2]), x, 2);
+  const float32x4_t s0 = vfmaq_laneq_f32(c0, load4(a[1]), x, 1);
+  const float32x4_t s2 = vfmaq_laneq_f32(c2, load4(a[3]), x, 3);
+
+  return store4(vaddq_f32(s0, s2));
+#else
   const float b0 = b[0];
   const float b1 = b[1];
   const float b2 = b[2];
@@ -85,6 +121,7 @@ V4f Simd::mat4_mul_mv(const V4f* a, const V4f& b)
           (a[0][1] * b0 + a[1][1] * b1) + (a[2][1] * b2 + a[3][1] * b3),
           (a[0][2] * b0 + a[1][2] * b1) + (a[2][2] * b2 + a[3][2] * b3),
           (a[0][3] * b0 + a[1][3] * b1) + (a[2][3] * b2 + a[3][3] * b3)};
+#endif
 }
 
 V4f Simd::mat4_mul_vm(const V4f& a, const V4f* b)
@@ -95,10 +132,30 @@ V4f Simd::mat4_mul_vm(const V4f& a, const V4f* b)
 /* Either input may alias the result, except that partial overlap is not
  * allowed. In the rare case of input b aliasing result, an internal copy
  * will be made. This should only ever be needed when a matrix is squared
- * in place.
+ * in place. The NEON version keeps input a in registers and reads each
+ * column of b before writing the same column of the result, so it does
+ * not need the copy.
  */
 void Simd::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
 {
+#if SOMATO_VECTOR_USE_NEON
+  const float32x4_t a0 = load4(a[0]);
+  const float32x4_t a1 = load4(a[1]);
+  const float32x4_t a2 = load4(a[2]);
+  const float32x4_t a3 = load4(a[3]);
+
+  for (int i = 0; i < 4; ++i)
+  {
+    const float32x4_t bi = load4(b[i]);
+
+    const float32x4_t c0 = vmulq_laneq_f32(a0, bi, 0);
+    const float32x4_t c2 = vmulq_laneq_f32(a2, bi, 2);
+    const float32x4_t s0 = vfmaq_laneq_f32(c0, a1, bi, 1);
+    const float32x4_t s2 = vfmaq_laneq_f32(c2, a3, bi, 3);
+
+    vst1q_f32(result[i].data(), vaddq_f32(s0, s2));
+  }
+#else
   V4f temp[4];
 
   if (b == result)
@@ -119,6 +176,47 @@ void Simd::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
     result[2][i] = (a0i * b[2][0] + a1i * b[2][1]) + (a2i * b[2][2] + a3i * b[2][3]);
     result[3][i] = (a0i * b[3][0] + a1i * b[3][1]) + (a2i * b[3][2] + a3i * b[3][3]);
   }
+#endif
+}
+
+void Simd::mat4_mul_mv_batch(const V4f* a, const float* const* src, float* const* dst,
+                             std::size_t count)
+{
+  for (std::size_t r = 0; r < 4; ++r)
+  {
+    float *const out = dst[r];
+
+    if (!out)
+      continue;
+
+    const float a0r = a[0][r];
+    const float a1r = a[1][r];
+    const float a2r = a[2][r];
+    const float a3r = a[3][r];
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const float w = (src[3]) ? src[3][i] : 1.f;
+      out[i] = (a0r * src[0][i] + a1r * src[1][i]) + (a2r * src[2][i] + a3r * w);
+    }
+  }
+}
+
+/* Each column of the result depends only on the same column of input b,
+ * so unlike mat4_mul_mm(), no copy is needed if b aliases the result.
+ */
+void Simd::mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result, std::size_t count)
+{
+  for (std::size_t i = 0; i < 4 * count; ++i)
+    result[i] = mat4_mul_mv(a, b[i]);
+}
+
+void Simd::mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+    for (std::size_t r = 0; r < 3; ++r)
+      for (std::size_t c = 0; c < 4; ++c)
+        result[12 * i + 4 * r + c] = m[4 * i + c][r];
 }
 
 V4f Simd::quat_from_wedge(const V4f& a, const V4f& b)
@@ -174,12 +272,39 @@ void Simd::quat_to_matrix(const V4f& quat, V4f* result)
   result[3][3] = 1.f;
 }
 
+/* The NEON version multiplies permutations of b, with the signs folded in,
+ * by each component of a in turn:
+ * (ar * br, ar * bx, ar * by, ar * bz)
+ * + ax * (-bx, br, -bz, by)
+ * + ay * (-by, bz, br, -bx)
+ * + az * (-bz, -by, bx, br)
+ */
 V4f Simd::quat_mul(const V4f& a, const V4f& b)
 {
+#if SOMATO_VECTOR_USE_NEON
+  const float32x4_t p = load4(a);
+  const float32x4_t q = load4(b);
+
+  const float32x4_t q_xrzy = vrev64q_f32(q);
+  const float32x4_t q_yzrx = vextq_f32(q, q, 2);
+  const float32x4_t q_zyxr = vrev64q_f32(q_yzrx);
+
+  const float32x4_t s1 = {-1.f,  1.f, -1.f,  1.f};
+  const float32x4_t s2 = {-1.f,  1.f,  1.f, -1.f};
+  const float32x4_t s3 = {-1.f, -1.f,  1.f,  1.f};
+
+  const float32x4_t c0 = vmulq_laneq_f32(q, p, 0);
+  const float32x4_t c2 = vmulq_laneq_f32(vmulq_f32(q_yzrx, s2), p, 2);
+  const float32x4_t c1 = vfmaq_laneq_f32(c0, vmulq_f32(q_xrzy, s1), p, 1);
+  const float32x4_t c3 = vfmaq_laneq_f32(c2, vmulq_f32(q_zyxr, s3), p, 3);
+
+  return store4(vaddq_f32(c1, c3));
+#else
   return {(a[0] * b[0] - a[1] * b[1]) - (a[2] * b[2] + a[3] * b[3]),
           (a[0] * b[1] + a[1] * b[0]) + (a[2] * b[3] - a[3] * b[2]),
           (a[0] * b[2] + a[2] * b[0]) + (a[3] * b[1] - a[1] * b[3]),
           (a[0] * b[3] + a[3] * b[0]) + (a[1] * b[2] - a[2] * b[1])};
+#endif
 }
 
 V4f Simd::quat_inv(const V4f& q)
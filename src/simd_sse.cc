@@ -18,7 +18,7 @@
  */
 
 #include <config.h>
-#include "simd_sse.h"
+#include "simd_dispatch.h"
 
 #include <cmath>
 #include <cstddef>
@@ -53,7 +53,7 @@ inline V4f rsqrt4(V4f a)
 
 } // anonymous namespace
 
-V4f Simd::norm4(V4f v)
+V4f Simd::Sse::norm4(V4f v)
 {
   const __m128 d = dot4r(v, v);
   return _mm_mul_ps(v, rsqrt4(d));
@@ -77,7 +77,7 @@ void Simd::mat4_transpose(const V4f* m, V4f* result)
   result[3] = _mm_movehl_ps(t3, t2); // 30, 31, 32, 33
 }
 
-V4f Simd::mat4_mul_mv(const V4f* a, V4f b)
+V4f Simd::Sse::mat4_mul_mv(const V4f* a, V4f b)
 {
   const __m128 c0 = _mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0,0,0,0)), a[0]);
   const __m128 c1 = _mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1,1,1,1)), a[1]);
@@ -114,7 +114,7 @@ V4f Simd::mat4_mul_vm(V4f a, const V4f* b)
 /* Input a may alias the result without restrictions. Input b may also alias
  * the result, except that partial overlap is not allowed.
  */
-void Simd::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
+void Simd::Sse::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
 {
   const __m128 a0 = a[0];
   const __m128 a1 = a[1];
@@ -137,6 +137,69 @@ void Simd::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
   }
 }
 
+void Simd::Sse::mat4_mul_mv_batch(const V4f* a, const float* const* src,
+                                  float* const* dst, std::size_t count)
+{
+  const std::size_t count4 = count & ~std::size_t{3};
+
+  for (std::size_t i = 0; i < count4; i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(src[0] + i);
+    const __m128 y = _mm_loadu_ps(src[1] + i);
+    const __m128 z = _mm_loadu_ps(src[2] + i);
+    const __m128 w = (src[3]) ? _mm_loadu_ps(src[3] + i) : _mm_set1_ps(1.f);
+
+    for (std::size_t r = 0; r < 4; ++r)
+      if (dst[r])
+      {
+        const __m128 c0 = _mm_mul_ps(_mm_set1_ps(ref4s(a[0], r)), x);
+        const __m128 c1 = _mm_mul_ps(_mm_set1_ps(ref4s(a[1], r)), y);
+        const __m128 c2 = _mm_mul_ps(_mm_set1_ps(ref4s(a[2], r)), z);
+        const __m128 c3 = _mm_mul_ps(_mm_set1_ps(ref4s(a[3], r)), w);
+
+        _mm_storeu_ps(dst[r] + i, _mm_add_ps(_mm_add_ps(c0, c1), _mm_add_ps(c2, c3)));
+      }
+  }
+  mat4_mul_mv_scalar(a, src, dst, count4, count);
+}
+
+/* Each column of the result depends only on the same column of input b,
+ * so the batch is processed as a single stream of columns.
+ */
+void Simd::Sse::mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result,
+                                  std::size_t count)
+{
+  const __m128 a0 = a[0];
+  const __m128 a1 = a[1];
+  const __m128 a2 = a[2];
+  const __m128 a3 = a[3];
+
+  for (std::size_t i = 0; i < 4 * count; ++i)
+  {
+    const __m128 bi = b[i];
+
+    const __m128 c0 = _mm_mul_ps(_mm_shuffle_ps(bi, bi, _MM_SHUFFLE(0,0,0,0)), a0);
+    const __m128 c1 = _mm_mul_ps(_mm_shuffle_ps(bi, bi, _MM_SHUFFLE(1,1,1,1)), a1);
+    const __m128 c2 = _mm_mul_ps(_mm_shuffle_ps(bi, bi, _MM_SHUFFLE(2,2,2,2)), a2);
+    const __m128 c3 = _mm_mul_ps(_mm_shuffle_ps(bi, bi, _MM_SHUFFLE(3,3,3,3)), a3);
+
+    result[i] = _mm_add_ps(_mm_add_ps(c0, c1), _mm_add_ps(c2, c3));
+  }
+}
+
+void Simd::Sse::mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    V4f rows[4];
+    mat4_transpose(&m[4 * i], rows);
+
+    _mm_storeu_ps(&result[12 * i + 0], rows[0]);
+    _mm_storeu_ps(&result[12 * i + 4], rows[1]);
+    _mm_storeu_ps(&result[12 * i + 8], rows[2]);
+  }
+}
+
 float Simd::quat_angle(V4f quat)
 {
   const __m128 d = _mm_mul_ps(quat, quat);
@@ -204,7 +267,7 @@ V4f Simd::quat_from_axis(const V4f& a, float phi)
  *
  * It is assumed that 2*(r*r) is finite.
  */
-void Simd::quat_to_matrix(V4f quat, V4f* result)
+void Simd::Sse::quat_to_matrix(V4f quat, V4f* result)
 {
   const __m128 rxyz_t2 = _mm_add_ps(quat, quat);
   const __m128 rxyz_p2 = _mm_mul_ps(quat, quat);
@@ -243,7 +306,7 @@ void Simd::quat_to_matrix(V4f quat, V4f* result)
  * y = ar * by + ay * br + az * bx - ax * bz
  * z = ar * bz + az * br + ax * by - ay * bx
  */
-V4f Simd::quat_mul(V4f a, V4f b)
+V4f Simd::Sse::quat_mul(V4f a, V4f b)
 {
   const __m128 a0 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(0,0,0,0));
   const __m128 a1 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,2,1,1));
@@ -277,3 +340,90 @@ V4f Simd::quat_inv(V4f quat)
 
   return _mm_div_ps(c, d);
 }
+
+namespace
+{
+
+/* Table of the kernels selected at run time according to the CPU features.
+ */
+struct Kernels
+{
+  V4f  (*norm4)(V4f v);
+  V4f  (*mat4_mul_mv)(const V4f* a, V4f b);
+  void (*mat4_mul_mm)(const V4f* a, const V4f* b, V4f* result);
+  void (*mat4_mul_mv_batch)(const V4f* a, const float* const* src, float* const* dst,
+                            std::size_t count);
+  void (*mat4_mul_mm_batch)(const V4f* a, const V4f* b, V4f* result, std::size_t count);
+  void (*mat4_transpose_3x4_batch)(const V4f* m, float* result, std::size_t count);
+  void (*quat_to_matrix)(V4f quat, V4f* result);
+  V4f  (*quat_mul)(V4f a, V4f b);
+};
+
+Kernels select_kernels()
+{
+#if SOMATO_VECTOR_USE_AVX2
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {&Simd::Avx2::norm4, &Simd::Avx2::mat4_mul_mv, &Simd::Avx2::mat4_mul_mm,
+            &Simd::Avx2::mat4_mul_mv_batch, &Simd::Avx2::mat4_mul_mm_batch,
+            &Simd::Avx2::mat4_transpose_3x4_batch,
+            &Simd::Avx2::quat_to_matrix, &Simd::Avx2::quat_mul};
+#endif
+  return {&Simd::Sse::norm4, &Simd::Sse::mat4_mul_mv, &Simd::Sse::mat4_mul_mm,
+          &Simd::Sse::mat4_mul_mv_batch, &Simd::Sse::mat4_mul_mm_batch,
+          &Simd::Sse::mat4_transpose_3x4_batch,
+          &Simd::Sse::quat_to_matrix, &Simd::Sse::quat_mul};
+}
+
+/* Select the kernels on first use. This also covers calls made during
+ * static initialization of other translation units.
+ */
+inline const Kernels& kernels()
+{
+  static const Kernels table = select_kernels();
+  return table;
+}
+
+} // anonymous namespace
+
+V4f Simd::norm4(V4f v)
+{
+  return kernels().norm4(v);
+}
+
+V4f Simd::mat4_mul_mv(const V4f* a, V4f b)
+{
+  return kernels().mat4_mul_mv(a, b);
+}
+
+void Simd::mat4_mul_mm(const V4f* a, const V4f* b, V4f* result)
+{
+  kernels().mat4_mul_mm(a, b, result);
+}
+
+void Simd::mat4_mul_mv_batch(const V4f* a, const float* const* src, float* const* dst,
+                             std::size_t count)
+{
+  kernels().mat4_mul_mv_batch(a, src, dst, count);
+}
+
+void Simd::mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result, std::size_t count)
+{
+  kernels().mat4_mul_mm_batch(a, b, result, count);
+}
+
+void Simd::mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count)
+{
+  kernels().mat4_transpose_3x4_batch(m, result, count);
+}
+
+void Simd::quat_to_matrix(V4f quat, V4f* result)
+{
+  kernels().quat_to_matrix(quat, result);
+}
+
+V4f Simd::quat_mul(V4f a, V4f b)
+{
+  return kernels().quat_mul(a, b);
+}
@@ -127,6 +127,19 @@ V4f  mat4_mul_mv(const V4f* a, V4f b) G_GNUC_PURE;
 V4f  mat4_mul_vm(V4f a, const V4f* b) G_GNUC_PURE;
 void mat4_mul_mm(const V4f* a, const V4f* b, V4f* result);
 
+/* Batched kernels. The vectors transformed by mat4_mul_mv_batch() are in
+ * structure-of-arrays layout, with separate arrays for the x, y, z and w
+ * components. If the w array is null, w = 1 is assumed. Output arrays
+ * which are null are skipped. In mat4_mul_mm_batch(), input b may alias
+ * the result, but input a must not. mat4_transpose_3x4_batch() writes the
+ * first three rows of each matrix, i.e. 12 floats per matrix, which is the
+ * layout expected by glUniformMatrix3x4fv().
+ */
+void mat4_mul_mv_batch(const V4f* a, const float* const* src, float* const* dst,
+                       std::size_t count);
+void mat4_mul_mm_batch(const V4f* a, const V4f* b, V4f* result, std::size_t count);
+void mat4_transpose_3x4_batch(const V4f* m, float* result, std::size_t count);
+
 inline V4f quat_from_rv(float r, V4f v)
 {
   const __m128 q = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,1,0,3));
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "bitcube.h"
+#include "puzzledef.h"
+#include "puzzlesolver.h"
+
+#include <glib.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+/*
+ * Command-line frontend of the puzzle solver, for running solves without
+ * a display.  The puzzle is read from a definition file as described in
+ * puzzledef.h.  Without a file, the Soma cube is solved.
+ */
+namespace
+{
+
+using namespace Somato;
+
+enum class Mode   { COUNT, ENUMERATE, FIRST };
+enum class Format { TEXT, JSON, BINARY };
+
+int      option_size    = 0;
+char*    option_mode    = nullptr;
+char*    option_order   = nullptr;
+gint64   option_limit   = 1;
+char*    option_format  = nullptr;
+int      option_threads = 0;
+gboolean option_stats   = FALSE;
+char**   option_files   = nullptr;
+
+const GOptionEntry option_entries[] =
+{
+  {"size", 's', 0, G_OPTION_ARG_INT, &option_size,
+   "Override the edge length N of the cube to fill (3 or 4)", "N"},
+  {"mode", 'm', 0, G_OPTION_ARG_STRING, &option_mode,
+   "One of count, enumerate or first (default: enumerate)", "MODE"},
+  {"limit", 'n', 0, G_OPTION_ARG_INT64, &option_limit,
+   "Number of solutions to output in first mode", "COUNT"},
+  {"order", 'o', 0, G_OPTION_ARG_STRING, &option_order,
+   "Piece order, either given or auto (default: auto)", "ORDER"},
+  {"format", 'f', 0, G_OPTION_ARG_STRING, &option_format,
+   "One of text, json or binary (default: text)", "FORMAT"},
+  {"threads", 'j', 0, G_OPTION_ARG_INT, &option_threads,
+   "Number of worker threads, or 0 for one per processor", "COUNT"},
+  {"stats", '\0', 0, G_OPTION_ARG_NONE, &option_stats,
+   "Write solver statistics as JSON to standard error", nullptr},
+  {G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_FILENAME_ARRAY, &option_files,
+   nullptr, "[PUZZLEFILE]"},
+  {nullptr, '\0', 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr}
+};
+
+char piece_symbol(std::size_t index)
+{
+  static const char symbols[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+  return (index < sizeof symbols - 1) ? symbols[index] : '#';
+}
+
+/* Print a solution as N rows of the N layers along the x axis side by
+ * side, with one letter per piece and '.' for empty cells.  Solutions
+ * after the first are separated by an empty line.
+ */
+template <int N>
+void write_text(std::FILE* out, std::uint64_t index, const BitCube<N>* pieces, std::size_t count)
+{
+  std::fprintf(out, "%s# solution %" G_GUINT64_FORMAT "\n", (index > 0) ? "\n" : "", index + 1);
+
+  for (int y = 0; y < N; ++y)
+  {
+    std::string row;
+
+    for (int x = 0; x < N; ++x)
+    {
+      if (x > 0)
+        row += ' ';
+
+      for (int z = 0; z < N; ++z)
+      {
+        char symbol = '.';
+
+        for (std::size_t i = 0; i < count; ++i)
+          if (pieces[i].get(x, y, z))
+            symbol = piece_symbol(i);
+
+        row += symbol;
+      }
+    }
+    std::fprintf(out, "%s\n", row.c_str());
+  }
+}
+
+/* Print a solution as an element of the "solutions" array, which is an
+ * array of pieces, each of which is an array of x,y,z cell coordinates.
+ */
+template <int N>
+void write_json(std::FILE* out, std::uint64_t index, const BitCube<N>* pieces, std::size_t count)
+{
+  std::fputs((index > 0) ? ",\n    [" : "\n    [", out);
+
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::fputs((i > 0) ? ", [" : "[", out);
+    bool first = true;
+
+    for (int x = 0; x < N; ++x)
+      for (int y = 0; y < N; ++y)
+        for (int z = 0; z < N; ++z)
+          if (pieces[i].get(x, y, z))
+          {
+            std::fprintf(out, "%s[%d,%d,%d]", (first) ? "" : ",", x, y, z);
+            first = false;
+          }
+
+    std::fputc(']', out);
+  }
+  std::fputc(']', out);
+}
+
+/* Write a solution in the bit plane layout of PuzzleCube: for the k-th
+ * of ceil(log2(count + 1)) planes, bit N*N*x + N*y + z is set if bit k
+ * of the one-based index of the piece occupying that cell is set.  The
+ * planes are written as little-endian integers of N^3 bits rounded up
+ * to 32 or 64 bits.
+ */
+template <int N>
+void write_binary(std::FILE* out, const BitCube<N>* pieces, std::size_t count)
+{
+  const int depth = ilog2p1_(count);
+  const std::size_t plane_size = sizeof(CubeBits<N>);
+
+  for (int k = 0; k < depth; ++k)
+  {
+    CubeBits<N> plane = 0;
+
+    for (std::size_t i = 0; i < count; ++i)
+      if (((i + 1) >> k) & 1)
+        for (int x = 0; x < N; ++x)
+          for (int y = 0; y < N; ++y)
+            for (int z = 0; z < N; ++z)
+              if (pieces[i].get(x, y, z))
+                plane |= CubeBits<N>{1} << (N*N*x + N*y + z);
+
+    unsigned char bytes[sizeof plane];
+
+    for (std::size_t b = 0; b < plane_size; ++b)
+      bytes[b] = (plane >> (8 * b)) & 0xFF;
+
+    std::fwrite(bytes, 1, plane_size, out);
+  }
+}
+
+void write_count(std::FILE* out, Format format, int size, std::uint64_t count)
+{
+  switch (format)
+  {
+    case Format::TEXT:
+      std::fprintf(out, "%" G_GUINT64_FORMAT "\n", count);
+      break;
+    case Format::JSON:
+      std::fprintf(out, "{\n  \"size\": %d,\n  \"count\": %" G_GUINT64_FORMAT "\n}\n",
+                   size, count);
+      break;
+    case Format::BINARY:
+    {
+      unsigned char bytes[8];
+
+      for (int b = 0; b < 8; ++b)
+        bytes[b] = (count >> (8 * b)) & 0xFF;
+
+      std::fwrite(bytes, 1, sizeof bytes, out);
+      break;
+    }
+  }
+}
+
+template <int N>
+int solve(const PuzzleDefinition& definition, Mode mode, PieceOrder order, Format format)
+{
+  BasicPuzzleSolver<N> solver {definition.bit_cubes<N>()};
+
+  solver.set_thread_count(option_threads);
+  solver.set_piece_order(order);
+
+  if (mode == Mode::FIRST)
+    solver.set_max_solutions(option_limit);
+
+  SolverStats stats;
+
+  if (mode == Mode::COUNT)
+  {
+    const std::uint64_t count = (option_stats) ? solver.count(stats) : solver.count();
+    write_count(stdout, format, N, count);
+  }
+  else
+  {
+    // Write out each solution as soon as the solver has found it.  As the
+    // number of solutions is not known up front, the JSON "count" member
+    // follows the solutions array.
+    const std::size_t count = solver.piece_count();
+    std::uint64_t index = 0;
+
+    const auto sink = [format, count, &index](const BitCube<N>* pieces)
+    {
+      switch (format)
+      {
+        case Format::TEXT:   write_text<N>(stdout, index, pieces, count); break;
+        case Format::JSON:   write_json<N>(stdout, index, pieces, count); break;
+        case Format::BINARY: write_binary<N>(stdout, pieces, count);      break;
+      }
+      ++index;
+    };
+
+    if (format == Format::JSON)
+      std::fprintf(stdout, "{\n  \"size\": %d,\n  \"pieces\": %zu,\n  \"solutions\": [",
+                   N, count);
+
+    const std::uint64_t total = (option_stats) ? solver.execute(sink, stats)
+                                               : solver.execute(sink);
+    if (format == Format::JSON)
+      std::fprintf(stdout, "\n  ],\n  \"count\": %" G_GUINT64_FORMAT "\n}\n", total);
+  }
+  if (option_stats)
+    std::fputs(stats.to_json().c_str(), stderr);
+
+  return 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  GOptionContext *const context = g_option_context_new("- solve puzzle cubes");
+  g_option_context_add_main_entries(context, option_entries, nullptr);
+
+  GError* error = nullptr;
+  const gboolean parsed = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+
+  const std::unique_ptr<char[], decltype(&g_free)> mode_del {option_mode, &g_free};
+  const std::unique_ptr<char[], decltype(&g_free)> order_del {option_order, &g_free};
+  const std::unique_ptr<char[], decltype(&g_free)> format_del {option_format, &g_free};
+  const std::unique_ptr<char*[], decltype(&g_strfreev)> files_del {option_files, &g_strfreev};
+
+  if (!parsed)
+  {
+    std::fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+  Mode mode = Mode::ENUMERATE;
+
+  if (option_mode && std::strcmp(option_mode, "count") == 0)
+    mode = Mode::COUNT;
+  else if (option_mode && std::strcmp(option_mode, "first") == 0)
+    mode = Mode::FIRST;
+  else if (option_mode && std::strcmp(option_mode, "enumerate") != 0)
+  {
+    std::fprintf(stderr, "Unknown mode \"%s\"\n", option_mode);
+    return 1;
+  }
+  PieceOrder order = PieceOrder::AUTOMATIC;
+
+  if (option_order && std::strcmp(option_order, "given") == 0)
+    order = PieceOrder::GIVEN;
+  else if (option_order && std::strcmp(option_order, "auto") != 0)
+  {
+    std::fprintf(stderr, "Unknown piece order \"%s\"\n", option_order);
+    return 1;
+  }
+  Format format = Format::TEXT;
+
+  if (option_format && std::strcmp(option_format, "json") == 0)
+    format = Format::JSON;
+  else if (option_format && std::strcmp(option_format, "binary") == 0)
+    format = Format::BINARY;
+  else if (option_format && std::strcmp(option_format, "text") != 0)
+  {
+    std::fprintf(stderr, "Unknown output format \"%s\"\n", option_format);
+    return 1;
+  }
+  if (mode == Mode::FIRST && option_limit < 1)
+  {
+    std::fprintf(stderr, "The solution limit must be positive\n");
+    return 1;
+  }
+  if (option_threads < 0)
+  {
+    std::fprintf(stderr, "The thread count must not be negative\n");
+    return 1;
+  }
+  if (option_files && option_files[0] && option_files[1])
+  {
+    std::fprintf(stderr, "Only one puzzle file may be specified\n");
+    return 1;
+  }
+  try
+  {
+    PuzzleDefinition definition = (option_files && option_files[0])
+                                  ? PuzzleDefinition::load(option_files[0])
+                                  : PuzzleDefinition::soma_cube();
+    if (option_size > 0)
+      definition.set_size(option_size);
+
+    switch (definition.size())
+    {
+      case 3: return solve<3>(definition, mode, order, format);
+      case 4: return solve<4>(definition, mode, order, format);
+    }
+    std::fprintf(stderr, "Unsupported cube size %d\n", definition.size());
+  }
+  catch (const PuzzleDefinition::Error& error)
+  {
+    std::fprintf(stderr, "%s\n", error.what());
+  }
+  return 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "bitcube.h"
+#include "puzzlesolver.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*
+ * Regression tests of the puzzle solver, run by "make check".  Each test
+ * prints a message for every failed check, and the program exits with a
+ * non-zero status if any check failed.
+ */
+namespace
+{
+
+using namespace Somato;
+
+typedef BitCube<3> Piece;
+
+struct Cell { int x, y, z; };
+
+int failures = 0;
+
+void check_equal(const char* what, std::uint64_t value, std::uint64_t expected)
+{
+  if (value != expected)
+  {
+    std::fprintf(stderr, "%s is %llu, expected %llu\n", what,
+                 static_cast<unsigned long long>(value),
+                 static_cast<unsigned long long>(expected));
+    ++failures;
+  }
+}
+
+void check_column(std::size_t col, const char* what,
+                  std::uint64_t value, std::uint64_t expected)
+{
+  char label[64];
+  std::snprintf(label, sizeof label, "Column %zu %s", col, what);
+
+  check_equal(label, value, expected);
+}
+
+Piece make_piece(const std::vector<Cell>& cells)
+{
+  Piece piece;
+
+  for (const auto& cell : cells)
+    piece.put(cell.x, cell.y, cell.z, true);
+
+  return piece;
+}
+
+SolverStats count_with_limit(const std::vector<Piece>& pieces, std::uint64_t limit)
+{
+  BasicPuzzleSolver<3> solver {pieces};
+
+  solver.set_thread_count(1);
+  solver.set_piece_order(PieceOrder::GIVEN);
+  solver.set_max_solutions(limit);
+
+  SolverStats stats;
+  solver.count(stats);
+
+  return stats;
+}
+
+const std::vector<Piece> single_solution_pieces
+{
+  make_piece({{0,0,0}, {0,0,1}, {0,1,0}, {0,2,0}, {1,0,0}, {1,1,0}, {1,2,0}, {2,0,0}}),
+  make_piece({{0,1,1}, {1,0,1}, {1,1,1}, {1,1,2}, {2,1,0}, {2,1,1}, {2,2,0}, {2,2,1}}),
+  make_piece({{0,2,0}, {0,2,1}, {1,2,0}, {1,2,1}, {2,0,1}, {2,1,1}, {2,2,1}})
+};
+
+/* The only solution of this piece set is found on the very last placement
+ * the search examines.  A search stopped at the first solution therefore
+ * ends at the same point as the complete search, and has to report the
+ * same number of placements examined and accepted at each depth.
+ */
+void test_stats_at_limit()
+{
+  const auto& pieces = single_solution_pieces;
+  const SolverStats complete = count_with_limit(pieces, 0);
+  const SolverStats limited  = count_with_limit(pieces, 1);
+
+  check_equal("Solution count", complete.solutions, 1);
+  check_equal("Solution count at limit", limited.solutions, 1);
+
+  for (std::size_t col = 0; col < pieces.size(); ++col)
+  {
+    const auto& stats    = limited.columns[col];
+    const auto& expected = complete.columns[col];
+
+    check_column(col, "nodes",    stats.nodes,    expected.nodes);
+    check_column(col, "scanned",  stats.scanned,  expected.scanned);
+    check_column(col, "accepted", stats.accepted, expected.accepted);
+  }
+}
+
+/* Solutions of puzzles with fewer than seven pieces are packed into the
+ * Soma cube representation with the remaining pieces left empty.
+ */
+void test_soma_cube_packing()
+{
+  const auto& pieces = single_solution_pieces;
+
+  BasicPuzzleSolver<3> flat_solver {pieces};
+  flat_solver.set_thread_count(1);
+
+  PuzzleSolver solver {pieces};
+  solver.set_thread_count(1);
+
+  const std::vector<Piece>    expected  = flat_solver.execute();
+  const std::vector<SomaCube> solutions = solver.execute();
+
+  check_equal("Packed solution count", solutions.size(), expected.size() / pieces.size());
+
+  if (solutions.empty())
+    return;
+
+  for (std::size_t i = 0; i < SomaCube::COUNT; ++i)
+  {
+    const Piece piece = (i < pieces.size()) ? expected[i] : Piece{};
+
+    if (solutions[0][i] != piece)
+    {
+      std::fprintf(stderr, "Packed piece %zu differs from the solver output\n", i);
+      ++failures;
+    }
+  }
+}
+
+} // anonymous namespace
+
+int main()
+{
+  test_stats_at_limit();
+  test_soma_cube_packing();
+
+  return (failures == 0) ? 0 : 1;
+}
@@ -17,15 +17,25 @@
  * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "meshcompress.h"
 #include "meshloader.h"
+#include "meshoptimize.h"
+#include "meshsimplify.h"
 #include "meshtypes.h"
 
 #include <glib.h>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 #include <cstddef>
+#include <cstring>
 
 namespace
 {
@@ -35,16 +45,22 @@ using MeshNodes = std::vector<MeshLoader::Node>;
 
 char*    mesh_filename = nullptr;
 char*    out_dirname   = nullptr;
+char*    cache_dirname = nullptr;
 char**   mesh_names    = nullptr;
 gboolean byte_order_be = FALSE;
 gboolean byte_order_le = FALSE;
+gboolean compress_data = FALSE;
 
 const GOptionEntry option_entries[] =
 {
   {"mesh-file",  'f', 0, G_OPTION_ARG_FILENAME, &mesh_filename, "Mesh data FILE", "FILE"},
   {"output-dir", 'd', 0, G_OPTION_ARG_FILENAME, &out_dirname, "Output DIRECTORY", "DIRECTORY"},
+  {"cache-dir",  'c', 0, G_OPTION_ARG_FILENAME, &cache_dirname,
+   "Cache processed meshes in DIRECTORY", "DIRECTORY"},
   {"be", 'b', 0, G_OPTION_ARG_NONE, &byte_order_be, "Output big-endian data",    nullptr},
   {"le", 'l', 0, G_OPTION_ARG_NONE, &byte_order_le, "Output little-endian data", nullptr},
+  {"compress", 'z', 0, G_OPTION_ARG_NONE, &compress_data,
+   "Compress vertex and index data", nullptr},
   {G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_STRING_ARRAY, &mesh_names, nullptr, "MESH..."},
   {nullptr, '\0', 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr}
 };
@@ -67,7 +83,9 @@ void generate_grid_vertices(MeshVertex* vertices)
     for (int y = 0; y < N; ++y)
       for (int x = 0; x < N; ++x)
       {
-        pv->set(stride[x], stride[y], stride[z]);
+        pv->set(stride[x] / grid_position_scale,
+                stride[y] / grid_position_scale,
+                stride[z] / grid_position_scale);
         ++pv;
       }
 }
@@ -94,67 +112,550 @@ void generate_grid_indices(MeshIndex* indices)
       }
 }
 
-bool fill_mesh_data(const MeshLoader& loader, const MeshNodes& nodes,
-                    std::vector<MeshDesc>&   mesh_desc,
-                    std::vector<MeshVertex>& mesh_vertices,
-                    std::vector<MeshIndex>&  mesh_indices)
+/*
+ * Size of the FIFO vertex cache used for reporting statistics.
+ */
+const unsigned int stats_cache_size = 16;
+
+/*
+ * Permitted increase of the cache miss ratio by overdraw optimization.
+ */
+const float overdraw_threshold = 1.05;
+
+/*
+ * Maximum number of triangles per cluster of the full detail level.
+ */
+const unsigned int cluster_max_triangles = 128;
+
+/*
+ * Minimum cosine of the normal cone half-angle of a cluster. Wider cones
+ * are rarely back-facing as a whole, so a new cluster is started instead.
+ */
+const float cluster_min_cone_cutoff = 0.5;
+
+/*
+ * Target triangle count relative to the full detail mesh, and maximum
+ * squared error relative to the squared mesh extent, for each simplified
+ * level of detail.
+ */
+const struct
 {
-  mesh_desc.reserve(nodes.size());
+  float triangle_ratio;
+  float max_error;
+}
+lod_targets[MESH_LOD_COUNT - 1] =
+{
+  {0.5,  1e-4},
+  {0.2,  2e-3}
+};
+
+/* Optimize the order of triangles and vertices of a single mesh for
+ * vertex cache efficiency, overdraw and vertex fetch locality.
+ */
+void optimize_mesh(std::ostream& log, const char* name, std::vector<SourceIndex>& indices,
+                   std::vector<SourceVertex>& vertices)
+{
+  const auto before = analyze_vertex_cache(indices, vertices.size(), stats_cache_size);
+
+  optimize_vertex_cache(indices, vertices.size());
+  optimize_overdraw(indices, vertices, overdraw_threshold);
+  optimize_vertex_fetch(indices, vertices);
+
+  const auto after = analyze_vertex_cache(indices, vertices.size(), stats_cache_size);
+
+  log << name << ": " << indices.size() / 3 << " triangles, "
+            << vertices.size() << " vertices, " << std::fixed << std::setprecision(3)
+            << "ACMR " << before.acmr << " -> " << after.acmr << ", "
+            << "ATVR " << before.atvr << " -> " << after.atvr << '\n';
+}
+
+/* Quantize mesh vertices to the range of signed normalized 16-bit
+ * integers, and record the inverse mapping in the mesh description.
+ * The scale is uniform across all axes so that normals do not need to
+ * be corrected for it.
+ */
+void quantize_mesh_vertices(const std::vector<SourceVertex>& source,
+                            MeshDesc& mesh, MeshVertex* vertices)
+{
+  float lower[3] = { G_MAXFLOAT,  G_MAXFLOAT,  G_MAXFLOAT};
+  float upper[3] = {-G_MAXFLOAT, -G_MAXFLOAT, -G_MAXFLOAT};
+
+  for (const auto& v : source)
+    for (int i = 0; i < 3; ++i)
+    {
+      lower[i] = std::min(lower[i], v.position[i]);
+      upper[i] = std::max(upper[i], v.position[i]);
+    }
+
+  float extent = 0.f;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    mesh.bias[i] = 0.5f * (lower[i] + upper[i]);
+    extent = std::max(extent, 0.5f * (upper[i] - lower[i]));
+  }
+  mesh.scale = (extent > 0.f) ? extent : 1.f;
+
+  const float inv_scale = 1.f / mesh.scale;
+
+  for (std::size_t i = 0; i < source.size(); ++i)
+  {
+    const auto& v = source[i];
+
+    vertices[i].set((v.position[0] - mesh.bias[0]) * inv_scale,
+                    (v.position[1] - mesh.bias[1]) * inv_scale,
+                    (v.position[2] - mesh.bias[2]) * inv_scale,
+                    v.normal[0], v.normal[1], v.normal[2]);
+  }
+}
+
+/* Generate the simplified levels of detail of a mesh from the
+ * optimized full detail triangle list in lods[0].
+ */
+void build_mesh_lods(std::ostream& log, const char* name, float extent,
+                     const std::vector<SourceVertex>& vertices,
+                     std::vector<SourceIndex>* lods)
+{
+  const std::size_t full_count = lods[0].size() / 3;
+
+  for (int level = 1; level < MESH_LOD_COUNT; ++level)
+  {
+    const auto& target = lod_targets[level - 1];
+
+    lods[level] = simplify_mesh(lods[level - 1], vertices,
+                                std::lrint(target.triangle_ratio * full_count),
+                                target.max_error * extent * extent);
+    optimize_vertex_cache(lods[level], vertices.size());
+
+    const auto stats = analyze_vertex_cache(lods[level], vertices.size(), stats_cache_size);
+
+    log << name << " LOD " << level << ": " << lods[level].size() / 3
+        << " triangles, " << std::fixed << std::setprecision(3)
+        << "ACMR " << stats.acmr << '\n';
+  }
+}
+
+/* Processed mesh of a single node, with indices relative to the
+ * first vertex of the mesh.
+ */
+struct NodeMesh
+{
+  std::vector<MeshVertex>  vertices;
+  std::vector<SourceIndex> lods[MESH_LOD_COUNT];
+  std::vector<MeshCluster> clusters;
+  MeshDesc                 desc {}; // only scale and bias are set
+  std::string              log;
+};
+
+/* Header of a cached processed mesh, followed by the vertices, the
+ * indices of each level of detail and the clusters in host byte order.
+ */
+struct CacheHeader
+{
+  guint32 magic;
+  guint32 vertex_count;
+  guint32 index_counts[MESH_LOD_COUNT];
+  guint32 cluster_count;
+  float   scale;
+  float   bias[3];
+};
+
+/*
+ * Tag of the cache format and processing pipeline. Change this whenever
+ * the processing changes in a way not captured by the parameters which
+ * are hashed along with the source data.
+ */
+const guint32 cache_magic = 0x534D4334; // "SMC4"
+
+/* Compute the cache key of a mesh from its source data and the
+ * processing parameters.
+ */
+std::string compute_cache_key(const std::vector<SourceVertex>& vertices,
+                              const std::vector<SourceIndex>& indices)
+{
+  GChecksum *const checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+  const auto update = [checksum](const void* data, std::size_t size)
+  {
+    g_checksum_update(checksum, static_cast<const guchar*>(data), size);
+  };
+  update(&cache_magic, sizeof cache_magic);
+  update(&stats_cache_size, sizeof stats_cache_size);
+  update(&overdraw_threshold, sizeof overdraw_threshold);
+  update(lod_targets, sizeof lod_targets);
+  update(&cluster_max_triangles, sizeof cluster_max_triangles);
+  update(&cluster_min_cone_cutoff, sizeof cluster_min_cone_cutoff);
+  update(vertices.data(), vertices.size() * sizeof(SourceVertex));
+  update(indices.data(), indices.size() * sizeof(SourceIndex));
+
+  std::string key = g_checksum_get_string(checksum);
+  g_checksum_free(checksum);
+
+  return key;
+}
+
+std::string get_cache_filename(const std::string& key)
+{
+  char *const filename = g_build_filename(cache_dirname, (key + ".mesh").c_str(), nullptr);
+  std::string result = filename;
+  g_free(filename);
+
+  return result;
+}
+
+bool read_cached_mesh(const std::string& key, NodeMesh& mesh)
+{
+  gchar* contents = nullptr;
+  gsize  length   = 0;
+
+  if (!g_file_get_contents(get_cache_filename(key).c_str(), &contents, &length, nullptr))
+    return false;
+
+  const std::unique_ptr<gchar[], decltype(&g_free)> contents_del {contents, &g_free};
+  CacheHeader header;
+
+  if (length < sizeof header)
+    return false;
+
+  std::memcpy(&header, contents, sizeof header);
+
+  std::size_t expected = sizeof header + header.vertex_count * sizeof(MeshVertex);
+
+  for (const auto count : header.index_counts)
+    expected += count * sizeof(SourceIndex);
+
+  expected += header.cluster_count * sizeof(MeshCluster);
+
+  if (header.magic != cache_magic || length != expected)
+    return false;
+
+  const char* pos = contents + sizeof header;
+
+  mesh.vertices.resize(header.vertex_count);
+  std::memcpy(mesh.vertices.data(), pos, header.vertex_count * sizeof(MeshVertex));
+  pos += header.vertex_count * sizeof(MeshVertex);
+
+  for (int level = 0; level < MESH_LOD_COUNT; ++level)
+  {
+    auto& indices = mesh.lods[level];
+
+    indices.resize(header.index_counts[level]);
+    std::memcpy(indices.data(), pos, indices.size() * sizeof(SourceIndex));
+    pos += indices.size() * sizeof(SourceIndex);
+  }
+  mesh.clusters.resize(header.cluster_count);
+  std::memcpy(mesh.clusters.data(), pos, header.cluster_count * sizeof(MeshCluster));
+
+  mesh.desc.scale = header.scale;
+  std::copy(std::begin(header.bias), std::end(header.bias), mesh.desc.bias);
+
+  return true;
+}
+
+void write_cached_mesh(const std::string& key, const NodeMesh& mesh)
+{
+  CacheHeader header {};
+
+  header.magic        = cache_magic;
+  header.vertex_count = mesh.vertices.size();
+  header.cluster_count = mesh.clusters.size();
+  header.scale        = mesh.desc.scale;
+  std::copy(std::begin(mesh.desc.bias), std::end(mesh.desc.bias), header.bias);
+
+  for (int level = 0; level < MESH_LOD_COUNT; ++level)
+    header.index_counts[level] = mesh.lods[level].size();
+
+  std::string contents (reinterpret_cast<const char*>(&header), sizeof header);
+
+  contents.append(reinterpret_cast<const char*>(mesh.vertices.data()),
+                  mesh.vertices.size() * sizeof(MeshVertex));
+
+  for (const auto& indices : mesh.lods)
+    contents.append(reinterpret_cast<const char*>(indices.data()),
+                    indices.size() * sizeof(SourceIndex));
+
+  contents.append(reinterpret_cast<const char*>(mesh.clusters.data()),
+                  mesh.clusters.size() * sizeof(MeshCluster));
+
+  // A failure to update the cache is not fatal.
+  GError* error = nullptr;
+
+  if (!g_file_set_contents(get_cache_filename(key).c_str(),
+                           contents.data(), contents.size(), &error))
+  {
+    std::cerr << error->message << std::endl;
+    g_error_free(error);
+  }
+}
+
+/* Load, optimize, quantize and simplify the mesh of a single node,
+ * or fetch the result from the cache if the source is unchanged.
+ */
+bool process_mesh_node(const MeshLoader& loader, MeshLoader::Node node,
+                       const char* name, NodeMesh& mesh)
+{
+  const auto counts = loader.count_node_vertices_triangles(node);
 
-  unsigned int total_vertices = GRID_VERTEX_COUNT;
-  unsigned int indices_offset = aligned_index_count(GRID_LINE_COUNT * 2);
+  if (counts.first <= 0 || counts.second <= 0)
+    return false;
+
+  std::vector<SourceVertex> source (counts.first);
+  loader.get_node_vertices(node, &source[0], source.size());
+
+  auto& lods = mesh.lods;
+  lods[0].resize(3 * counts.second);
+
+  if (loader.get_node_indices(node, 0, &lods[0][0], lods[0].size()) != lods[0].size())
+    return false;
+
+  std::string key;
 
-  for (const auto node : nodes)
+  if (cache_dirname)
   {
-    const auto counts = loader.count_node_vertices_triangles(node);
+    key = compute_cache_key(source, lods[0]);
+
+    if (read_cached_mesh(key, mesh))
+    {
+      mesh.log = std::string{name} + ": unchanged, using cached result\n";
+      return true;
+    }
+  }
+  std::ostringstream log;
+
+  optimize_mesh(log, name, lods[0], source);
+
+  mesh.vertices.resize(source.size());
+  quantize_mesh_vertices(source, mesh.desc, &mesh.vertices[0]);
+
+  build_mesh_lods(log, name, mesh.desc.scale, source, lods);
+
+  mesh.clusters = build_mesh_clusters(lods[0], source, cluster_max_triangles,
+                                      cluster_min_cone_cutoff);
+
+  const auto stats = analyze_vertex_cache(lods[0], source.size(), stats_cache_size);
+
+  log << name << ": " << mesh.clusters.size() << " clusters, "
+      << std::fixed << std::setprecision(3) << "ACMR " << stats.acmr << '\n';
+
+  mesh.log = log.str();
+
+  if (cache_dirname)
+    write_cached_mesh(key, mesh);
+
+  return true;
+}
+
+/* Process the mesh nodes on a pool of worker threads, one node
+ * at a time per thread.
+ */
+bool process_mesh_nodes(const MeshLoader& loader, const MeshNodes& nodes,
+                        std::vector<NodeMesh>& meshes)
+{
+  meshes.resize(nodes.size());
+
+  std::unique_ptr<bool[]> success {new bool[nodes.size()]()};
+  std::atomic<std::size_t> next_node {0};
+
+  const auto worker = [&]
+  {
+    std::size_t i;
+    while ((i = next_node++) < nodes.size())
+      success[i] = process_mesh_node(loader, nodes[i], mesh_names[i], meshes[i]);
+  };
+  const std::size_t thread_count = std::min<std::size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), nodes.size());
+
+  std::vector<std::thread> threads;
+
+  for (std::size_t i = 1; i < thread_count; ++i)
+    threads.emplace_back(worker);
 
-    if (counts.first <= 0 || counts.second <= 0)
+  worker();
+
+  for (auto& thread : threads)
+    thread.join();
+
+  for (std::size_t i = 0; i < nodes.size(); ++i)
+  {
+    std::cout << meshes[i].log;
+
+    if (!success[i])
       return false;
+  }
+  return true;
+}
+
+inline MeshIndex swap_index_bytes(MeshIndex index)
+{
+  return GUINT16_SWAP_LE_BE(index);
+}
+
+inline MeshIndex32 swap_index_bytes(MeshIndex32 index)
+{
+  return GUINT32_SWAP_LE_BE(index);
+}
 
-    mesh_desc.push_back({counts.second, indices_offset,
-                         total_vertices, total_vertices + counts.first - 1});
-    total_vertices += counts.first;
-    indices_offset += aligned_index_count(3 * counts.second);
+/* Append an index array converted to element type T, padded with the
+ * maximum index value up to the index array alignment.
+ */
+template <typename T, typename S>
+void append_indices(std::vector<guint8>& data, const std::vector<S>& indices, bool swap)
+{
+  const std::size_t offset = data.size();
+  data.resize(offset + aligned_index_bytes(indices.size() * sizeof(T)), 0xFF);
+
+  for (std::size_t i = 0; i < indices.size(); ++i)
+  {
+    T index = indices[i];
+
+    if (swap)
+      index = swap_index_bytes(index);
+
+    std::memcpy(&data[offset + i * sizeof(T)], &index, sizeof(T));
   }
-  mesh_vertices.resize(total_vertices);
-  mesh_indices.resize(indices_offset);
+}
+
+/*
+ * Concatenate the processed meshes. Each mesh selects 16-bit indices
+ * relative to its first vertex if possible, and 32-bit ones otherwise.
+ * The index data is written in the output byte order right away, since
+ * the element type varies along the array.
+ */
+bool fill_mesh_data(const MeshLoader& loader, const MeshNodes& nodes, bool swap,
+                    std::vector<MeshDesc>&    mesh_desc,
+                    std::vector<MeshVertex>&  mesh_vertices,
+                    std::vector<guint8>&      mesh_indices,
+                    std::vector<MeshCluster>& mesh_clusters)
+{
+  std::vector<NodeMesh> meshes;
+
+  if (!process_mesh_nodes(loader, nodes, meshes))
+    return false;
+
+  std::vector<MeshIndex> grid_indices (2 * GRID_LINE_COUNT);
+
+  mesh_desc.reserve(nodes.size());
+  mesh_vertices.resize(GRID_VERTEX_COUNT);
 
   generate_grid_vertices(&mesh_vertices[0]);
-  generate_grid_indices(&mesh_indices[0]);
+  generate_grid_indices(&grid_indices[0]);
 
-  for (std::size_t i = 0; i < nodes.size(); ++i)
+  append_indices<MeshIndex>(mesh_indices, grid_indices, swap);
+
+  for (const auto& node_mesh : meshes)
   {
-    const auto  node = nodes[i];
-    const auto& mesh = mesh_desc[i];
+    MeshDesc mesh = node_mesh.desc;
+    mesh.element_first = mesh_vertices.size();
+    mesh.element_last  = mesh.element_first + node_mesh.vertices.size() - 1;
 
-    loader.get_node_vertices(node, &mesh_vertices[mesh.element_first],
-                             mesh.element_count());
-    loader.get_node_indices(node, mesh.element_first, &mesh_indices[mesh.indices_offset],
-                            aligned_index_count(3 * mesh.triangle_count));
+    // The maximum index value is reserved for padding.
+    mesh.index_size = (node_mesh.vertices.size() <= G_MAXUINT16) ? sizeof(MeshIndex)
+                                                                 : sizeof(MeshIndex32);
+    mesh_vertices.insert(mesh_vertices.end(), node_mesh.vertices.cbegin(),
+                         node_mesh.vertices.cend());
+
+    mesh.cluster_first = mesh_clusters.size();
+    mesh.cluster_count = node_mesh.clusters.size();
+
+    mesh_clusters.insert(mesh_clusters.end(), node_mesh.clusters.cbegin(),
+                         node_mesh.clusters.cend());
+
+    for (int level = 0; level < MESH_LOD_COUNT; ++level)
+    {
+      const auto& indices = node_mesh.lods[level];
+
+      mesh.lod[level] = {static_cast<unsigned int>(indices.size() / 3),
+                         static_cast<unsigned int>(mesh_indices.size())};
+
+      if (mesh.index_size == sizeof(MeshIndex))
+        append_indices<MeshIndex>(mesh_indices, indices, swap);
+      else
+        append_indices<MeshIndex32>(mesh_indices, indices, swap);
+    }
+    mesh_desc.push_back(mesh);
   }
   return true;
 }
 
-template <typename T>
-inline void swap_data_bytes(std::vector<T>& data)
+/*
+ * Chunk layout of the compressed vertex data, with the cell grid
+ * followed by one chunk per mesh.
+ */
+std::vector<MeshStreamChunk> vertex_chunk_layout(const std::vector<MeshDesc>& mesh_desc)
 {
-  std::for_each(begin(data), end(data), [](T& v) { v.swap_bytes(); });
+  std::vector<MeshStreamChunk> layout;
+
+  layout.push_back({MESH_CHUNK_VERTICES, 0, GRID_VERTEX_COUNT * sizeof(MeshVertex), 0, 0});
+
+  for (const auto& mesh : mesh_desc)
+    layout.push_back({MESH_CHUNK_VERTICES,
+                      static_cast<guint32>(mesh.element_first * sizeof(MeshVertex)),
+                      static_cast<guint32>(mesh.element_count() * sizeof(MeshVertex)), 0, 0});
+  return layout;
 }
 
-template <>
-inline void swap_data_bytes(std::vector<unsigned short>& data)
+/*
+ * Chunk layout of the compressed index data, with the cell grid
+ * followed by one chunk per level of detail of each mesh.
+ */
+std::vector<MeshStreamChunk> index_chunk_layout(const std::vector<MeshDesc>& mesh_desc,
+                                                std::size_t size)
 {
-  std::transform(cbegin(data), cend(data), begin(data),
-                 [](unsigned short v) { return GUINT16_SWAP_LE_BE(v); });
+  std::vector<MeshStreamChunk> layout;
+
+  // Each chunk extends up to the start of the next one.
+  guint32 offset   = 0;
+  guint32 encoding = MESH_CHUNK_INDICES16;
+
+  for (const auto& mesh : mesh_desc)
+    for (const auto& lod : mesh.lod)
+    {
+      layout.push_back({encoding, offset, lod.indices_offset - offset, 0, 0});
+
+      offset   = lod.indices_offset;
+      encoding = (mesh.index_size == sizeof(MeshIndex32)) ? MESH_CHUNK_INDICES32
+                                                          : MESH_CHUNK_INDICES16;
+    }
+  layout.push_back({encoding, offset, static_cast<guint32>(size) - offset, 0, 0});
+
+  return layout;
 }
 
+template <typename T>
+inline void swap_data_bytes(std::vector<T>& data)
+{
+  std::for_each(begin(data), end(data), [](T& v) { v.swap_bytes(); });
+}
+
+/*
+ * Write an output file, unless it already has the same contents. This
+ * keeps the modification time of unchanged files, so that targets which
+ * depend on them are not rebuilt needlessly. The file is replaced
+ * atomically, so an interrupted run never leaves a truncated file.
+ */
 bool write_raw_data_file(const char* filename, const void* data, std::size_t size)
 {
   char* filepath = (out_dirname) ? g_build_filename(out_dirname, filename, nullptr)
                                  : nullptr;
+  const char *const path = (filepath) ? filepath : filename;
+
+  gchar* contents = nullptr;
+  gsize  length   = 0;
+
+  if (g_file_get_contents(path, &contents, &length, nullptr))
+  {
+    const bool unchanged = (length == size && std::memcmp(contents, data, size) == 0);
+    g_free(contents);
+
+    if (unchanged)
+    {
+      g_free(filepath);
+      return true;
+    }
+  }
   GError* error = nullptr;
-  const gboolean written = g_file_set_contents((filepath) ? filepath : filename,
-                                               static_cast<const char*>(data), size, &error);
+  const gboolean written = g_file_set_contents(path, static_cast<const char*>(data),
+                                               size, &error);
   g_free(filepath);
 
   if (!written)
@@ -185,6 +686,7 @@ int main(int argc, char** argv)
 
   const std::unique_ptr<char[], decltype(&g_free)> mesh_filename_del {mesh_filename, &g_free};
   const std::unique_ptr<char[], decltype(&g_free)> out_dirname_del {out_dirname, &g_free};
+  const std::unique_ptr<char[], decltype(&g_free)> cache_dirname_del {cache_dirname, &g_free};
   const std::unique_ptr<char*[], decltype(&g_strfreev)> mesh_names_del {mesh_names, &g_strfreev};
 
   if (!parsed)
@@ -208,6 +710,11 @@ int main(int argc, char** argv)
     std::cerr << "Conflicting big-endian and little-endian options" << std::endl;
     return 1;
   }
+  if (cache_dirname && g_mkdir_with_parents(cache_dirname, 0755) < 0)
+  {
+    std::cerr << "Failed to create cache directory " << cache_dirname << std::endl;
+    return 1;
+  }
   MeshLoader loader;
 
   if (!loader.read_file(mesh_filename))
@@ -227,24 +734,60 @@ int main(int argc, char** argv)
     }
     nodes.push_back(node);
   }
-  std::vector<MeshDesc>   mesh_desc;
-  std::vector<MeshVertex> mesh_vertices;
-  std::vector<MeshIndex>  mesh_indices;
+  const bool swap = (byte_order_be && G_BYTE_ORDER == G_LITTLE_ENDIAN) ||
+                    (byte_order_le && G_BYTE_ORDER == G_BIG_ENDIAN);
+
+  std::vector<MeshDesc>    mesh_desc;
+  std::vector<MeshVertex>  mesh_vertices;
+  std::vector<guint8>      mesh_indices;
+  std::vector<MeshCluster> mesh_clusters;
 
-  if (!fill_mesh_data(loader, nodes, mesh_desc, mesh_vertices, mesh_indices))
+  if (!fill_mesh_data(loader, nodes, swap, mesh_desc, mesh_vertices,
+                      mesh_indices, mesh_clusters))
   {
     std::cerr << "Failed to get mesh data" << std::endl;
     return 1;
   }
-  if ((byte_order_be && G_BYTE_ORDER == G_LITTLE_ENDIAN) ||
-      (byte_order_le && G_BYTE_ORDER == G_BIG_ENDIAN))
+  std::vector<MeshStreamChunk> vertex_layout, index_layout;
+
+  if (compress_data)
+  {
+    vertex_layout = vertex_chunk_layout(mesh_desc);
+    index_layout  = index_chunk_layout(mesh_desc, mesh_indices.size());
+  }
+  if (swap)
   {
     swap_data_bytes(mesh_desc);
     swap_data_bytes(mesh_vertices);
-    swap_data_bytes(mesh_indices);
+    swap_data_bytes(mesh_clusters);
+  }
+  if (compress_data)
+  {
+    const auto *const vertices = reinterpret_cast<const guint8*>(&mesh_vertices[0]);
+    const std::size_t vertices_size = mesh_vertices.size() * sizeof(MeshVertex);
+    const std::size_t indices_size  = mesh_indices.size();
+
+    const auto vertex_stream = encode_mesh_stream(vertices, vertices_size, vertex_layout, swap);
+    const auto index_stream  = encode_mesh_stream(&mesh_indices[0], indices_size,
+                                                  index_layout, swap);
+    if (vertex_stream.empty() || index_stream.empty())
+    {
+      std::cerr << "Failed to compress mesh data" << std::endl;
+      return 1;
+    }
+    std::cout << "Compressed vertices: " << vertices_size << " -> " << vertex_stream.size()
+              << " bytes, indices: " << indices_size << " -> " << index_stream.size()
+              << " bytes\n";
+
+    if (!write_data_file("mesh-vertices.bin", vertex_stream) ||
+        !write_data_file("mesh-indices.bin",  index_stream))
+      return 1;
   }
-  if (!write_data_file("mesh-vertices.bin", mesh_vertices) ||
-      !write_data_file("mesh-indices.bin",  mesh_indices)  ||
+  else if (!write_data_file("mesh-vertices.bin", mesh_vertices) ||
+           !write_data_file("mesh-indices.bin",  mesh_indices))
+    return 1;
+
+  if (!write_data_file("mesh-clusters.bin", mesh_clusters) ||
       !write_data_file("mesh-desc.bin",     mesh_desc))
     return 1;
 
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "meshcompress.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+
+using namespace Somato;
+
+void write_varint(std::vector<guint8>& out, guint32 value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back(value | 0x80);
+    value >>= 7;
+  }
+  out.push_back(value);
+}
+
+inline guint16 swap_word_bytes(guint16 value) { return GUINT16_SWAP_LE_BE(value); }
+inline guint32 swap_word_bytes(guint32 value) { return GUINT32_SWAP_LE_BE(value); }
+
+template <typename T>
+T read_word(const guint8* data, bool swap)
+{
+  T value;
+  std::memcpy(&value, data, sizeof value);
+
+  return (swap) ? swap_word_bytes(value) : value;
+}
+
+/*
+ * Encode indices as the difference to the previous index. Deltas of
+ * 32-bit indices wrap around, which the decoder reverses.
+ */
+template <typename T>
+void encode_indices(std::vector<guint8>& out, const guint8* data, std::size_t size, bool swap)
+{
+  guint32 previous = 0;
+
+  for (std::size_t pos = 0; pos + sizeof(T) <= size; pos += sizeof(T))
+  {
+    const guint32 index = read_word<T>(data + pos, swap);
+
+    write_varint(out, zigzag_encode(gint32(index - previous)));
+    previous = index;
+  }
+}
+
+/*
+ * Encode each position coordinate and normal component of the vertices
+ * as the difference to the same attribute of the previous vertex.
+ */
+void encode_vertices(std::vector<guint8>& out, const guint8* data, std::size_t size, bool swap)
+{
+  gint32 previous[5] = {0, 0, 0, 0, 0};
+
+  for (std::size_t pos = 0; pos + sizeof(MeshVertex) <= size; pos += sizeof(MeshVertex))
+  {
+    gint32 attribs[5];
+
+    for (int i = 0; i < 3; ++i)
+      attribs[i] = gint16(read_word<guint16>(data + pos + offsetof(MeshVertex, position) + 2 * i,
+                                             swap));
+
+    const guint8 *const normal = data + pos + offsetof(MeshVertex, normal);
+    attribs[3] = gint8(normal[0]);
+    attribs[4] = gint8(normal[1]);
+
+    for (int i = 0; i < 5; ++i)
+    {
+      write_varint(out, zigzag_encode(attribs[i] - previous[i]));
+      previous[i] = attribs[i];
+    }
+  }
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+std::vector<guint8> encode_mesh_stream(const guint8* data, std::size_t size,
+                                       std::vector<MeshStreamChunk> layout, bool swap)
+{
+  std::vector<guint8> encoded;
+  std::size_t decoded_end = 0;
+
+  for (auto& chunk : layout)
+  {
+    g_return_val_if_fail(chunk.decoded_offset == decoded_end, std::vector<guint8>{});
+    g_return_val_if_fail(chunk.decoded_size <= size - decoded_end, std::vector<guint8>{});
+
+    const guint8 *const source = data + chunk.decoded_offset;
+    chunk.encoded_offset = encoded.size();
+
+    switch (chunk.encoding)
+    {
+      case MESH_CHUNK_INDICES16:
+        encode_indices<guint16>(encoded, source, chunk.decoded_size, swap);
+        break;
+      case MESH_CHUNK_INDICES32:
+        encode_indices<guint32>(encoded, source, chunk.decoded_size, swap);
+        break;
+      case MESH_CHUNK_VERTICES:
+        encode_vertices(encoded, source, chunk.decoded_size, swap);
+        break;
+      default:
+        chunk.encoding = MESH_CHUNK_RAW;
+        encoded.insert(encoded.end(), source, source + chunk.decoded_size);
+        break;
+    }
+    chunk.encoded_size = encoded.size() - chunk.encoded_offset;
+    decoded_end += chunk.decoded_size;
+  }
+  g_return_val_if_fail(decoded_end == size, std::vector<guint8>{});
+
+  MeshStreamHeader header;
+  header.magic        = MESH_STREAM_MAGIC;
+  header.chunk_count  = layout.size();
+  header.decoded_size = size;
+  header.encoded_size = encoded.size();
+
+  if (swap)
+  {
+    header.swap_bytes();
+
+    for (auto& chunk : layout)
+      chunk.swap_bytes();
+  }
+  std::vector<guint8> stream (sizeof header + layout.size() * sizeof(MeshStreamChunk));
+
+  std::memcpy(&stream[0], &header, sizeof header);
+  std::memcpy(&stream[sizeof header], layout.data(), layout.size() * sizeof(MeshStreamChunk));
+
+  stream.insert(stream.end(), encoded.begin(), encoded.end());
+
+  return stream;
+}
+
+} // namespace Somato
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_MESHCOMPRESS_H_INCLUDED
+#define SOMATO_MESHCOMPRESS_H_INCLUDED
+
+#include "meshtypes.h"
+
+#include <glib.h>
+#include <vector>
+#include <cstddef>
+
+namespace Somato
+{
+
+/* Encode mesh data as a compressed stream. The layout lists the chunks
+ * with their encoding and decoded range, which must cover the data in
+ * sequence. The data and the resulting stream are in output byte order,
+ * which differs from the host byte order if swap is set.
+ */
+std::vector<guint8> encode_mesh_stream(const guint8* data, std::size_t size,
+                                       std::vector<MeshStreamChunk> layout, bool swap);
+
+} // namespace Somato
+
+#endif // !SOMATO_MESHCOMPRESS_H_INCLUDED
@@ -41,7 +41,6 @@ MeshLoader::MeshLoader()
   importer_->SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,
                                 aiPrimitiveType_POINT
                                 | aiPrimitiveType_LINE);
-  importer_->SetPropertyInteger(AI_CONFIG_PP_ICL_PTCACHE_SIZE, 20);
 }
 
 MeshLoader::~MeshLoader()
@@ -54,8 +53,7 @@ bool MeshLoader::read_file(const char* filename)
                               | aiProcess_JoinIdenticalVertices
                               | aiProcess_Triangulate
                               | aiProcess_SortByPType
-                              | aiProcess_GenSmoothNormals
-                              | aiProcess_ImproveCacheLocality) != nullptr);
+                              | aiProcess_GenSmoothNormals) != nullptr);
 }
 
 const char* MeshLoader::get_error_string() const
@@ -91,7 +89,7 @@ MeshLoader::count_node_vertices_triangles(Node node) const
   return counts;
 }
 
-std::size_t MeshLoader::get_node_vertices(Node node, MeshVertex* buffer,
+std::size_t MeshLoader::get_node_vertices(Node node, SourceVertex* buffer,
                                           std::size_t max_vertices) const
 {
   std::size_t n_written = 0;
@@ -115,8 +113,8 @@ std::size_t MeshLoader::get_node_vertices(Node node, MeshVertex* buffer,
 
     for (std::size_t i = 0; i < n_vertices; ++i)
     {
-      buffer[n_written + i].set(vertices[i].x, vertices[i].y, vertices[i].z,
-                                normals [i].x, normals [i].y, normals [i].z);
+      buffer[n_written + i] = {{vertices[i].x, vertices[i].y, vertices[i].z},
+                               {normals [i].x, normals [i].y, normals [i].z}};
     }
     n_written += n_vertices;
   }
@@ -124,7 +122,7 @@ std::size_t MeshLoader::get_node_vertices(Node node, MeshVertex* buffer,
 }
 
 std::size_t MeshLoader::get_node_indices(Node node, unsigned int base,
-                                         MeshIndex* buffer, std::size_t max_indices) const
+                                         SourceIndex* buffer, std::size_t max_indices) const
 {
   std::size_t n_written = 0;
 
@@ -139,7 +137,7 @@ std::size_t MeshLoader::get_node_indices(Node node, unsigned int base,
     const aiMesh *const mesh = scene_meshes[node->mMeshes[mesh_idx]];
 
     g_return_val_if_fail(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE, n_written);
-    g_return_val_if_fail(mesh->mNumFaces < (~MeshIndex{0} - base) / 3, n_written);
+    g_return_val_if_fail(mesh->mNumVertices < ~SourceIndex{0} - base, n_written);
 
     const aiFace *const faces = mesh->mFaces;
     const std::size_t n_faces =
@@ -160,7 +158,7 @@ std::size_t MeshLoader::get_node_indices(Node node, unsigned int base,
     n_written += 3 * n_faces;
   }
   for (std::size_t n = n_written; n < max_indices; ++n)
-    buffer[n] = ~MeshIndex{0};
+    buffer[n] = ~SourceIndex{0};
 
   return n_written;
 }
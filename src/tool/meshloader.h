@@ -32,6 +32,19 @@ struct aiNode;
 namespace Somato
 {
 
+/* Vertex attributes as read from the mesh file, prior to quantization.
+ */
+struct SourceVertex
+{
+  float position[3];
+  float normal[3];
+};
+
+/* Vertex index as used while processing meshes. The index format of
+ * the output is chosen per mesh once the vertex count is known.
+ */
+typedef unsigned int SourceIndex;
+
 class MeshLoader
 {
 public:
@@ -58,10 +71,10 @@ public:
   Node lookup_node(const char* name) const;
   VertexTriangleCounts count_node_vertices_triangles(Node node) const;
 
-  std::size_t get_node_vertices(Node node, MeshVertex* buffer,
+  std::size_t get_node_vertices(Node node, SourceVertex* buffer,
                                 std::size_t max_vertices) const;
   std::size_t get_node_indices(Node node, unsigned int base,
-                               MeshIndex* buffer, std::size_t max_indices) const;
+                               SourceIndex* buffer, std::size_t max_indices) const;
 private:
   const std::unique_ptr<Assimp::Importer> importer_;
 };
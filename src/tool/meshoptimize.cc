@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "meshoptimize.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+
+using namespace Somato;
+
+/*
+ * Size of the LRU cache modelled by the vertex cache optimization.
+ */
+const int forsyth_cache_size = 32;
+
+/*
+ * Score of a vertex in the optimization by cache position and remaining
+ * valence, as suggested by Tom Forsyth.
+ */
+float forsyth_vertex_score(int cache_pos, int valence)
+{
+  if (valence <= 0)
+    return -1.f; // no triangles left
+
+  float score = 0.f;
+
+  if (cache_pos >= 0)
+  {
+    // The three most recent vertices belong to the last emitted triangle.
+    // Give them a fixed score to discourage strip-like triangle order.
+    if (cache_pos < 3)
+      score = 0.75f;
+    else
+      score = std::pow(1.f - float(cache_pos - 3) / (forsyth_cache_size - 3), 1.5f);
+  }
+  // Boost vertices with few remaining triangles, to get rid of them early.
+  return score + 2.f / std::sqrt(float(valence));
+}
+
+struct Vec3
+{
+  float x, y, z;
+
+  Vec3& operator+=(const Vec3& b) { x += b.x; y += b.y; z += b.z; return *this; }
+
+  friend Vec3 operator-(const Vec3& a, const Vec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+  friend Vec3 operator*(float s, const Vec3& a) { return {s * a.x, s * a.y, s * a.z}; }
+
+  friend float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+  friend Vec3 cross(const Vec3& a, const Vec3& b)
+    { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+};
+
+inline Vec3 vertex_position(const SourceVertex& v)
+{
+  return {v.position[0], v.position[1], v.position[2]};
+}
+
+/*
+ * Simulated FIFO vertex cache, flushed in constant time by advancing
+ * the time stamp.
+ */
+class FifoCache
+{
+public:
+  FifoCache(unsigned int vertex_count, unsigned int cache_size)
+    : stamps_ (vertex_count, 0), cache_size_ {cache_size}, time_ {cache_size + 1} {}
+
+  // Return whether the vertex was missing from the cache.
+  bool access(SourceIndex index)
+  {
+    if (time_ - stamps_[index] > cache_size_)
+    {
+      stamps_[index] = time_++;
+      return true;
+    }
+    return false;
+  }
+  void flush() { time_ += cache_size_ + 1; }
+
+private:
+  std::vector<unsigned int> stamps_;
+  unsigned int              cache_size_;
+  unsigned int              time_;
+};
+
+/*
+ * Area-weighted centroid and normal of a range of triangles.
+ */
+void triangle_moments(const SourceIndex* indices, std::size_t triangle_count,
+                      const std::vector<SourceVertex>& vertices,
+                      Vec3& centroid, Vec3& normal)
+{
+  Vec3  sum_center {0.f, 0.f, 0.f};
+  Vec3  sum_normal {0.f, 0.f, 0.f};
+  float sum_area = 0.f;
+
+  for (std::size_t t = 0; t < triangle_count; ++t)
+  {
+    const Vec3 a = vertex_position(vertices[indices[3 * t]]);
+    const Vec3 b = vertex_position(vertices[indices[3 * t + 1]]);
+    const Vec3 c = vertex_position(vertices[indices[3 * t + 2]]);
+
+    const Vec3  n    = cross(b - a, c - a); // length is twice the area
+    const float area = std::sqrt(dot(n, n));
+
+    Vec3 center = a;
+    center += b;
+    center += c;
+
+    sum_center += (area / 3.f) * center;
+    sum_normal += n;
+    sum_area   += area;
+  }
+  centroid = (sum_area > 0.f) ? (1.f / sum_area) * sum_center : sum_center;
+  normal   = sum_normal;
+}
+
+/*
+ * Compute the bounding sphere and normal cone of a range of triangles.
+ */
+void compute_cluster_bounds(const SourceIndex* indices, const Vec3* normals,
+                            const std::vector<SourceVertex>& vertices,
+                            MeshCluster& cluster)
+{
+  Vec3 lower = vertex_position(vertices[indices[0]]);
+  Vec3 upper = lower;
+
+  for (std::size_t i = 1; i < 3 * cluster.triangle_count; ++i)
+  {
+    const Vec3 p = vertex_position(vertices[indices[i]]);
+
+    lower = {std::min(lower.x, p.x), std::min(lower.y, p.y), std::min(lower.z, p.z)};
+    upper = {std::max(upper.x, p.x), std::max(upper.y, p.y), std::max(upper.z, p.z)};
+  }
+  Vec3 center = lower;
+  center += upper;
+  center = 0.5f * center;
+
+  float radius2 = 0.f;
+
+  for (std::size_t i = 0; i < 3 * cluster.triangle_count; ++i)
+  {
+    const Vec3 d = vertex_position(vertices[indices[i]]) - center;
+    radius2 = std::max(radius2, dot(d, d));
+  }
+  Vec3 axis {0.f, 0.f, 0.f};
+
+  for (std::size_t t = 0; t < cluster.triangle_count; ++t)
+    axis += normals[t];
+
+  const float axis_length = std::sqrt(dot(axis, axis));
+  float cutoff = -1.f;
+
+  if (axis_length > 0.f)
+  {
+    axis = (1.f / axis_length) * axis;
+    cutoff = 1.f;
+
+    // Degenerate triangles have a zero normal and never produce any
+    // fragments, so they do not constrain the cone.
+    for (std::size_t t = 0; t < cluster.triangle_count; ++t)
+      if (dot(normals[t], normals[t]) > 0.f)
+        cutoff = std::min(cutoff, dot(axis, normals[t]));
+  }
+  // A cone of half a sphere or more cannot be culled.
+  if (cutoff <= 0.f)
+    cutoff = -1.f;
+
+  cluster.center[0]    = center.x;
+  cluster.center[1]    = center.y;
+  cluster.center[2]    = center.z;
+  cluster.radius       = std::sqrt(radius2);
+  cluster.cone_axis[0] = axis.x;
+  cluster.cone_axis[1] = axis.y;
+  cluster.cone_axis[2] = axis.z;
+  cluster.cone_cutoff  = cutoff;
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+VertexCacheStats analyze_vertex_cache(const std::vector<SourceIndex>& indices,
+                                      unsigned int vertex_count,
+                                      unsigned int cache_size)
+{
+  VertexCacheStats stats;
+
+  g_return_val_if_fail(vertex_count > 0 && indices.size() >= 3, stats);
+
+  FifoCache cache {vertex_count, cache_size};
+  unsigned int misses = 0;
+
+  for (const SourceIndex index : indices)
+    misses += cache.access(index);
+
+  stats.acmr = float(misses) / (indices.size() / 3);
+  stats.atvr = float(misses) / vertex_count;
+
+  return stats;
+}
+
+void optimize_vertex_cache(std::vector<SourceIndex>& indices, unsigned int vertex_count)
+{
+  const std::size_t triangle_count = indices.size() / 3;
+
+  g_return_if_fail(indices.size() % 3 == 0);
+
+  // Build the vertex to triangle adjacency in compressed row form.
+  std::vector<unsigned int> adjacency_offset (vertex_count + 1, 0);
+
+  for (const SourceIndex index : indices)
+  {
+    g_return_if_fail(index < vertex_count);
+    ++adjacency_offset[index + 1];
+  }
+  std::partial_sum(adjacency_offset.begin(), adjacency_offset.end(),
+                   adjacency_offset.begin());
+
+  std::vector<unsigned int> adjacency (indices.size());
+  std::vector<int>          valence (vertex_count, 0);
+
+  for (std::size_t i = 0; i < indices.size(); ++i)
+  {
+    const SourceIndex v = indices[i];
+    adjacency[adjacency_offset[v] + valence[v]++] = i / 3;
+  }
+
+  std::vector<int>   cache_pos (vertex_count, -1);
+  std::vector<float> vertex_score (vertex_count);
+
+  for (unsigned int v = 0; v < vertex_count; ++v)
+    vertex_score[v] = forsyth_vertex_score(-1, valence[v]);
+
+  std::vector<bool> emitted (triangle_count, false);
+
+  std::vector<SourceIndex> result;
+  result.reserve(indices.size());
+
+  std::vector<SourceIndex> cache, next_cache;
+  cache.reserve(forsyth_cache_size + 3);
+  next_cache.reserve(forsyth_cache_size + 3);
+
+  std::size_t scan_pos = 0;
+  std::size_t best = triangle_count;
+
+  while (result.size() < indices.size())
+  {
+    if (best == triangle_count)
+    {
+      // Nothing left adjacent to the cache. Continue with the next
+      // triangle in the original order.
+      while (emitted[scan_pos])
+        ++scan_pos;
+      best = scan_pos;
+    }
+    emitted[best] = true;
+
+    const SourceIndex *const tri = &indices[3 * best];
+    result.insert(result.end(), tri, tri + 3);
+
+    // Remove the triangle from its vertices' adjacency lists.
+    for (int k = 0; k < 3; ++k)
+    {
+      const SourceIndex v = tri[k];
+      const auto first = adjacency.begin() + adjacency_offset[v];
+      const auto last  = first + valence[v];
+
+      std::iter_swap(std::find(first, last, unsigned(best)), last - 1);
+      --valence[v];
+    }
+
+    // Move the triangle's vertices to the front of the cache.
+    next_cache.assign(tri, tri + 3);
+
+    for (const SourceIndex v : cache)
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        next_cache.push_back(v);
+
+    for (std::size_t i = forsyth_cache_size; i < next_cache.size(); ++i)
+      cache_pos[next_cache[i]] = -1;
+
+    next_cache.resize(std::min<std::size_t>(next_cache.size(), forsyth_cache_size));
+
+    for (std::size_t i = 0; i < next_cache.size(); ++i)
+      cache_pos[next_cache[i]] = i;
+
+    // Update the scores of all vertices that were or still are in the
+    // cache, and find the best triangle adjacent to the cache.
+    float best_score = -1.f;
+    best = triangle_count;
+
+    for (const auto* list : {&cache, &next_cache})
+      for (const SourceIndex v : *list)
+        vertex_score[v] = forsyth_vertex_score(cache_pos[v], valence[v]);
+
+    for (const SourceIndex v : next_cache)
+      for (int j = 0; j < valence[v]; ++j)
+      {
+        const unsigned int t = adjacency[adjacency_offset[v] + j];
+        const float score = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]]
+                          + vertex_score[indices[3 * t + 2]];
+
+        if (score > best_score)
+        {
+          best_score = score;
+          best = t;
+        }
+      }
+    cache.swap(next_cache);
+  }
+  indices.swap(result);
+}
+
+void optimize_overdraw(std::vector<SourceIndex>& indices,
+                       const std::vector<SourceVertex>& vertices,
+                       float threshold)
+{
+  const std::size_t triangle_count = indices.size() / 3;
+
+  g_return_if_fail(indices.size() % 3 == 0);
+
+  if (triangle_count == 0)
+    return;
+
+  const float mesh_acmr = analyze_vertex_cache(indices, vertices.size(),
+                                               forsyth_cache_size).acmr;
+
+  // Split the triangle list into clusters. The cache is modelled as
+  // flushed at each cluster start, since the order of clusters changes.
+  std::vector<std::size_t> cluster_start;
+  FifoCache cache {unsigned(vertices.size()), forsyth_cache_size};
+
+  unsigned int cluster_misses = 0;
+  std::size_t  cluster_size   = 0;
+
+  for (std::size_t t = 0; t < triangle_count; ++t)
+  {
+    if (cluster_size == 0)
+      cluster_start.push_back(t);
+
+    cluster_misses += cache.access(indices[3 * t]);
+    cluster_misses += cache.access(indices[3 * t + 1]);
+    cluster_misses += cache.access(indices[3 * t + 2]);
+    ++cluster_size;
+
+    if (cluster_misses <= threshold * mesh_acmr * cluster_size)
+    {
+      cache.flush();
+      cluster_misses = 0;
+      cluster_size   = 0;
+    }
+  }
+  cluster_start.push_back(triangle_count);
+
+  const std::size_t cluster_count = cluster_start.size() - 1;
+
+  Vec3 mesh_centroid, mesh_normal;
+  triangle_moments(&indices[0], triangle_count, vertices, mesh_centroid, mesh_normal);
+
+  // Sort clusters by how far they face outward from the mesh centroid.
+  std::vector<float>       sort_key (cluster_count);
+  std::vector<std::size_t> order (cluster_count);
+
+  for (std::size_t c = 0; c < cluster_count; ++c)
+  {
+    Vec3 centroid, normal;
+    triangle_moments(&indices[3 * cluster_start[c]], cluster_start[c + 1] - cluster_start[c],
+                     vertices, centroid, normal);
+
+    const float length = std::sqrt(dot(normal, normal));
+
+    sort_key[c] = (length > 0.f) ? dot(centroid - mesh_centroid, normal) / length : 0.f;
+    order[c]    = c;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&sort_key](std::size_t a, std::size_t b) { return (sort_key[a] > sort_key[b]); });
+
+  std::vector<SourceIndex> result;
+  result.reserve(indices.size());
+
+  for (const std::size_t c : order)
+    result.insert(result.end(), indices.begin() + 3 * cluster_start[c],
+                                indices.begin() + 3 * cluster_start[c + 1]);
+  indices.swap(result);
+}
+
+void optimize_vertex_fetch(std::vector<SourceIndex>& indices,
+                           std::vector<SourceVertex>& vertices)
+{
+  for (const SourceIndex index : indices)
+    g_return_if_fail(index < vertices.size());
+
+  const SourceIndex unused = ~SourceIndex{0};
+  std::vector<SourceIndex> remap (vertices.size(), unused);
+
+  std::vector<SourceVertex> result;
+  result.reserve(vertices.size());
+
+  for (SourceIndex& index : indices)
+  {
+    if (remap[index] == unused)
+    {
+      remap[index] = result.size();
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  // Keep unreferenced vertices at the end, to preserve the vertex count.
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+    if (remap[i] == unused)
+      result.push_back(vertices[i]);
+
+  vertices.swap(result);
+}
+
+std::vector<MeshCluster> build_mesh_clusters(const std::vector<SourceIndex>& indices,
+                                             const std::vector<SourceVertex>& vertices,
+                                             unsigned int max_triangles, float min_cone_cutoff)
+{
+  std::vector<MeshCluster> clusters;
+
+  g_return_val_if_fail(indices.size() % 3 == 0 && max_triangles > 0, clusters);
+
+  const std::size_t triangle_count = indices.size() / 3;
+  std::vector<Vec3> face_normals (triangle_count);
+
+  for (std::size_t t = 0; t < triangle_count; ++t)
+  {
+    const Vec3 a = vertex_position(vertices[indices[3 * t]]);
+    const Vec3 b = vertex_position(vertices[indices[3 * t + 1]]);
+    const Vec3 c = vertex_position(vertices[indices[3 * t + 2]]);
+
+    Vec3 n = cross(b - a, c - a);
+    const float length = std::sqrt(dot(n, n));
+
+    if (length > 0.f)
+      n = (1.f / length) * n;
+
+    face_normals[t] = n;
+  }
+  const auto add_cluster = [&](std::size_t begin, std::size_t end)
+  {
+    MeshCluster cluster {};
+    cluster.triangle_first = begin;
+    cluster.triangle_count = end - begin;
+
+    compute_cluster_bounds(&indices[3 * begin], &face_normals[begin], vertices, cluster);
+    clusters.push_back(cluster);
+  };
+  // Collect runs of consecutive triangles, so that the order established
+  // by the vertex cache and overdraw optimizations is kept intact. A new
+  // cluster is started whenever the current one is full, or if adding the
+  // next triangle would widen its normal cone beyond the cutoff.
+  std::size_t begin = 0;
+  Vec3 normal_sum {0.f, 0.f, 0.f};
+
+  for (std::size_t t = 0; t < triangle_count; ++t)
+  {
+    const Vec3& n = face_normals[t];
+    bool split = (t - begin >= max_triangles);
+
+    if (!split && t > begin && dot(n, n) > 0.f)
+    {
+      Vec3 axis = normal_sum;
+      axis += n;
+      const float axis_length = std::sqrt(dot(axis, axis));
+
+      split = !(axis_length > 0.f);
+
+      if (!split)
+      {
+        axis = (1.f / axis_length) * axis;
+
+        for (std::size_t i = begin; i <= t && !split; ++i)
+          split = (dot(face_normals[i], face_normals[i]) > 0.f
+                   && dot(axis, face_normals[i]) < min_cone_cutoff);
+      }
+    }
+    if (split)
+    {
+      add_cluster(begin, t);
+      begin = t;
+      normal_sum = {0.f, 0.f, 0.f};
+    }
+    normal_sum += n;
+  }
+  if (begin < triangle_count)
+    add_cluster(begin, triangle_count);
+
+  return clusters;
+}
+
+} // namespace Somato
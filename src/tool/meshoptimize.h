@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_MESHOPTIMIZE_H_INCLUDED
+#define SOMATO_MESHOPTIMIZE_H_INCLUDED
+
+#include "meshloader.h"
+#include "meshtypes.h"
+
+#include <vector>
+
+namespace Somato
+{
+
+/* Post-transform vertex cache efficiency of a triangle list.
+ */
+struct VertexCacheStats
+{
+  float acmr = 0.; // average cache miss ratio: vertex shader runs per triangle
+  float atvr = 0.; // average transform to vertex ratio: runs per vertex
+};
+
+/* Simulate a FIFO post-transform vertex cache of the given size.
+ */
+VertexCacheStats analyze_vertex_cache(const std::vector<SourceIndex>& indices,
+                                      unsigned int vertex_count,
+                                      unsigned int cache_size);
+
+/* Reorder triangles for vertex cache locality, using Tom Forsyth's
+ * linear-speed vertex cache optimization algorithm.
+ */
+void optimize_vertex_cache(std::vector<SourceIndex>& indices, unsigned int vertex_count);
+
+/* Reorder clusters of a cache-optimized triangle list so that outward
+ * facing parts of the mesh tend to be drawn first, in order to reduce
+ * overdraw. A cluster boundary is inserted wherever doing so keeps the
+ * cache miss ratio within the threshold factor of the original.
+ */
+void optimize_overdraw(std::vector<SourceIndex>& indices,
+                       const std::vector<SourceVertex>& vertices,
+                       float threshold);
+
+/* Renumber the vertices in the order of first use by the triangle list,
+ * so that vertex fetches proceed linearly through memory.
+ */
+void optimize_vertex_fetch(std::vector<SourceIndex>& indices,
+                           std::vector<SourceVertex>& vertices);
+
+/* Split the triangle list of a mesh into runs of at most max_triangles
+ * consecutive triangles, without reordering them. A run is also ended
+ * early where the cosine of the normal cone half-angle would fall below
+ * min_cone_cutoff. Each cluster gets a bounding sphere and a normal cone
+ * for culling.
+ */
+std::vector<MeshCluster> build_mesh_clusters(const std::vector<SourceIndex>& indices,
+                                             const std::vector<SourceVertex>& vertices,
+                                             unsigned int max_triangles, float min_cone_cutoff);
+
+} // namespace Somato
+
+#endif // !SOMATO_MESHOPTIMIZE_H_INCLUDED
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "meshsimplify.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <utility>
+
+namespace
+{
+
+using namespace Somato;
+
+/* Symmetric 4x4 matrix of a quadric error function, stored as the
+ * upper triangle in row order.
+ */
+struct Quadric
+{
+  double q[10] = {0., 0., 0., 0., 0., 0., 0., 0., 0., 0.};
+
+  void add_plane(double a, double b, double c, double d)
+  {
+    q[0] += a * a; q[1] += a * b; q[2] += a * c; q[3] += a * d;
+                   q[4] += b * b; q[5] += b * c; q[6] += b * d;
+                                  q[7] += c * c; q[8] += c * d;
+                                                 q[9] += d * d;
+  }
+  Quadric& operator+=(const Quadric& other)
+  {
+    for (int i = 0; i < 10; ++i)
+      q[i] += other.q[i];
+    return *this;
+  }
+  double evaluate(double x, double y, double z) const
+  {
+    return x * (q[0] * x + 2. * (q[1] * y + q[2] * z + q[3]))
+         + y * (q[4] * y + 2. * (q[5] * z + q[6]))
+         + z * (q[7] * z + 2. *  q[8])
+         + q[9];
+  }
+};
+
+typedef std::array<unsigned int, 3> Triangle;
+
+/* Candidate half-edge collapse, moving vertex from onto vertex to.
+ */
+struct Collapse
+{
+  double       cost;
+  unsigned int from;
+  unsigned int to;
+  unsigned int from_stamp;
+  unsigned int to_stamp;
+
+  bool operator<(const Collapse& other) const { return (cost > other.cost); }
+};
+
+std::array<double, 3> face_normal(const std::vector<SourceVertex>& vertices,
+                                  unsigned int i0, unsigned int i1, unsigned int i2)
+{
+  const float* const p0 = vertices[i0].position;
+  const float* const p1 = vertices[i1].position;
+  const float* const p2 = vertices[i2].position;
+
+  const double u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+  const double v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+  return {{u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]}};
+}
+
+class Simplifier
+{
+public:
+  Simplifier(const std::vector<SourceIndex>& indices, const std::vector<SourceVertex>& vertices);
+
+  std::vector<SourceIndex> run(std::size_t target_count, double max_error);
+
+private:
+  void lock_seams_and_boundaries();
+  void compute_quadrics();
+  void push_candidate(unsigned int from, unsigned int to);
+  bool collapse_allowed(unsigned int from, unsigned int to) const;
+  void collapse(unsigned int from, unsigned int to);
+  std::vector<unsigned int> neighbors(unsigned int v) const;
+
+  const std::vector<SourceVertex>&       vertices_;
+  std::vector<Triangle>                  triangles_;
+  std::vector<bool>                      triangle_alive_;
+  std::vector<std::vector<unsigned int>> vertex_triangles_;
+  std::vector<Quadric>                   quadrics_;
+  std::vector<unsigned int>              stamps_;
+  std::vector<bool>                      locked_;
+  std::vector<bool>                      vertex_alive_;
+  std::priority_queue<Collapse>          queue_;
+  std::size_t                            triangle_count_;
+};
+
+Simplifier::Simplifier(const std::vector<SourceIndex>& indices,
+                       const std::vector<SourceVertex>& vertices)
+:
+  vertices_         {vertices},
+  triangles_        (indices.size() / 3),
+  triangle_alive_   (indices.size() / 3, true),
+  vertex_triangles_ (vertices.size()),
+  quadrics_         (vertices.size()),
+  stamps_           (vertices.size(), 0),
+  locked_           (vertices.size(), false),
+  vertex_alive_     (vertices.size(), true),
+  triangle_count_   {indices.size() / 3}
+{
+  for (std::size_t t = 0; t < triangles_.size(); ++t)
+  {
+    triangles_[t] = {{indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]}};
+
+    for (const unsigned int v : triangles_[t])
+      vertex_triangles_[v].push_back(t);
+  }
+  lock_seams_and_boundaries();
+  compute_quadrics();
+}
+
+/*
+ * Vertices sharing their position with another vertex lie on a seam
+ * of discontinuous attributes. Edges used by only one triangle, or by
+ * more than two, lie on a boundary. Both kinds of vertices are locked.
+ */
+void Simplifier::lock_seams_and_boundaries()
+{
+  std::map<std::array<float, 3>, unsigned int> positions;
+  std::vector<unsigned int> group (vertices_.size());
+
+  for (std::size_t v = 0; v < vertices_.size(); ++v)
+  {
+    const float* const p = vertices_[v].position;
+    const auto inserted = positions.emplace(std::array<float, 3>{{p[0], p[1], p[2]}}, v);
+
+    group[v] = inserted.first->second;
+
+    if (!inserted.second)
+    {
+      locked_[v] = true;
+      locked_[group[v]] = true;
+    }
+  }
+  std::map<std::pair<unsigned int, unsigned int>, int> edge_use;
+
+  for (const auto& tri : triangles_)
+    for (int k = 0; k < 3; ++k)
+    {
+      const unsigned int a = group[tri[k]];
+      const unsigned int b = group[tri[(k + 1) % 3]];
+
+      ++edge_use[std::minmax(a, b)];
+    }
+
+  for (const auto& tri : triangles_)
+    for (int k = 0; k < 3; ++k)
+    {
+      const unsigned int a = tri[k];
+      const unsigned int b = tri[(k + 1) % 3];
+
+      if (edge_use[std::minmax(group[a], group[b])] != 2)
+      {
+        locked_[a] = true;
+        locked_[b] = true;
+      }
+    }
+}
+
+void Simplifier::compute_quadrics()
+{
+  for (const auto& tri : triangles_)
+  {
+    const auto n = face_normal(vertices_, tri[0], tri[1], tri[2]);
+    const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    if (length <= 0.)
+      continue;
+
+    const double a = n[0] / length;
+    const double b = n[1] / length;
+    const double c = n[2] / length;
+
+    const float* const p = vertices_[tri[0]].position;
+    const double d = -(a * p[0] + b * p[1] + c * p[2]);
+
+    for (const unsigned int v : tri)
+      quadrics_[v].add_plane(a, b, c, d);
+  }
+}
+
+std::vector<unsigned int> Simplifier::neighbors(unsigned int v) const
+{
+  std::vector<unsigned int> result;
+
+  for (const unsigned int t : vertex_triangles_[v])
+    for (const unsigned int w : triangles_[t])
+      if (w != v)
+        result.push_back(w);
+
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+
+  return result;
+}
+
+void Simplifier::push_candidate(unsigned int from, unsigned int to)
+{
+  if (locked_[from])
+    return;
+
+  const float* const p = vertices_[to].position;
+
+  Quadric quadric = quadrics_[from];
+  quadric += quadrics_[to];
+
+  queue_.push({std::max(0., quadric.evaluate(p[0], p[1], p[2])),
+               from, to, stamps_[from], stamps_[to]});
+}
+
+/*
+ * Check the link condition to keep the mesh manifold, and make sure
+ * that none of the remaining triangles around the moved vertex flips.
+ */
+bool Simplifier::collapse_allowed(unsigned int from, unsigned int to) const
+{
+  const auto from_neighbors = neighbors(from);
+  const auto to_neighbors   = neighbors(to);
+
+  std::vector<unsigned int> common;
+  std::set_intersection(from_neighbors.begin(), from_neighbors.end(),
+                        to_neighbors.begin(), to_neighbors.end(),
+                        std::back_inserter(common));
+  unsigned int shared = 0;
+
+  for (const unsigned int t : vertex_triangles_[from])
+  {
+    const auto& tri = triangles_[t];
+
+    if (std::find(tri.begin(), tri.end(), to) != tri.end())
+    {
+      ++shared;
+      continue;
+    }
+    Triangle moved = tri;
+    std::replace(moved.begin(), moved.end(), from, to);
+
+    const auto before = face_normal(vertices_, tri[0], tri[1], tri[2]);
+    const auto after  = face_normal(vertices_, moved[0], moved[1], moved[2]);
+
+    const double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+
+    if (!(dot > 0.))
+      return false;
+  }
+  return (shared > 0 && common.size() == shared);
+}
+
+void Simplifier::collapse(unsigned int from, unsigned int to)
+{
+  for (const unsigned int t : vertex_triangles_[from])
+  {
+    auto& tri = triangles_[t];
+
+    if (std::find(tri.begin(), tri.end(), to) != tri.end())
+    {
+      // Degenerate after the collapse; remove from the other vertices.
+      triangle_alive_[t] = false;
+      --triangle_count_;
+
+      for (const unsigned int v : tri)
+        if (v != from)
+        {
+          auto& list = vertex_triangles_[v];
+          list.erase(std::find(list.begin(), list.end(), t));
+        }
+    }
+    else
+    {
+      std::replace(tri.begin(), tri.end(), from, to);
+      vertex_triangles_[to].push_back(t);
+    }
+  }
+  vertex_triangles_[from].clear();
+  vertex_alive_[from] = false;
+  quadrics_[to] += quadrics_[from];
+
+  ++stamps_[to];
+  const auto around = neighbors(to);
+
+  for (const unsigned int w : around)
+    ++stamps_[w];
+
+  for (const unsigned int w : around)
+  {
+    push_candidate(w, to);
+    push_candidate(to, w);
+  }
+}
+
+std::vector<SourceIndex> Simplifier::run(std::size_t target_count, double max_error)
+{
+  for (const auto& tri : triangles_)
+    for (int k = 0; k < 3; ++k)
+    {
+      push_candidate(tri[k], tri[(k + 1) % 3]);
+      push_candidate(tri[(k + 1) % 3], tri[k]);
+    }
+
+  while (triangle_count_ > target_count && !queue_.empty())
+  {
+    const Collapse candidate = queue_.top();
+    queue_.pop();
+
+    if (candidate.cost > max_error)
+      break;
+
+    if (!vertex_alive_[candidate.from] || !vertex_alive_[candidate.to]
+        || candidate.from_stamp != stamps_[candidate.from]
+        || candidate.to_stamp != stamps_[candidate.to])
+      continue; // stale
+
+    if (collapse_allowed(candidate.from, candidate.to))
+      collapse(candidate.from, candidate.to);
+  }
+
+  std::vector<SourceIndex> result;
+  result.reserve(3 * triangle_count_);
+
+  for (std::size_t t = 0; t < triangles_.size(); ++t)
+    if (triangle_alive_[t])
+      result.insert(result.end(), triangles_[t].begin(), triangles_[t].end());
+
+  return result;
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+std::vector<SourceIndex> simplify_mesh(const std::vector<SourceIndex>& indices,
+                                       const std::vector<SourceVertex>& vertices,
+                                       std::size_t target_count, float max_error)
+{
+  g_return_val_if_fail(indices.size() % 3 == 0, indices);
+
+  for (const SourceIndex index : indices)
+    g_return_val_if_fail(index < vertices.size(), indices);
+
+  Simplifier simplifier {indices, vertices};
+
+  return simplifier.run(target_count, max_error);
+}
+
+} // namespace Somato
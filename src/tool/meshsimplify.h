@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_MESHSIMPLIFY_H_INCLUDED
+#define SOMATO_MESHSIMPLIFY_H_INCLUDED
+
+#include "meshloader.h"
+#include "meshtypes.h"
+
+#include <vector>
+#include <cstddef>
+
+namespace Somato
+{
+
+/* Simplify a triangle mesh by quadric error metric half-edge collapses,
+ * until no more than target_count triangles are left or the next collapse
+ * would exceed max_error, given as squared distance. Vertices on open
+ * boundaries and attribute seams stay in place. As no new vertices are
+ * created, the simplified triangles refer to a subset of the original
+ * vertices.
+ */
+std::vector<SourceIndex> simplify_mesh(const std::vector<SourceIndex>& indices,
+                                       const std::vector<SourceVertex>& vertices,
+                                       std::size_t target_count, float max_error);
+
+} // namespace Somato
+
+#endif // !SOMATO_MESHSIMPLIFY_H_INCLUDED
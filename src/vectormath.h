@@ -127,6 +127,12 @@ private:
                    const Simd::V4f& c2, const Simd::V4f& c3)
     : m_ {c0, c1, c2, c3} {}
 
+  // Access an array of matrices as one contiguous array of columns.
+  static const Simd::V4f* columns(const Matrix4* m)
+    { return reinterpret_cast<const Simd::V4f*>(m); }
+  static Simd::V4f* columns(Matrix4* m)
+    { return reinterpret_cast<Simd::V4f*>(m); }
+
 public:
   typedef Vector4::value_type value_type;
   typedef Vector4::size_type  size_type;
@@ -166,6 +172,21 @@ public:
   friend Matrix4 transpose(const Matrix4& m)
     { Matrix4 r (uninitialized); Simd::mat4_transpose(m.m_, r.m_); return r; }
 
+  // Batched operations. transform_batch() takes the vectors as separate
+  // arrays of their x, y, z and w components; a null w array stands for
+  // w = 1, and null output arrays are skipped. mul_batch() computes
+  // result[i] = a * b[i], where b may alias result.
+  friend void transform_batch(const Matrix4& a, const value_type* const src[4],
+                              value_type* const dst[4], size_type count)
+    { Simd::mat4_mul_mv_batch(a.m_, src, dst, count); }
+  friend void mul_batch(const Matrix4& a, const Matrix4* b, Matrix4* result, size_type count)
+    { Simd::mat4_mul_mm_batch(a.m_, columns(b), columns(result), count); }
+
+  // Write the first three rows of each matrix, 12 values per matrix,
+  // as expected by glUniformMatrix3x4fv() without transposition.
+  friend void transpose_3x4_batch(const Matrix4* m, value_type* result, size_type count)
+    { Simd::mat4_transpose_3x4_batch(columns(m), result, count); }
+
   value_type*       operator[](size_type i)       { return &Simd::ref4s(m_[i], 0); }
   const value_type* operator[](size_type i) const { return &Simd::ref4s(m_[i], 0); }
 };
@@ -259,6 +280,9 @@ public:
   value_type z() const { return Simd::ext4s<3>(v_); }
 };
 
+static_assert(sizeof(Matrix4) == 4 * sizeof(Simd::V4f),
+              "Matrix4 arrays must be contiguous arrays of columns");
+
 inline Matrix4 Matrix4::from_quaternion(const Quat& quat)
 {
   Matrix4 result (uninitialized);
@@ -0,0 +1,665 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "voxelmesher.h"
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+using namespace Somato;
+
+/* Width of the bevel along convex edges, in cell units.
+ */
+const float bevel_width = 0.1;
+
+/* Number of sample layers per cell and axis. The two outer layers on
+ * each side have the width of the bevel, so that the surface rounds off
+ * within that distance from the cell boundary.
+ */
+enum { CELL_LAYERS = 5 };
+
+/* Coordinates of the layer centers within a cell.
+ */
+const float layer_offsets[CELL_LAYERS] =
+{
+  0.5f * bevel_width, 1.5f * bevel_width, 0.5f, 1.f - 1.5f * bevel_width, 1.f - 0.5f * bevel_width
+};
+
+enum { FLAT_NORMALS = 6, NORMAL_CLASSES = 7 };
+
+struct Vec3
+{
+  float v[3] = {0., 0., 0.};
+
+  float& operator[](int i) { return v[i]; }
+  float  operator[](int i) const { return v[i]; }
+};
+
+Vec3 operator-(const Vec3& a, const Vec3& b)
+{
+  Vec3 r;
+  for (int i = 0; i < 3; ++i)
+    r[i] = a[i] - b[i];
+  return r;
+}
+
+Vec3 cross(const Vec3& a, const Vec3& b)
+{
+  Vec3 r;
+  r[0] = a[1] * b[2] - a[2] * b[1];
+  r[1] = a[2] * b[0] - a[0] * b[2];
+  r[2] = a[0] * b[1] - a[1] * b[0];
+  return r;
+}
+
+float length(const Vec3& a)
+{
+  return std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+}
+
+/* Surface quadrilateral around a sample grid edge. The vertices refer to
+ * dual grid cells and are ordered counterclockwise as seen from outside.
+ */
+struct Quad
+{
+  int  vertices[4];
+  int  axis;     // axis of the sample grid edge
+  int  slice;    // edge start sample along the axis
+  int  u, v;     // edge position across the axis
+  bool positive; // whether the outside lies in positive axis direction
+  bool flat;     // whether the quad lies in the plane between the samples
+};
+
+/*
+ * Mesh the boundary of the occupied cells with naive surface nets on a
+ * sample grid which is refined near the cell boundaries. Each dual cell
+ * straddling the surface contributes one vertex at the centroid of its
+ * edge crossings. This keeps flat faces flat, and rounds off convex and
+ * concave edges within the width of the outer sample layers. Flat quads
+ * of the same plane are then merged greedily into larger polygons.
+ */
+template <int N>
+class VoxelMeshBuilder
+{
+public:
+  explicit VoxelMeshBuilder(BitCube<N> mask);
+  VoxelMesh build();
+
+private:
+  enum { M = CELL_LAYERS * N + 2, D = M - 1 };
+
+  static int sample_cell(int s) { return (s - 1 + CELL_LAYERS) / CELL_LAYERS - 1; }
+  static int dual_index(int x, int y, int z) { return (x * D + y) * D + z; }
+
+  bool inside(int x, int y, int z) const;
+  void place_dual_vertices();
+  void collect_quads();
+  void merge_flat_quads(int axis, int slice, bool positive);
+  void emit_quad(const Quad& quad);
+  void emit_polygon(const std::vector<int>& boundary, int normal_class);
+  int  emit_vertex(int dual, int normal_class);
+  int  emit_center_vertex(const std::vector<int>& boundary);
+
+  BitCube<N>              mask_;
+  float                   coords_[M];
+  std::vector<int>        dual_vertices_;
+  std::vector<Vec3>       positions_;
+  std::vector<Vec3>       normal_sums_;
+  std::vector<int>        use_counts_;
+  std::vector<Quad>       quads_;
+  std::vector<int>        quad_at_;  // quad per sample edge of a slice
+  std::vector<bool>       merged_;
+  std::vector<int>        vertex_map_;
+  std::vector<Vec3>       out_positions_;
+  std::vector<Vec3>       out_normals_;
+  std::vector<int>        out_indices_;
+};
+
+template <int N>
+VoxelMeshBuilder<N>::VoxelMeshBuilder(BitCube<N> mask)
+:
+  mask_          {mask},
+  dual_vertices_ (D * D * D, -1),
+  quad_at_       (M * M, -1)
+{
+  coords_[0] = -0.5f * bevel_width;
+  coords_[M - 1] = N + 0.5f * bevel_width;
+
+  for (int s = 1; s < M - 1; ++s)
+    coords_[s] = sample_cell(s) + layer_offsets[(s - 1) % CELL_LAYERS];
+}
+
+template <int N>
+bool VoxelMeshBuilder<N>::inside(int x, int y, int z) const
+{
+  const int cx = sample_cell(x);
+  const int cy = sample_cell(y);
+  const int cz = sample_cell(z);
+
+  return (cx >= 0 && cx < N && cy >= 0 && cy < N && cz >= 0 && cz < N
+          && mask_.get(cx, cy, cz));
+}
+
+template <int N>
+void VoxelMeshBuilder<N>::place_dual_vertices()
+{
+  for (int x = 0; x < D; ++x)
+    for (int y = 0; y < D; ++y)
+      for (int z = 0; z < D; ++z)
+      {
+        bool corners[8];
+        for (int i = 0; i < 8; ++i)
+          corners[i] = inside(x + (i >> 2), y + ((i >> 1) & 1), z + (i & 1));
+
+        Vec3 sum;
+        int  count = 0;
+
+        // Visit the 12 edges of the dual cell, 4 per axis.
+        for (int axis = 0; axis < 3; ++axis)
+          for (int i = 0; i < 8; ++i)
+          {
+            const int bit = 4 >> axis;
+            const int j = i | bit;
+
+            if ((i & bit) || corners[i] == corners[j])
+              continue;
+
+            const int base[3] = {x + (i >> 2), y + ((i >> 1) & 1), z + (i & 1)};
+
+            for (int k = 0; k < 3; ++k)
+              sum[k] += (k == axis) ? 0.5f * (coords_[base[k]] + coords_[base[k] + 1])
+                                    : coords_[base[k]];
+            ++count;
+          }
+
+        if (count > 0)
+        {
+          for (int k = 0; k < 3; ++k)
+            sum[k] /= count;
+
+          dual_vertices_[dual_index(x, y, z)] = positions_.size();
+          positions_.push_back(sum);
+        }
+      }
+
+  normal_sums_.resize(positions_.size());
+  use_counts_.resize(positions_.size());
+}
+
+template <int N>
+void VoxelMeshBuilder<N>::collect_quads()
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+
+    for (int a = 0; a < M - 1; ++a)
+      for (int b = 1; b < M - 1; ++b)
+        for (int c = 1; c < M - 1; ++c)
+        {
+          int s[3];
+          s[axis] = a; s[u] = b; s[v] = c;
+          const bool first = inside(s[0], s[1], s[2]);
+          ++s[axis];
+          const bool second = inside(s[0], s[1], s[2]);
+
+          if (first == second)
+            continue;
+
+          Quad quad;
+          quad.axis  = axis;
+          quad.slice = a;
+          quad.u = b;
+          quad.v = c;
+          quad.positive = first;
+
+          static const int corners[4][2] = {{-1, -1}, {0, -1}, {0, 0}, {-1, 0}};
+
+          for (int i = 0; i < 4; ++i)
+          {
+            int d[3];
+            d[axis] = a;
+            d[u] = b + corners[i][0];
+            d[v] = c + corners[i][1];
+            quad.vertices[(first) ? i : 3 - i] = dual_vertices_[dual_index(d[0], d[1], d[2])];
+          }
+
+          const float plane = 0.5f * (coords_[a] + coords_[a + 1]);
+          quad.flat = true;
+
+          for (const int i : quad.vertices)
+          {
+            ++use_counts_[i];
+            quad.flat = quad.flat && std::abs(positions_[i][axis] - plane) < 1e-5f;
+          }
+
+          // Twice the area-weighted normal of the quad.
+          const Vec3 normal = cross(positions_[quad.vertices[2]] - positions_[quad.vertices[0]],
+                                    positions_[quad.vertices[3]] - positions_[quad.vertices[1]]);
+          for (const int i : quad.vertices)
+            for (int k = 0; k < 3; ++k)
+              normal_sums_[i][k] += normal[k];
+
+          quads_.push_back(quad);
+        }
+  }
+  merged_.assign(quads_.size(), false);
+}
+
+template <int N>
+int VoxelMeshBuilder<N>::emit_vertex(int dual, int normal_class)
+{
+  int& mapped = vertex_map_[dual * NORMAL_CLASSES + normal_class];
+
+  if (mapped < 0)
+  {
+    Vec3 normal;
+
+    if (normal_class < FLAT_NORMALS)
+    {
+      normal[normal_class >> 1] = (normal_class & 1) ? -1.f : 1.f;
+    }
+    else
+    {
+      const Vec3& sum = normal_sums_[dual];
+      const float len = std::max(length(sum), 1e-12f);
+
+      for (int k = 0; k < 3; ++k)
+        normal[k] = sum[k] / len;
+    }
+    mapped = out_positions_.size();
+    out_positions_.push_back(positions_[dual]);
+    out_normals_.push_back(normal);
+  }
+  return mapped;
+}
+
+template <int N>
+int VoxelMeshBuilder<N>::emit_center_vertex(const std::vector<int>& boundary)
+{
+  Vec3 center;
+
+  for (const int i : boundary)
+    for (int k = 0; k < 3; ++k)
+      center[k] += out_positions_[i][k];
+
+  for (int k = 0; k < 3; ++k)
+    center[k] /= boundary.size();
+
+  out_positions_.push_back(center);
+  out_normals_.push_back(out_normals_[boundary.front()]);
+
+  return out_positions_.size() - 1;
+}
+
+template <int N>
+void VoxelMeshBuilder<N>::emit_quad(const Quad& quad)
+{
+  int v[4];
+  for (int i = 0; i < 4; ++i)
+    v[i] = emit_vertex(quad.vertices[i], (quad.flat) ? 2 * quad.axis + !quad.positive
+                                                     : FLAT_NORMALS);
+
+  // Split non-planar quads along the shorter diagonal.
+  const float d02 = length(out_positions_[v[2]] - out_positions_[v[0]]);
+  const float d13 = length(out_positions_[v[3]] - out_positions_[v[1]]);
+  const int r = (d13 < d02) ? 1 : 0;
+
+  out_indices_.insert(end(out_indices_), {v[r], v[r + 1], v[r + 2],
+                                          v[r], v[r + 2], v[(r + 3) % 4]});
+}
+
+/*
+ * Triangulate a convex polygon whose vertices all lie on the sides of a
+ * rectangle. Every boundary vertex is kept, since neighboring faces use
+ * them as corners, and skipping any of them would open up T-junctions.
+ */
+template <int N>
+void VoxelMeshBuilder<N>::emit_polygon(const std::vector<int>& duals, int normal_class)
+{
+  std::vector<int> boundary;
+  boundary.reserve(duals.size());
+
+  for (const int dual : duals)
+    boundary.push_back(emit_vertex(dual, normal_class));
+
+  const int count = boundary.size();
+
+  if (count == 4)
+  {
+    out_indices_.insert(end(out_indices_), {boundary[0], boundary[1], boundary[2],
+                                            boundary[0], boundary[2], boundary[3]});
+    return;
+  }
+  const int center = emit_center_vertex(boundary);
+
+  for (int i = 0; i < count; ++i)
+    out_indices_.insert(end(out_indices_), {center, boundary[i], boundary[(i + 1) % count]});
+}
+
+template <int N>
+void VoxelMeshBuilder<N>::merge_flat_quads(int axis, int slice, bool positive)
+{
+  const int u = (axis + 1) % 3;
+  const int v = (axis + 2) % 3;
+
+  const auto usable = [this](int q) { return (q >= 0 && !merged_[q]); };
+  const auto dual_at = [this, axis, u, v, slice](int a, int b)
+  {
+    int d[3];
+    d[axis] = slice; d[u] = a; d[v] = b;
+    return dual_vertices_[dual_index(d[0], d[1], d[2])];
+  };
+
+  for (int c0 = 1; c0 < M - 1; ++c0)
+    for (int b0 = 1; b0 < M - 1; ++b0)
+    {
+      if (!usable(quad_at_[b0 * M + c0]))
+        continue;
+
+      int b1 = b0;
+      while (b1 + 1 < M - 1 && usable(quad_at_[(b1 + 1) * M + c0]))
+        ++b1;
+
+      // Grow the rectangle row by row, as long as the vertices which
+      // end up in the interior are not used by any other quads.
+      int c1 = c0;
+      for (; c1 + 1 < M - 1; ++c1)
+      {
+        bool ok = true;
+
+        for (int b = b0; ok && b <= b1; ++b)
+          ok = usable(quad_at_[b * M + c1 + 1]);
+
+        for (int b = b0; ok && b < b1; ++b)
+          ok = (use_counts_[dual_at(b, c1)] == 4);
+
+        if (!ok)
+          break;
+      }
+
+      for (int b = b0; b <= b1; ++b)
+        for (int c = c0; c <= c1; ++c)
+          merged_[quad_at_[b * M + c]] = true;
+
+      // Walk around the rectangle corners in dual grid coordinates.
+      std::vector<int> boundary;
+
+      for (int b = b0 - 1; b < b1; ++b)
+        boundary.push_back(dual_at(b, c0 - 1));
+      for (int c = c0 - 1; c < c1; ++c)
+        boundary.push_back(dual_at(b1, c));
+      for (int b = b1; b > b0 - 1; --b)
+        boundary.push_back(dual_at(b, c1));
+      for (int c = c1; c > c0 - 1; --c)
+        boundary.push_back(dual_at(b0 - 1, c));
+
+      if (!positive)
+        std::reverse(begin(boundary), end(boundary));
+
+      emit_polygon(boundary, 2 * axis + !positive);
+    }
+}
+
+template <int N>
+VoxelMesh VoxelMeshBuilder<N>::build()
+{
+  place_dual_vertices();
+  collect_quads();
+
+  vertex_map_.assign(positions_.size() * NORMAL_CLASSES, -1);
+
+  for (int axis = 0; axis < 3; ++axis)
+    for (int slice = 0; slice < M - 1; ++slice)
+      for (const bool positive : {true, false})
+      {
+        std::fill(begin(quad_at_), end(quad_at_), -1);
+        bool any = false;
+
+        for (size_t i = 0; i < quads_.size(); ++i)
+        {
+          const Quad& quad = quads_[i];
+
+          if (quad.flat && quad.axis == axis && quad.slice == slice
+              && quad.positive == positive)
+          {
+            quad_at_[quad.u * M + quad.v] = i;
+            any = true;
+          }
+        }
+        if (any)
+          merge_flat_quads(axis, slice, positive);
+      }
+
+  for (size_t i = 0; i < quads_.size(); ++i)
+    if (!merged_[i])
+      emit_quad(quads_[i]);
+
+  // Center the mesh on the cube and quantize it with a uniform scale.
+  VoxelMesh mesh;
+  float lower[3] = {G_MAXFLOAT, G_MAXFLOAT, G_MAXFLOAT};
+  float upper[3] = {-G_MAXFLOAT, -G_MAXFLOAT, -G_MAXFLOAT};
+
+  for (const Vec3& p : out_positions_)
+    for (int k = 0; k < 3; ++k)
+    {
+      lower[k] = std::min(lower[k], p[k]);
+      upper[k] = std::max(upper[k], p[k]);
+    }
+
+  float extent = 0.;
+  for (int k = 0; k < 3; ++k)
+  {
+    mesh.bias[k] = (0.5f * (lower[k] + upper[k]) - 0.5f * N) * grid_cell_size;
+    extent = std::max(extent, 0.5f * (upper[k] - lower[k]) * grid_cell_size);
+  }
+  mesh.scale = (extent > 0.f) ? extent : 1.f;
+
+  mesh.vertices.resize(out_positions_.size());
+
+  for (size_t i = 0; i < out_positions_.size(); ++i)
+  {
+    const Vec3& p = out_positions_[i];
+    const Vec3& n = out_normals_[i];
+    float q[3];
+
+    for (int k = 0; k < 3; ++k)
+      q[k] = ((p[k] - 0.5f * N) * grid_cell_size - mesh.bias[k]) / mesh.scale;
+
+    mesh.vertices[i].set(q[0], q[1], q[2], n[0], n[1], n[2]);
+  }
+  mesh.indices.assign(begin(out_indices_), end(out_indices_));
+
+  return mesh;
+}
+
+/* Process-wide cache of generated meshes, keyed by piece mask.
+ */
+class VoxelMeshCache
+{
+public:
+  std::shared_ptr<const VoxelMesh> lookup(SomaBitCube mask);
+
+private:
+  std::mutex mutex_;
+  std::map<SomaBitCube, std::shared_ptr<const VoxelMesh>, SomaBitCube::SortPredicate> meshes_;
+};
+
+std::shared_ptr<const VoxelMesh> VoxelMeshCache::lookup(SomaBitCube mask)
+{
+  {
+    std::lock_guard<std::mutex> lock {mutex_};
+    const auto pos = meshes_.find(mask);
+
+    if (pos != meshes_.end())
+      return pos->second;
+  }
+  // Build outside of the lock. In the unlikely case that two workers race
+  // for the same mask, the first result to be inserted is kept.
+  auto mesh = std::make_shared<const VoxelMesh>(build_voxel_mesh(mask));
+
+  std::lock_guard<std::mutex> lock {mutex_};
+  return meshes_.emplace(mask, std::move(mesh)).first->second;
+}
+
+VoxelMeshCache voxel_mesh_cache;
+
+template <typename T>
+Glib::RefPtr<const Glib::Bytes> create_bytes(const std::vector<T>& data)
+{
+  return Glib::Bytes::create(data.data(), data.size() * sizeof(T));
+}
+
+} // anonymous namespace
+
+namespace Somato
+{
+
+template <int N>
+VoxelMesh build_voxel_mesh(BitCube<N> mask)
+{
+  return VoxelMeshBuilder<N>{mask}.build();
+}
+
+template VoxelMesh build_voxel_mesh<3>(BitCube<3> mask);
+template VoxelMesh build_voxel_mesh<4>(BitCube<4> mask);
+
+VoxelMesher::VoxelMesher(const SomaCube& pieces)
+:
+  pieces_ {pieces}
+{}
+
+VoxelMesher::~VoxelMesher()
+{
+  wait_finish();
+}
+
+SceneData VoxelMesher::acquire_results()
+{
+  rethrow_any_error();
+  return std::move(data_);
+}
+
+void VoxelMesher::execute()
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  std::array<std::shared_ptr<const VoxelMesh>, SomaCube::COUNT> meshes;
+  std::array<std::exception_ptr, SomaCube::COUNT> errors;
+  std::atomic<int> next_piece {0};
+
+  const auto worker = [&]
+  {
+    int i;
+    while ((i = next_piece++) < SomaCube::COUNT)
+    {
+      // Puzzles of fewer pieces leave the remaining ones empty.
+      if (pieces_[i].empty())
+        continue;
+
+      try
+      {
+        meshes[i] = voxel_mesh_cache.lookup(pieces_[i]);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+  const int thread_count = std::min<int>(std::max(1u, std::thread::hardware_concurrency()),
+                                         SomaCube::COUNT);
+  std::vector<std::thread> threads;
+
+  for (int i = 1; i < thread_count; ++i)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : threads)
+    thread.join();
+
+  for (const auto& error : errors)
+    if (error)
+      std::rethrow_exception(error);
+
+  // Concatenate the meshes in the layout of the baked mesh data. The
+  // generated meshes have a single level of detail and are not split
+  // into clusters.
+  std::vector<MeshDesc>   descs (SomaCube::COUNT);
+  std::vector<MeshVertex> vertices;
+  std::vector<MeshIndex>  indices;
+
+  for (int i = 0; i < SomaCube::COUNT; ++i)
+  {
+    if (!meshes[i])
+      continue;
+
+    const VoxelMesh& mesh = *meshes[i];
+    MeshDesc& desc = descs[i];
+
+    desc.element_first = vertices.size();
+    desc.element_last  = vertices.size() + mesh.vertices.size() - 1;
+
+    if (mesh.vertices.empty() || mesh.vertices.size() > G_MAXUINT16)
+      throw Error{Glib::ustring::compose("Invalid generated mesh %1", i)};
+
+    desc.index_size = sizeof(MeshIndex);
+    desc.scale      = mesh.scale;
+    std::copy(std::begin(mesh.bias), std::end(mesh.bias), desc.bias);
+
+    for (auto& lod : desc.lod)
+    {
+      lod.triangle_count = mesh.indices.size() / 3;
+      lod.indices_offset = indices.size() * sizeof(MeshIndex);
+    }
+    vertices.insert(end(vertices), begin(mesh.vertices), end(mesh.vertices));
+    indices.insert(end(indices), begin(mesh.indices), end(mesh.indices));
+    indices.resize(aligned_index_count(indices.size()), ~MeshIndex{0});
+  }
+  data_.mesh_desc     = create_bytes(descs);
+  data_.mesh_vertices = create_bytes(vertices);
+  data_.mesh_indices  = create_bytes(indices);
+  data_.mesh_clusters = create_bytes(std::vector<MeshCluster>{});
+
+  const auto stop = std::chrono::steady_clock::now();
+  const std::chrono::duration<double, std::milli> elapsed = stop - start;
+
+  g_info("Voxel mesh generation time: %0.1f ms", elapsed.count());
+}
+
+} // namespace Somato
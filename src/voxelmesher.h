@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2004-2017  Daniel Elstner  <daniel.kitta@gmail.com>
+ *
+ * This file is part of Somato.
+ *
+ * Somato is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Somato is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Somato.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOMATO_VOXELMESHER_H_INCLUDED
+#define SOMATO_VOXELMESHER_H_INCLUDED
+
+#include "asynctask.h"
+#include "bitcube.h"
+#include "meshtypes.h"
+#include "puzzle.h"
+#include "sceneloader.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Somato
+{
+
+/* Triangle mesh generated from a cube piece mask. The quantized positions
+ * are relative to the cube center, so no further piece transformation is
+ * needed to put the mesh in place.
+ */
+struct VoxelMesh
+{
+  std::vector<MeshVertex> vertices;
+  std::vector<MeshIndex>  indices;
+  float                   scale   = 1.;
+  float                   bias[3] = {0., 0., 0.};
+};
+
+/* Build a watertight mesh with beveled edges from the occupied cells of
+ * the mask. Coplanar faces are merged across cell boundaries.
+ */
+template <int N> VoxelMesh build_voxel_mesh(BitCube<N> mask);
+
+/*
+ * Generate the meshes of a set of puzzle pieces on worker threads. The
+ * results are laid out like the baked scene data, with one mesh per
+ * piece in the original order. Meshes are cached per distinct piece mask
+ * for the lifetime of the process.
+ *
+ * Although build_voxel_mesh() handles any cube size, the task takes the
+ * pieces of a SomaCube, as that is what CubeScene displays.
+ */
+class VoxelMesher : public Async::Task
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit Error(const std::string& message) : std::runtime_error(message) {}
+  };
+
+  explicit VoxelMesher(const SomaCube& pieces);
+  virtual ~VoxelMesher();
+
+  const SomaCube& get_pieces() const { return pieces_; }
+  SceneData acquire_results();
+
+private:
+  void execute() override;
+
+  SomaCube  pieces_;
+  SceneData data_;
+};
+
+} // namespace Somato
+
+#endif // !SOMATO_VOXELMESHER_H_INCLUDED
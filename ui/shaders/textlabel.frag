@@ -1,6 +1,3 @@
-#ifdef GL_ARB_texture_gather
-# extension GL_ARB_texture_gather : require
-#endif
 precision mediump float;
 
 uniform sampler2D labelTexture;
@@ -12,15 +9,20 @@ out vec4 outputColor;
 
 void main()
 {
-#if __VERSION__ >= 400 || (defined(GL_ES) && __VERSION__ >= 310) || defined(GL_ARB_texture_gather)
-  vec4 textQuad = textureGather(labelTexture, varTexcoord);
-  vec2 shadow = max(textQuad.rg, textQuad.ba);
-  float alpha = max(shadow.r, shadow.g);
-  float text  = textQuad.g;
-#else
-  float shadow = texture(labelTexture, varTexcoord).r;
-  float text   = textureOffset(labelTexture, varTexcoord, ivec2(1, 1)).r;
+  // Texture coordinate steps of one pixel right and down in the window.
+  vec2 pixelRight = dFdx(varTexcoord);
+  vec2 pixelDown  = -dFdy(varTexcoord);
+
+  // Sample the signed distance field, with the outline at 0.5, for the
+  // text itself and for the shadow one pixel to the lower right of it.
+  float textDist   = texture(labelTexture, varTexcoord).r;
+  float shadowDist = texture(labelTexture, varTexcoord - pixelRight - pixelDown).r;
+
+  // Antialias the edges over about one pixel at any scale.
+  float edge   = 0.7 * fwidth(textDist);
+  float text   = smoothstep(0.5 - edge, 0.5 + edge, textDist);
+  float shadow = smoothstep(0.5 - edge, 0.5 + edge, shadowDist);
   float alpha  = max(text, shadow);
-#endif
+
   outputColor = vec4(varColor * text, alpha);
 }